@@ -4,15 +4,29 @@ Model Analysis Tool
 Analyzes the neural network model file and provides comprehensive statistics.
 """
 
+import re
 import sys
 import numpy as np
 from collections import Counter
 
 # Network architecture constants
 INPUT_SIZE = 27
-HIDDEN_SIZE = 64
+DEFAULT_HIDDEN_SIZE = 64  # Shape of models saved before the "# Shape: 27xH" header
 OUTPUT_SIZE = 1
 
+def read_hidden_size(lines):
+    """Hidden size from the "# Shape: 27xH" header (DEFAULT_HIDDEN_SIZE for older files)."""
+    for line in lines:
+        line = line.strip()
+        if line and not line.startswith('#'):
+            break  # The header comes before the first data line
+        match = re.match(r'# Shape: (\d+)x(\d+)', line)
+        if match:
+            if int(match.group(1)) != INPUT_SIZE:
+                raise ValueError(f"model has {match.group(1)} inputs, expected {INPUT_SIZE}")
+            return int(match.group(2))
+    return DEFAULT_HIDDEN_SIZE
+
 def load_model(filename):
     """Load model from file and extract weights/biases."""
     weights1 = []
@@ -23,6 +37,7 @@ def load_model(filename):
     
     with open(filename, 'r') as f:
         lines = f.readlines()
+    hidden_size = read_hidden_size(lines)
     
     # Parse header/metadata
     data_start = 0
@@ -69,26 +84,26 @@ def load_model(filename):
     # Parse weights and biases
     current_line = data_start
     
-    # Load weights1 (INPUT_SIZE rows, HIDDEN_SIZE columns each)
+    # Load weights1 (INPUT_SIZE rows, hidden_size columns each)
     for i in range(INPUT_SIZE):
         if current_line >= len(lines):
             break
         line = lines[current_line].strip()
         if line and not line.startswith('#'):
             weights = [float(x) for x in line.split() if x]
-            if len(weights) == HIDDEN_SIZE:
+            if len(weights) == hidden_size:
                 weights1.append(weights)
             current_line += 1
     
-    # Load bias1 (HIDDEN_SIZE values)
+    # Load bias1 (hidden_size values)
     if current_line < len(lines):
         line = lines[current_line].strip()
         if line and not line.startswith('#'):
             bias1 = [float(x) for x in line.split() if x]
             current_line += 1
     
-    # Load weights2 (HIDDEN_SIZE rows, OUTPUT_SIZE columns each)
-    for i in range(HIDDEN_SIZE):
+    # Load weights2 (hidden_size rows, OUTPUT_SIZE columns each)
+    for i in range(hidden_size):
         if current_line >= len(lines):
             break
         line = lines[current_line].strip()
@@ -104,7 +119,7 @@ def load_model(filename):
         if line and not line.startswith('#'):
             bias2 = [float(x) for x in line.split() if x]
     
-    return weights1, bias1, weights2, bias2, metadata
+    return weights1, bias1, weights2, bias2, metadata, hidden_size
 
 def analyze_array(arr, name):
     """Analyze an array and return statistics."""
@@ -159,18 +174,19 @@ def print_analysis(filename):
     print()
     
     try:
-        weights1, bias1, weights2, bias2, metadata = load_model(filename)
+        weights1, bias1, weights2, bias2, metadata, hidden_size = load_model(filename)
     except Exception as e:
         print(f"ERROR: Failed to load model: {e}")
         return
+    print(f"Shape: {INPUT_SIZE}x{hidden_size}x{OUTPUT_SIZE}")
     
     # Check if model loaded correctly
     if len(weights1) != INPUT_SIZE:
         print(f"WARNING: Expected {INPUT_SIZE} rows in weights1, got {len(weights1)}")
-    if len(bias1) != HIDDEN_SIZE:
-        print(f"WARNING: Expected {HIDDEN_SIZE} values in bias1, got {len(bias1)}")
-    if len(weights2) != HIDDEN_SIZE:
-        print(f"WARNING: Expected {HIDDEN_SIZE} rows in weights2, got {len(weights2)}")
+    if len(bias1) != hidden_size:
+        print(f"WARNING: Expected {hidden_size} values in bias1, got {len(bias1)}")
+    if len(weights2) != hidden_size:
+        print(f"WARNING: Expected {hidden_size} rows in weights2, got {len(weights2)}")
     if len(bias2) != OUTPUT_SIZE:
         print(f"WARNING: Expected {OUTPUT_SIZE} values in bias2, got {len(bias2)}")
     print()
@@ -0,0 +1,1511 @@
+#include "diagnostics.h"
+#include "rl_agent.h"
+#include "game_classes.h"
+#include "replay_buffer.h"
+#include "weight_snapshot.h"
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+// Double-precision copy of the network, used as the reference path
+struct ReferenceNetwork {
+    std::vector<double> weights1;  // INPUT_SIZE x hidden_size, row per input
+    std::vector<double> bias1;
+    std::vector<double> weights2;
+    double bias2;
+    int hidden_size;
+    
+    double forward(const std::vector<double>& input) const {
+        const int H = hidden_size;
+        double output = bias2;
+        for (int i = 0; i < H; i++) {
+            double sum = bias1[i];
+            for (int j = 0; j < NeuralNetwork::INPUT_SIZE; j++) {
+                sum += input[j] * weights1[j * H + i];
+            }
+            output += std::max(0.2 * sum, sum) * weights2[i];
+        }
+        return std::max(-200.0, std::min(200.0, output));
+    }
+};
+
+// Build the reference from the model file at full precision (same clipping as load()),
+// or from the network's own weights when there is no model file
+ReferenceNetwork buildReference(const std::string& model_file, const NeuralNetwork& net, bool from_file) {
+    const int I = NeuralNetwork::INPUT_SIZE;
+    const int H = net.hidden_size;
+    ReferenceNetwork ref;
+    ref.hidden_size = H;
+    std::vector<double> values;
+    if (from_file && NeuralNetwork::readParameters(model_file, net.parameterCount(), values)) {
+        for (double& v : values) {
+            v = std::max(-NeuralNetwork::LOAD_WEIGHT_LIMIT, std::min(NeuralNetwork::LOAD_WEIGHT_LIMIT, v));
+        }
+    } else {
+        values.insert(values.end(), net.weights1.begin(), net.weights1.begin() + I * H);
+        values.insert(values.end(), net.bias1.begin(), net.bias1.begin() + H);
+        values.insert(values.end(), net.weights2.begin(), net.weights2.begin() + H);
+        values.insert(values.end(), net.bias2.begin(), net.bias2.end());
+    }
+    ref.weights1.assign(values.begin(), values.begin() + I * H);
+    ref.bias1.assign(values.begin() + I * H, values.begin() + I * H + H);
+    ref.weights2.assign(values.begin() + I * H + H, values.begin() + I * H + 2 * H);
+    ref.bias2 = values[I * H + 2 * H];
+    return ref;
+}
+
+// Plausible feature vector: same layout and normalisation as RLAgent::extractState
+std::vector<double> randomState(std::mt19937& gen, int next_piece) {
+    std::vector<double> state(NeuralNetwork::INPUT_SIZE, 0.0);
+    std::uniform_int_distribution<int> height_dist(0, 20);
+    std::uniform_int_distribution<int> piece_dist(0, 6);
+    std::uniform_int_distribution<int> hole_dist(0, 40);
+    int heights[10];
+    int max_height = 0;
+    int bumpiness = 0;
+    for (int x = 0; x < 10; x++) {
+        heights[x] = height_dist(gen) / 2;
+        max_height = std::max(max_height, heights[x]);
+        state[x] = heights[x] / 20.0;
+        if (x > 0) bumpiness += std::abs(heights[x] - heights[x - 1]);
+    }
+    state[10] = max_height / 20.0;
+    state[11] = std::min(1.0, hole_dist(gen) / 200.0);
+    state[12] = std::min(1.0, bumpiness / 180.0);
+    if (gen() % 2) state[13 + piece_dist(gen)] = 1.0;  // Current piece (absent for afterstates)
+    state[20 + next_piece] = 1.0;
+    return state;
+}
+
+// Random board in replay form: columns up to half height, with some holes under the surface
+PackedState randomPackedState(std::mt19937& gen, int next_piece) {
+    PackedState packed;
+    packed.clear();
+    for (int x = 0; x < PackedState::COLUMNS; x++) {
+        int top = PackedState::ROWS - int(gen() % (PackedState::ROWS / 2 + 1));
+        for (int y = top; y < PackedState::ROWS; y++) {
+            if (y == top || gen() % 5 != 0) packed.setCell(x, y);
+        }
+    }
+    packed.current_piece = (gen() % 2) ? int8_t(gen() % 7) : int8_t(-1);  // Absent for afterstates
+    packed.next_piece = int8_t(next_piece);
+    return packed;
+}
+
+// Afterstates scored by findBestMove, grouped by decision
+struct PositionCorpus {
+    std::vector<nn_real> states;      // INPUT_SIZE values per afterstate
+    std::vector<int> decision_start;  // First afterstate of each decision, plus the total at the end
+    
+    int decisions() const { return decision_start.empty() ? 0 : int(decision_start.size()) - 1; }
+};
+
+// Text format: "DECISION <count>" followed by one line of INPUT_SIZE values per afterstate
+bool loadCorpus(const std::string& filename, PositionCorpus& corpus) {
+    std::ifstream file(filename);
+    if (!file.is_open()) return false;
+    std::string line;
+    int afterstates = 0;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        std::string key;
+        int count = 0;
+        if (!(iss >> key) || key != "DECISION" || !(iss >> count)) continue;
+        corpus.decision_start.push_back(afterstates);
+        for (int n = 0; n < count * NeuralNetwork::INPUT_SIZE; n++) {
+            double value;
+            if (!(file >> value)) return false;
+            corpus.states.push_back(nn_real(value));
+        }
+        afterstates += count;
+    }
+    corpus.decision_start.push_back(afterstates);
+    return corpus.decisions() > 0;
+}
+
+void saveCorpus(const std::string& filename, const PositionCorpus& corpus) {
+    std::ofstream file(filename);
+    if (!file.is_open()) return;
+    const int I = NeuralNetwork::INPUT_SIZE;
+    file << "# Position corpus: afterstates scored by findBestMove, " << I << " features each\n";
+    for (int d = 0; d < corpus.decisions(); d++) {
+        file << "DECISION " << corpus.decision_start[d + 1] - corpus.decision_start[d] << "\n";
+        for (int n = corpus.decision_start[d]; n < corpus.decision_start[d + 1]; n++) {
+            for (int j = 0; j < I; j++) {
+                file << corpus.states[n * I + j] << (j + 1 < I ? " " : "\n");
+            }
+        }
+    }
+}
+
+// Play greedy games without the UI (fixed seed) and keep every decision's afterstates
+// Float vs quantized network on every afterstate of a corpus, compared on the raw outputs
+// (before the Q-value clamp) so saturated outputs still show the quantization error
+struct QuantizedComparison {
+    double max_abs;
+    double mean_abs;
+    int clamped;          // Float outputs beyond +/-200, where move selection sees a tie
+    int argmax_mismatch;  // Decisions whose best afterstate differs
+    double regret_sum;    // Float output lost by the quantized choice, over the mismatches
+    double regret_max;
+    double float_ns;      // Per forward pass
+    double quant_ns;
+    
+    double mismatchRate(const PositionCorpus& corpus) const {
+        return double(argmax_mismatch) / std::max(1, corpus.decisions());
+    }
+};
+
+QuantizedComparison compareQuantized(const NeuralNetwork& net, const PositionCorpus& corpus) {
+    const int I = NeuralNetwork::INPUT_SIZE;
+    const int samples = corpus.decision_start.empty() ? 0 : corpus.decision_start.back();
+    const NNKernels& k = net.kernels();
+    const NetworkView view = net.view();
+    const QuantizedView quantized = net.quantizedView();
+    std::vector<double> q(samples), q_quant(samples);
+    int16_t input[NN_INPUT_PAIRS * 2];
+    auto t0 = std::chrono::steady_clock::now();
+    for (int n = 0; n < samples; n++) {
+        q[n] = k.forward(view, &corpus.states[size_t(n) * I], nullptr);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int n = 0; n < samples; n++) {
+        nnQuantizeInput(&corpus.states[size_t(n) * I], input);
+        q_quant[n] = k.forward_quantized(quantized, input);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    
+    QuantizedComparison result = {};
+    double sum_abs = 0.0;
+    for (int n = 0; n < samples; n++) {
+        double diff = std::abs(q[n] - q_quant[n]);
+        result.max_abs = std::max(result.max_abs, diff);
+        sum_abs += diff;
+        result.clamped += std::abs(q[n]) >= 200.0;
+    }
+    result.mean_abs = sum_abs / std::max(1, samples);
+    
+    // A mismatch costs the float output difference between the two chosen moves
+    for (int d = 0; d < corpus.decisions(); d++) {
+        int begin = corpus.decision_start[d], end = corpus.decision_start[d + 1];
+        int best = std::max_element(q.begin() + begin, q.begin() + end) - q.begin();
+        int best_quant = std::max_element(q_quant.begin() + begin, q_quant.begin() + end) - q_quant.begin();
+        if (best != best_quant) {
+            result.argmax_mismatch++;
+            double regret = q[best] - q[best_quant];
+            result.regret_sum += regret;
+            result.regret_max = std::max(result.regret_max, regret);
+        }
+    }
+    result.float_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / std::max(1, samples);
+    result.quant_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / std::max(1, samples);
+    return result;
+}
+
+void printQuantizedComparison(const char* label, const QuantizedComparison& c, const PositionCorpus& corpus) {
+    char buffer[400];
+    snprintf(buffer, sizeof(buffer),
+             "%s: Max abs diff: %.3g | Mean abs diff: %.3g | Beyond the clamp: %d\n"
+             "  Argmax mismatches: %d/%d decisions (%.2f%%) | Regret: mean %.3g, max %.3g\n"
+             "  Forward: quantized %.1f ns/call, float %.1f ns/call (%.2fx)\n",
+             label, c.max_abs, c.mean_abs, c.clamped,
+             c.argmax_mismatch, corpus.decisions(), 100.0 * c.mismatchRate(corpus),
+             c.argmax_mismatch ? c.regret_sum / c.argmax_mismatch : 0.0, c.regret_max,
+             c.quant_ns, c.float_ns, c.quant_ns > 0 ? c.float_ns / c.quant_ns : 0.0);
+    std::cout << buffer;
+}
+
+void recordCorpus(RLAgent& agent, int decisions, PositionCorpus& corpus) {
+    srand(2024);
+    std::unique_ptr<TetrisGame> game(new TetrisGame());
+    for (int moves = 0; corpus.decisions() < decisions && moves < decisions * 2; moves++) {
+        if (game->game_over || game->current_piece == nullptr) {
+            game.reset(new TetrisGame());
+        }
+        size_t before = corpus.states.size() / NeuralNetwork::INPUT_SIZE;
+        RLAgent::Move move = agent.findBestMove(*game, false, &corpus.states);
+        size_t after = corpus.states.size() / NeuralNetwork::INPUT_SIZE;
+        if (after > before) {
+            if (corpus.decision_start.empty()) corpus.decision_start.push_back(0);
+            corpus.decision_start.push_back(int(after));
+        }
+        game->executeAIMove(move.rotation, move.x);
+    }
+}
+
+} // namespace
+
+int runPrecisionCheck(const std::string& model_file, int samples) {
+    NeuralNetwork net;
+    bool loaded = net.load(model_file);
+    ReferenceNetwork ref = buildReference(model_file, net, loaded);
+    
+    std::cout << "Precision check: " << (sizeof(nn_real) == sizeof(float) ? "float32" : "float64")
+              << " weights, " << (sizeof(nn_accum) == sizeof(float) ? "float32" : "float64")
+              << " accumulator vs float64 reference\n";
+    std::cout << "Model: " << (loaded ? model_file : std::string("(random init, no model file)"))
+              << " (" << NeuralNetwork::INPUT_SIZE << "x" << net.hidden_size << ")\n";
+    
+    // Group candidates like findBestMove does: one decision = many afterstates with a shared next piece
+    const int CANDIDATES_PER_DECISION = 34;
+    std::mt19937 gen(12345);
+    std::vector<std::vector<double>> ref_states;
+    std::vector<std::vector<nn_real>> states;
+    for (int n = 0; n < samples; n++) {
+        int next_piece = (n / CANDIDATES_PER_DECISION) % 7;
+        ref_states.push_back(randomState(gen, next_piece));
+        states.push_back(std::vector<nn_real>(ref_states.back().begin(), ref_states.back().end()));
+    }
+    
+    std::vector<double> q_ref(samples), q(samples);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int n = 0; n < samples; n++) q_ref[n] = ref.forward(ref_states[n]);
+    auto t1 = std::chrono::steady_clock::now();
+    for (int n = 0; n < samples; n++) q[n] = net.forward(states[n]);
+    auto t2 = std::chrono::steady_clock::now();
+    
+    double max_abs = 0.0, sum_abs = 0.0, max_rel = 0.0;
+    for (int n = 0; n < samples; n++) {
+        double diff = std::abs(q[n] - q_ref[n]);
+        max_abs = std::max(max_abs, diff);
+        sum_abs += diff;
+        max_rel = std::max(max_rel, diff / std::max(1.0, std::abs(q_ref[n])));
+    }
+    
+    int decisions = 0, argmax_mismatch = 0;
+    for (int start = 0; start + CANDIDATES_PER_DECISION <= samples; start += CANDIDATES_PER_DECISION) {
+        auto ref_best = std::max_element(q_ref.begin() + start, q_ref.begin() + start + CANDIDATES_PER_DECISION);
+        auto best = std::max_element(q.begin() + start, q.begin() + start + CANDIDATES_PER_DECISION);
+        if ((ref_best - q_ref.begin()) != (best - q.begin())) argmax_mismatch++;
+        decisions++;
+    }
+    
+    double ref_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / samples;
+    double net_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / samples;
+    
+    char buffer[400];
+    snprintf(buffer, sizeof(buffer),
+             "Samples: %d | Max abs diff: %.3g | Mean abs diff: %.3g | Max rel diff: %.3g\n"
+             "Argmax mismatches: %d/%d decisions\n"
+             "Forward: %.1f ns/call (reference %.1f ns/call)\n",
+             samples, max_abs, sum_abs / std::max(1, samples), max_rel,
+             argmax_mismatch, decisions, net_ns, ref_ns);
+    std::cout << buffer;
+    
+    // Float32 weights carry ~7 significant digits; Q-values are clipped to +/-200
+    const double TOLERANCE = 1e-3;
+    bool pass = max_rel <= TOLERANCE;
+    std::cout << (pass ? "PASS" : "FAIL") << " (tolerance " << TOLERANCE << " relative)\n";
+    return pass ? 0 : 1;
+}
+
+int runKernelCheck(const std::string& model_file, int samples) {
+    NeuralNetwork model;
+    bool loaded = model.load(model_file);
+    const int I = NeuralNetwork::INPUT_SIZE;
+    
+    std::cout << "Kernel check: SIMD forward and backward kernels vs scalar reference (bit-exact)\n";
+    std::cout << "Model: " << (loaded ? model_file : std::string("(random init, no model file)"))
+              << " (" << I << "x" << model.hidden_size << ")\n";
+    std::cout << "Selected for this CPU: " << model.kernels().name << "\n";
+    
+    std::mt19937 gen(54321);
+    std::vector<nn_real> inputs;
+    inputs.reserve(samples * I);
+    for (int n = 0; n < samples; n++) {
+        std::vector<double> state = randomState(gen, n % 7);
+        inputs.insert(inputs.end(), state.begin(), state.end());
+    }
+    
+    // Incremental evaluation: each sample gets a candidate that changes 1-5 of the 13 board
+    // features (like an afterstate of the same board), evaluated from the sample's pre-activations
+    const int BOARD_FEATURES = 13;
+    std::uniform_real_distribution<double> feature(0.0, 1.0);
+    std::vector<nn_real> candidates(inputs);
+    std::vector<int> changed, change_start(samples + 1);
+    std::vector<nn_accum> deltas;
+    for (int n = 0; n < samples; n++) {
+        change_start[n] = changed.size();
+        for (int t = 0; t < 1 + n % 5; t++) {
+            int j = (n + 3 * t) % BOARD_FEATURES;  // Distinct for t < 5
+            nn_real value = nn_real(feature(gen));
+            changed.push_back(j);
+            deltas.push_back(nn_accum(value) - nn_accum(candidates[n * I + j]));
+            candidates[n * I + j] = value;
+        }
+    }
+    change_start[samples] = changed.size();
+    
+    bool all_pass = true;
+    for (int shape = 0; shape < NN_SHAPE_COUNT; shape++) {
+        // The model's own shape uses its weights; the other shapes use a random network
+        const int H = NN_HIDDEN_SIZES[shape];
+        NeuralNetwork net = (H == model.hidden_size) ? model : NeuralNetwork(H);
+        NetworkView view = net.view();
+        std::cout << "Shape " << I << "x" << H << (H == model.hidden_size ? " (model)" : "") << ":\n";
+        
+        // Scalar reference results
+        const NNKernels* scalar = nnKernelsFor(NN_ISA_SCALAR, shape);
+        std::vector<nn_accum> ref_out(samples), ref_pre(samples * H);
+        scalar->forward_batch(view, inputs.data(), samples, ref_out.data(), ref_pre.data());
+        
+        // Backward reference: the pre-activations stand in for hidden deltas, and the update
+        // gets a few NaN gradients and parameters plus an odd count so the tail path runs too
+        std::vector<nn_accum> ref_grad(I * H, 0.0);
+        for (int n = 0; n < samples; n++) {
+            scalar->accumulate_gradients(&inputs[n * I], &ref_pre[n * H], ref_grad.data());
+        }
+        UpdateRule rule;
+        rule.grad_scale = nn_accum(1.0) / 32;
+        rule.max_gradient = 5.0;
+        rule.step = nn_accum(0.001) * 32;
+        rule.limit = 25.0;
+        const int update_count = I * H - 5;
+        std::vector<nn_accum> update_grad(ref_grad);
+        std::vector<nn_real> ref_params(net.weights1.begin(), net.weights1.begin() + I * H);
+        update_grad[3] = update_grad[I * H - 7] = std::numeric_limits<nn_accum>::quiet_NaN();
+        ref_params[5] = ref_params[I * H - 6] = std::numeric_limits<nn_real>::quiet_NaN();
+        std::vector<nn_real> start_params(ref_params);
+        scalar->apply_update(ref_params.data(), update_grad.data(), update_count, rule);
+        
+        // Quantized network on the same inputs
+        std::vector<int16_t> quantized_inputs(samples * NN_INPUT_PAIRS * 2);
+        for (int n = 0; n < samples; n++) {
+            nnQuantizeInput(&inputs[n * I], &quantized_inputs[n * NN_INPUT_PAIRS * 2]);
+        }
+        QuantizedView quantized_view = net.quantizedView();
+        std::vector<float> ref_quantized(samples);
+        for (int n = 0; n < samples; n++) {
+            ref_quantized[n] = scalar->forward_quantized(quantized_view, &quantized_inputs[n * NN_INPUT_PAIRS * 2]);
+        }
+        
+        // Incremental reference, and how far it is from a full forward pass of the candidates
+        std::vector<nn_accum> ref_delta_out(samples), full_out(samples);
+        for (int n = 0; n < samples; n++) {
+            ref_delta_out[n] = scalar->forward_delta(view, &ref_pre[n * H], &changed[change_start[n]],
+                                                     &deltas[change_start[n]], change_start[n + 1] - change_start[n]);
+        }
+        scalar->forward_batch(view, candidates.data(), samples, full_out.data(), nullptr);
+        double max_delta_diff = 0.0;
+        bool delta_close = true;
+        for (int n = 0; n < samples; n++) {
+            double diff = std::abs(double(ref_delta_out[n]) - double(full_out[n]));
+            max_delta_diff = std::max(max_delta_diff, diff);
+            delta_close = delta_close && diff <= 1e-4 * std::max(1.0, std::abs(double(full_out[n])));
+        }
+        std::cout << "  incremental vs full forward: max |diff| " << max_delta_diff
+                  << (delta_close ? " (OK)" : " (TOO LARGE)") << "\n";
+        all_pass = all_pass && delta_close;
+        
+        for (int isa = 0; isa < NN_ISA_COUNT; isa++) {
+            const NNKernels* kernels = nnKernelsFor(static_cast<NNIsa>(isa), shape);
+            if (kernels == nullptr) {
+                continue;
+            }
+            
+            // Single-sample variant
+            std::vector<nn_accum> out(samples), pre(samples * H);
+            auto t0 = std::chrono::steady_clock::now();
+            for (int n = 0; n < samples; n++) {
+                out[n] = kernels->forward(view, &inputs[n * I], nullptr);
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            for (int n = 0; n < samples; n++) {
+                kernels->forward(view, &inputs[n * I], &pre[n * H]);
+            }
+            bool single_ok = std::memcmp(out.data(), ref_out.data(), samples * sizeof(nn_accum)) == 0 &&
+                             std::memcmp(pre.data(), ref_pre.data(), samples * H * sizeof(nn_accum)) == 0;
+            
+            // Batched variant
+            std::vector<nn_accum> batch_out(samples), batch_pre(samples * H);
+            auto t2 = std::chrono::steady_clock::now();
+            kernels->forward_batch(view, inputs.data(), samples, batch_out.data(), nullptr);
+            auto t3 = std::chrono::steady_clock::now();
+            kernels->forward_batch(view, inputs.data(), samples, batch_out.data(), batch_pre.data());
+            bool batch_ok = std::memcmp(batch_out.data(), ref_out.data(), samples * sizeof(nn_accum)) == 0 &&
+                            std::memcmp(batch_pre.data(), ref_pre.data(), samples * H * sizeof(nn_accum)) == 0;
+            
+            // Backward: gradient accumulation and the clipped update
+            std::vector<nn_accum> grad(I * H, 0.0);
+            auto t4 = std::chrono::steady_clock::now();
+            for (int n = 0; n < samples; n++) {
+                kernels->accumulate_gradients(&inputs[n * I], &ref_pre[n * H], grad.data());
+            }
+            auto t5 = std::chrono::steady_clock::now();
+            std::vector<nn_real> params(start_params);
+            kernels->apply_update(params.data(), update_grad.data(), update_count, rule);
+            bool backward_ok = std::memcmp(grad.data(), ref_grad.data(), I * H * sizeof(nn_accum)) == 0 &&
+                               std::memcmp(params.data(), ref_params.data(), I * H * sizeof(nn_real)) == 0;
+            
+            // Incremental forward from the reference pre-activations
+            std::vector<nn_accum> delta_out(samples);
+            auto t6 = std::chrono::steady_clock::now();
+            for (int n = 0; n < samples; n++) {
+                delta_out[n] = kernels->forward_delta(view, &ref_pre[n * H], &changed[change_start[n]],
+                                                      &deltas[change_start[n]], change_start[n + 1] - change_start[n]);
+            }
+            auto t7 = std::chrono::steady_clock::now();
+            bool delta_ok = std::memcmp(delta_out.data(), ref_delta_out.data(), samples * sizeof(nn_accum)) == 0;
+            
+            std::vector<float> quantized_out(samples);
+            auto t8 = std::chrono::steady_clock::now();
+            for (int n = 0; n < samples; n++) {
+                quantized_out[n] = kernels->forward_quantized(quantized_view, &quantized_inputs[n * NN_INPUT_PAIRS * 2]);
+            }
+            auto t9 = std::chrono::steady_clock::now();
+            bool quantized_ok = std::memcmp(quantized_out.data(), ref_quantized.data(), samples * sizeof(float)) == 0;
+            
+            char buffer[500];
+            snprintf(buffer, sizeof(buffer),
+                     "  %-8s single: %-4s %7.1f ns/call | batch: %-4s %7.1f ns/sample | backward: %-4s %7.1f ns/sample"
+                     " | incremental: %-4s %7.1f ns/call | quantized: %-4s %7.1f ns/call\n",
+                     kernels->name, single_ok ? "OK" : "DIFF",
+                     std::chrono::duration<double, std::nano>(t1 - t0).count() / samples,
+                     batch_ok ? "OK" : "DIFF",
+                     std::chrono::duration<double, std::nano>(t3 - t2).count() / samples,
+                     backward_ok ? "OK" : "DIFF",
+                     std::chrono::duration<double, std::nano>(t5 - t4).count() / samples,
+                     delta_ok ? "OK" : "DIFF",
+                     std::chrono::duration<double, std::nano>(t7 - t6).count() / samples,
+                     quantized_ok ? "OK" : "DIFF",
+                     std::chrono::duration<double, std::nano>(t9 - t8).count() / samples);
+            std::cout << buffer;
+            all_pass = all_pass && single_ok && batch_ok && backward_ok && delta_ok && quantized_ok;
+        }
+    }
+    
+    std::cout << (all_pass ? "PASS" : "FAIL") << "\n";
+    return all_pass ? 0 : 1;
+}
+
+int runQuantizedCheck(const std::string& model_file, int decisions, const std::string& corpus_file) {
+    RLAgent agent(model_file);
+    NeuralNetwork& net = agent.q_network;
+    const int I = NeuralNetwork::INPUT_SIZE;
+    
+    std::cout << "Quantized check: fixed-point move selection vs " << (sizeof(nn_real) == sizeof(float) ? "float32" : "float64")
+              << " network (" << net.kernels().name << " kernels)\n";
+    std::cout << "Model: " << (agent.model_loaded ? model_file : std::string("(random init, no model file)"))
+              << " (" << I << "x" << net.hidden_size << ", weight scale " << net.quantized.weight_scale << ")\n";
+    
+    PositionCorpus corpus;
+    if (!corpus_file.empty() && loadCorpus(corpus_file, corpus)) {
+        std::cout << "Corpus: " << corpus_file << "\n";
+    } else {
+        recordCorpus(agent, decisions, corpus);
+        if (!corpus_file.empty()) {
+            saveCorpus(corpus_file, corpus);
+            std::cout << "Corpus: recorded from greedy play, saved to " << corpus_file << "\n";
+        } else {
+            std::cout << "Corpus: recorded from greedy play\n";
+        }
+    }
+    
+    // Outputs are compared before the +/-200 Q-value clamp: a model whose outputs saturate
+    // would otherwise agree everywhere without testing anything. A freshly initialized network
+    // of the same shape, whose outputs sit well inside the clamp, is compared as well
+    NeuralNetwork fresh(net.hidden_size);
+    const QuantizedComparison loaded = compareQuantized(net, corpus);
+    const QuantizedComparison initial = compareQuantized(fresh, corpus);
+    const int samples = corpus.decision_start.empty() ? 0 : corpus.decision_start.back();
+    std::cout << "Decisions: " << corpus.decisions() << " (" << samples << " afterstates), outputs before the clamp\n";
+    printQuantizedComparison("Loaded model", loaded, corpus);
+    printQuantizedComparison("Fresh network", initial, corpus);
+    if (samples > 0 && loaded.clamped == samples) {
+        std::cout << "Warning: every model output is beyond the +/-200 clamp, so both paths choose moves "
+                     "by tie-breaking\n";
+    }
+    
+    // Near-ties may flip under quantization; more than a few percent means the scale is off
+    const double MAX_MISMATCH_RATE = 0.05;
+    bool pass = corpus.decisions() > 0 && loaded.mismatchRate(corpus) <= MAX_MISMATCH_RATE &&
+                initial.mismatchRate(corpus) <= MAX_MISMATCH_RATE;
+    std::cout << (pass ? "PASS" : "FAIL") << " (at most " << 100.0 * MAX_MISMATCH_RATE
+              << "% mismatches for the model and the fresh network)\n";
+    return pass ? 0 : 1;
+}
+
+int runHogwildBench(const std::string& model_file, int learners, double seconds) {
+    NeuralNetwork start;
+    bool loaded = start.load(model_file);
+    const int I = NeuralNetwork::INPUT_SIZE;
+    
+    std::cout << "Hogwild benchmark: " << learners << " learners vs 1, " << seconds << " s each, "
+              << std::thread::hardware_concurrency() << " hardware threads\n";
+    std::cout << "Model: " << (loaded ? model_file : std::string("(random init, no model file)"))
+              << " (" << I << "x" << start.hidden_size << ", " << optimizerName(start.optimizer.type) << ")\n";
+    
+    // Terminal experiences rewarded with a teacher network's Q-value: every target is the
+    // teacher's output, so the held-out error against the teacher measures convergence
+    NeuralNetwork teacher(start.hidden_size);
+    std::mt19937 gen(97531);
+    std::vector<PackedState> experience_states;
+    std::vector<double> experience_rewards;
+    std::vector<nn_real> features(I);
+    for (int n = 0; n < RLAgent::DEFAULT_BUFFER_SIZE; n++) {
+        experience_states.push_back(randomPackedState(gen, n % 7));
+        decodeState(experience_states.back(), features.data());
+        experience_rewards.push_back(teacher.forward(features));
+    }
+    std::vector<std::vector<nn_real>> held_out;
+    std::vector<double> held_out_q;
+    for (int n = 0; n < 2000; n++) {
+        decodeState(randomPackedState(gen, n % 7), features.data());
+        held_out.push_back(features);
+        held_out_q.push_back(teacher.forward(held_out.back()));
+    }
+    auto held_out_error = [&](NeuralNetwork& net) {
+        double sum = 0.0;
+        for (size_t n = 0; n < held_out.size(); n++) {
+            sum += std::abs(net.forward(held_out[n]) - held_out_q[n]);
+        }
+        return sum / held_out.size();
+    };
+    
+    const int CHECKPOINTS = 4;
+    double final_error[2] = {0.0, 0.0};
+    const int configs[2] = {1, learners};
+    for (int c = 0; c < 2; c++) {
+        RLAgent agent("", start.hidden_size);
+        agent.q_network = start;  // Same starting weights and optimizer state for both runs
+        for (size_t n = 0; n < experience_states.size(); n++) {
+            agent.replay_buffer.push(experience_states[n], 0, 0, experience_rewards[n], experience_states[n], true);
+        }
+        srand(13579);
+        agent.enableHogwild(configs[c]);
+        
+        std::cout << "  " << configs[c] << " learner" << (configs[c] > 1 ? "s" : " ") << "  start error "
+                  << held_out_error(agent.q_network) << "\n";
+        long long batches = 0;
+        double elapsed = 0.0;  // Time in train() only (evaluation excluded)
+        for (int checkpoint = 1; checkpoint <= CHECKPOINTS; checkpoint++) {
+            while (elapsed < seconds * checkpoint / CHECKPOINTS) {
+                auto t0 = std::chrono::steady_clock::now();
+                agent.train();
+                elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                batches += agent.hogwildLearners();
+            }
+            
+            double error = held_out_error(agent.q_network);
+            char buffer[200];
+            snprintf(buffer, sizeof(buffer), "    %5.2f s: %8lld batches, %9.0f batches/s (%9.0f samples/s), held-out error %.4g\n",
+                     elapsed, batches, batches / elapsed, batches * agent.batch_size / elapsed, error);
+            std::cout << buffer;
+            final_error[c] = error;
+        }
+        agent.enableHogwild(0);
+    }
+    
+    // Racing updates may converge a little differently, but must not blow up
+    bool pass = std::isfinite(final_error[1]) && final_error[1] <= 2.0 * final_error[0] + 1e-3;
+    std::cout << (pass ? "PASS" : "FAIL") << " (Hogwild error within 2x of single-threaded)\n";
+    return pass ? 0 : 1;
+}
+
+int runSnapshotCheck(int readers, double seconds) {
+    std::cout << "Snapshot check: 1 learner publishing, " << readers << " readers, " << seconds << " s\n";
+    WeightSnapshots snapshots;
+    std::atomic<bool> stop(false);
+    
+    // Every parameter of snapshot v equals v, so a reader can tell a torn copy
+    struct ReaderStats {
+        long long reads = 0;
+        long long torn = 0;
+        long long out_of_order = 0;
+    };
+    std::vector<ReaderStats> stats(readers);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r]() {
+            ReaderStats& mine = stats[r];
+            long long last_version = 0;
+            while (!stop.load()) {
+                WeightSnapshots::ReadGuard guard(snapshots, r);
+                const WeightSnapshots::Snapshot* snapshot = guard.get();
+                if (snapshot == nullptr) continue;
+                const NeuralNetwork& net = snapshot->network;
+                const nn_real expected = nn_real(snapshot->version);
+                bool whole = net.bias2[0] == expected;
+                for (size_t k = 0; k < net.weights1Count(); k++) whole = whole && net.weights1[k] == expected;
+                for (int i = 0; i < net.hidden_size; i++) {
+                    whole = whole && net.bias1[i] == expected && net.weights2[i] == expected;
+                }
+                mine.torn += !whole;
+                mine.out_of_order += snapshot->version < last_version;
+                last_version = snapshot->version;
+                mine.reads++;
+            }
+        });
+    }
+    
+    NeuralNetwork net;
+    long long publishes = 0, skipped = 0;
+    size_t max_retired = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while (elapsed < seconds) {
+        const nn_real value = nn_real(snapshots.version() + 1);
+        net.weights1.fill(value);
+        net.bias1.fill(value);
+        net.weights2.fill(value);
+        net.bias2.fill(value);
+        if (snapshots.publish(net)) {
+            publishes++;
+        } else {
+            skipped++;  // Every buffer still held by a reader
+        }
+        max_retired = std::max(max_retired, snapshots.retiredCount());
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+    stop.store(true);
+    for (std::thread& thread : threads) thread.join();
+    
+    long long reads = 0, torn = 0, out_of_order = 0;
+    for (const ReaderStats& reader : stats) {
+        reads += reader.reads;
+        torn += reader.torn;
+        out_of_order += reader.out_of_order;
+    }
+    char buffer[300];
+    snprintf(buffer, sizeof(buffer),
+             "Publishes: %lld (%.0f/s, %lld skipped) | Reads: %lld (%.0f/s) | Buffers: %zu | Max retired: %zu\n"
+             "Torn snapshots: %lld | Out-of-order versions: %lld\n",
+             publishes, publishes / elapsed, skipped, reads, reads / elapsed, snapshots.bufferCount(), max_retired,
+             torn, out_of_order);
+    std::cout << buffer;
+    bool pass = reads > 0 && torn == 0 && out_of_order == 0;
+    std::cout << (pass ? "PASS" : "FAIL") << "\n";
+    return pass ? 0 : 1;
+}
+
+int runSharedAgentCheck(const std::string& model_file, int threads, int positions) {
+    RLAgent agent(model_file);
+    agent.epsilon = 0.5;  // Half of the training-mode decisions explore
+    std::cout << "Shared agent check: " << threads << " game threads, one const agent, "
+              << positions << " positions\n";
+    std::cout << "Model: " << (agent.model_loaded ? model_file : std::string("(random init, no model file)"))
+              << " (" << NeuralNetwork::INPUT_SIZE << "x" << agent.q_network.hidden_size << ")\n";
+    
+    // Positions from greedy play (fixed seed), set up on this thread: TetrisGame draws
+    // pieces from rand(), so the game threads only choose moves
+    srand(2024);
+    std::vector<std::unique_ptr<TetrisGame>> games;
+    for (int p = 0; p < positions; p++) {
+        std::unique_ptr<TetrisGame> game(new TetrisGame());
+        for (int m = 0; m < p % 40 && !game->game_over && game->current_piece != nullptr; m++) {
+            RLAgent::Move move = agent.findBestMove(*game, false);
+            game->executeAIMove(move.rotation, move.x);
+        }
+        if (!game->game_over && game->current_piece != nullptr) games.push_back(std::move(game));
+    }
+    
+    // Reference decisions, single-threaded: greedy, and training mode with a generator per position
+    const RLAgent& shared = agent;
+    const int count = int(games.size());
+    std::vector<RLAgent::Move> greedy(count), explored(count);
+    RLAgent::DecisionScratch scratch;
+    for (int p = 0; p < count; p++) {
+        std::mt19937 rng(p);
+        greedy[p] = shared.findBestMove(*games[p], false, rng, scratch);
+        rng.seed(p);
+        explored[p] = shared.findBestMove(*games[p], true, rng, scratch);
+    }
+    
+    // Every thread replays all positions (each starting at a different one) with its own scratch
+    const int ROUNDS = 5;
+    std::vector<long long> mismatches(threads, 0);
+    std::vector<std::thread> pool;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t]() {
+            RLAgent::DecisionScratch mine;
+            for (int round = 0; round < ROUNDS; round++) {
+                for (int k = 0; k < count; k++) {
+                    int p = (k + t * count / threads) % count;
+                    std::mt19937 rng(p);
+                    RLAgent::Move a = shared.findBestMove(*games[p], false, rng, mine);
+                    rng.seed(p);
+                    RLAgent::Move b = shared.findBestMove(*games[p], true, rng, mine);
+                    if (a.rotation != greedy[p].rotation || a.x != greedy[p].x || a.q_value != greedy[p].q_value ||
+                        b.rotation != explored[p].rotation || b.x != explored[p].x || b.q_value != explored[p].q_value) {
+                        mismatches[t]++;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : pool) thread.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    
+    long long total_mismatches = 0;
+    for (long long m : mismatches) total_mismatches += m;
+    long long decisions = 2LL * ROUNDS * count * threads;
+    char buffer[200];
+    snprintf(buffer, sizeof(buffer), "Positions in play: %d | Decisions: %lld (%.0f/s) | Differing from single-threaded: %lld\n",
+             count, decisions, decisions / elapsed, total_mismatches);
+    std::cout << buffer;
+    bool ok = count > 0 && total_mismatches == 0;
+    std::cout << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
+
+int runReplayCheck(int draws) {
+    std::cout << "Replay check: packed states, sum-tree and prioritized sampling, " << draws << " sampled transitions\n";
+    std::mt19937 gen(4242);
+    
+    // Packed states decode to the same features as extraction from the board, on boards
+    // from random play (plenty of holes and ragged columns)
+    RLAgent agent("");
+    const int I = NeuralNetwork::INPUT_SIZE;
+    std::vector<nn_real> decoded(I);
+    int decode_errors = 0, boards = 0;
+    std::vector<PackedState> played;  // Consecutive positions, for the archive check below
+    srand(2024);
+    std::unique_ptr<TetrisGame> game(new TetrisGame());
+    for (int move = 0; move < 5000; move++) {
+        if (game->game_over || game->current_piece == nullptr) game.reset(new TetrisGame());
+        std::vector<nn_real> expected = agent.extractStateFromBoard(game->board, game->lines_cleared, game->level,
+                                                                    game->next_piece);
+        decodeState(RLAgent::packState(game->board, nullptr, game->next_piece), decoded.data());
+        if (!std::equal(expected.begin(), expected.end(), decoded.begin())) decode_errors++;
+        played.push_back(RLAgent::packState(*game));
+        decodeState(played.back(), decoded.data());
+        if (decoded[13 + game->current_piece->type] != 1.0) decode_errors++;
+        boards++;
+        game->executeAIMove(int(gen() % 4), int(gen() % (TetrisGame::WIDTH + 1)) - 2);
+    }
+    std::cout << "Packed states: " << decode_errors << "/" << boards << " boards decode differently ("
+              << sizeof(PackedState) << " bytes per state)\n";
+    
+    // Mirror images: each piece's rotations reflected are the rotations of mirrorPiece's
+    // piece, and on the played positions mirrorFeatures permutes exactly what decoding the
+    // mirrored state gives (and mirroring twice is the identity)
+    int mirror_errors = 0;
+    auto shapeMasks = [](int type, bool reflect) {
+        std::vector<int> masks;  // One 4x4 bitmap per rotation, shifted to the top left corner
+        TetrisPiece piece(type);
+        for (int rotation = 0; rotation < 4; rotation++) {
+            int shape[4][4];
+            piece.rotation = rotation;
+            piece.getShape(shape);
+            int min_x = 4, min_y = 4;
+            for (int y = 0; y < 4; y++) {
+                for (int x = 0; x < 4; x++) {
+                    if (!shape[y][reflect ? 3 - x : x]) continue;
+                    min_x = std::min(min_x, x);
+                    min_y = std::min(min_y, y);
+                }
+            }
+            int mask = 0;
+            for (int y = 0; y < 4; y++) {
+                for (int x = 0; x < 4; x++) {
+                    if (shape[y][reflect ? 3 - x : x]) mask |= 1 << ((y - min_y) * 4 + x - min_x);
+                }
+            }
+            masks.push_back(mask);
+        }
+        std::sort(masks.begin(), masks.end());
+        return masks;
+    };
+    for (int type = 0; type < 7; type++) {
+        mirror_errors += shapeMasks(type, true) != shapeMasks(mirrorPiece(type), false);
+    }
+    std::vector<nn_real> mirrored(I);
+    for (const PackedState& position : played) {
+        PackedState image = mirrorState(position);
+        PackedState back = mirrorState(image);
+        decodeState(position, decoded.data());
+        mirrorFeatures(decoded.data());
+        decodeState(image, mirrored.data());
+        mirror_errors += !std::equal(decoded.begin(), decoded.end(), mirrored.begin()) ||
+                         std::memcmp(&back, &position, sizeof(PackedState)) != 0;
+    }
+    std::cout << "Mirror images: " << mirror_errors << " errors (7 pieces, " << played.size() << " positions)\n";
+    
+    // Replay file: contents survive closing and reopening (after wrapping around), a second
+    // writer is refused, and a read-only mapping sees the same rows
+    int file_errors = 0;
+    const std::string path = "replay_check_" + std::to_string(getpid()) + ".tmp";
+    std::string error;
+    {
+        ReplayBuffer writer;
+        file_errors += !writer.openFile(path, 1000, false, error);
+        for (int n = 0; n < 1500; n++) {
+            PackedState state = randomPackedState(gen, n % 7);
+            writer.push(state, n % 4, n % 10, n, state, n % 3 == 0);
+        }
+    }
+    {
+        ReplayBuffer writer, second_writer, reader;
+        file_errors += !writer.openFile(path, 50, false, error);  // Keeps the file's capacity
+        file_errors += second_writer.openFile(path, 1000, false, error);
+        file_errors += !reader.openFile(path, 0, true, error);
+        file_errors += writer.capacity() != 1000 || writer.size() != 1000 || reader.size() != 1000;
+        for (size_t age = 0; age < writer.size() && file_errors == 0; age++) {
+            size_t slot = writer.slot(age);
+            int n = 500 + int(age);
+            file_errors += writer.reward(slot) != float(n) || writer.actionX(slot) != n % 10 ||
+                           writer.done(slot) != (n % 3 == 0) || reader.slot(age) != slot ||
+                           std::memcmp(&reader.state(slot), &writer.state(slot), sizeof(PackedState)) != 0;
+        }
+        file_errors += writer.terminalCount() + writer.nonTerminalCount() != writer.size();
+        reader.push(writer.state(0), 0, 0, 0.0, writer.state(0), false);  // Ignored
+        file_errors += reader.size() != 1000;
+    }
+    std::remove(path.c_str());
+    std::cout << "Replay file: " << file_errors << " errors after reopening\n";
+    
+    // Terminal/non-terminal pools against a reference deque of (id, done) on random push
+    // sequences (wrapping several times): every stored row is in the pool of its kind, once
+    int pool_errors = 0;
+    {
+        std::mt19937 pool_gen(4545);
+        const size_t POOL_CAPACITY = 200;
+        ReplayBuffer pooled(POOL_CAPACITY);
+        std::deque<std::pair<int, bool>> reference;
+        PackedState state = randomPackedState(pool_gen, 0);
+        for (int n = 0; n < 5000; n++) {
+            const bool done = int(pool_gen() % 100) < (n / 1000) * 20;  // 0% to 80% terminal as it goes
+            pooled.push(state, 0, 0, n, state, done);
+            reference.push_back(std::make_pair(n, done));
+            if (reference.size() > POOL_CAPACITY) reference.pop_front();
+            if (n % 37 != 0) continue;
+            pool_errors += pooled.size() != reference.size();
+            size_t terminal = 0;
+            std::vector<int> seen(POOL_CAPACITY, 0);
+            for (size_t age = 0; age < reference.size(); age++) {
+                size_t slot = pooled.slot(age);
+                pool_errors += pooled.reward(slot) != float(reference[age].first) ||
+                               pooled.done(slot) != reference[age].second;
+                terminal += reference[age].second;
+            }
+            pool_errors += pooled.terminalCount() != terminal ||
+                           pooled.nonTerminalCount() != reference.size() - terminal;
+            for (size_t k = 0; k < pooled.terminalCount(); k++) {
+                size_t slot = pooled.terminalSlot(k);
+                pool_errors += slot >= POOL_CAPACITY || !pooled.done(slot) || seen[slot]++ != 0;
+            }
+            for (size_t k = 0; k < pooled.nonTerminalCount(); k++) {
+                size_t slot = pooled.nonTerminalSlot(k);
+                pool_errors += slot >= POOL_CAPACITY || pooled.done(slot) || seen[slot]++ != 0;
+            }
+        }
+    }
+    std::cout << "Pools: " << pool_errors << " mismatches against a reference deque\n";
+    
+    // Resize of a wrapped, prioritized, deduplicated ring: shrinking keeps the newest rows in
+    // age order with their rewards, done flags, priorities and counts, growing keeps them all,
+    // and the largest priority seen survives (new rows still get it). A mapped buffer refuses
+    int resize_errors = 0;
+    {
+        std::mt19937 resize_gen(4747);
+        ReplayBuffer ring(300);
+        ring.enablePriorities();
+        ring.enableDeduplication();
+        struct Row { int id; bool done; uint32_t copies; };
+        std::deque<Row> reference;
+        for (int n = 0; n < 700; n++) {  // Wraps twice; every 10th transition is pushed twice
+            PackedState state = randomPackedState(resize_gen, n % 7);
+            const bool done = n % 3 == 0;
+            const int copies = n % 10 == 0 ? 2 : 1;
+            for (int c = 0; c < copies; c++) ring.push(state, n % 4, n % 10, n, state, done);
+            reference.push_back(Row{n, done, uint32_t(copies)});
+            if (reference.size() > 300) reference.pop_front();
+        }
+        auto expectedPriority = [](int id) { return 1.0 + 0.01 * id; };
+        for (size_t age = 0; age < ring.size(); age++) {
+            size_t slot = ring.slot(age);
+            ring.setPriority(slot, age == 0 ? 50.0 : expectedPriority(int(ring.reward(slot))));
+        }
+        auto checkNewest = [&](size_t kept) {
+            int errors = ring.size() != kept;
+            size_t copies = 0;
+            for (size_t age = 0; age < ring.size() && age < kept; age++) {
+                const Row& row = reference[reference.size() - kept + age];
+                size_t slot = ring.slot(age);
+                errors += ring.reward(slot) != float(row.id) || ring.done(slot) != row.done ||
+                          ring.copies(slot) != row.copies ||
+                          std::abs(ring.priority(slot) - expectedPriority(row.id)) > 1e-9;
+                copies += row.copies;
+            }
+            return errors + (ring.transitions() != copies) +
+                   (ring.terminalCount() + ring.nonTerminalCount() != ring.size());
+        };
+        resize_errors += !ring.resize(120) || ring.capacity() != 120;
+        resize_errors += checkNewest(120);
+        resize_errors += !ring.resize(400) || ring.capacity() != 400;
+        resize_errors += checkNewest(120);
+        PackedState fresh = randomPackedState(resize_gen, 0);
+        ring.push(fresh, 0, 0, -1.0, fresh, false);  // The evicted row's priority 50 is still the largest
+        resize_errors += ring.size() != 121 || ring.priority(ring.slot(120)) != 50.0;
+        
+        ReplayBuffer mapped;
+        resize_errors += !mapped.openFile(path, 1000, false, error);
+        resize_errors += mapped.resize(2000) || mapped.capacity() != 1000;
+    }
+    std::remove(path.c_str());
+    std::cout << "Resize: " << resize_errors << " errors after shrinking and growing a wrapped buffer\n";
+    
+    // Cold archive: transitions from play survive closing and reopening with a torn block
+    // appended, and every one sampled from the window decodes to what was appended
+    const int ARCHIVED = 3000;
+    auto archived = [&](int n) {
+        ArchivedTransition transition;
+        transition.state = played[n % (played.size() - 1)];
+        transition.next_state = played[n % (played.size() - 1) + 1];
+        transition.reward = float(n);
+        transition.action_rotation = int8_t(n % 4);
+        transition.action_x = int8_t(n % 10 - 2);
+        transition.done = n % 7 == 0;
+        return transition;
+    };
+    int archive_errors = 0;
+    long long archive_bytes = 0;
+    size_t window = 0;
+    {
+        ReplayArchive archive;
+        archive_errors += !archive.open(path, error);
+        for (int n = 0; n < ARCHIVED; n++) archive.append(archived(n));
+    }
+    {
+        FILE* file = std::fopen(path.c_str(), "ab");  // Torn block: header promising more than follows
+        const uint32_t torn[6] = {0x4b4c4254, 256, 4000, 0, 1, 2};
+        archive_errors += file == nullptr || std::fwrite(torn, sizeof(torn), 1, file) != 1;
+        if (file != nullptr) std::fclose(file);
+        ReplayArchive archive, second;
+        archive_errors += !archive.open(path, error);
+        archive_errors += second.open(path, error);
+        archive_errors += archive.size() != size_t(ARCHIVED);
+        archive_bytes = archive.fileBytes();
+        for (int step = 0; step < 40; step++) {
+            archive_errors += !archive.advance();
+            window = archive.windowSize();
+            archive_errors += window > size_t(ReplayArchive::WINDOW_BLOCKS * ReplayArchive::BLOCK_TRANSITIONS);
+            for (size_t k = 0; k < window && archive_errors == 0; k++) {
+                const ArchivedTransition& got = archive.sample(k);
+                int n = int(got.reward);
+                ArchivedTransition expected = archived(n);
+                archive_errors += n < 0 || n >= ARCHIVED || got.reward != float(n) ||
+                                  got.action_rotation != expected.action_rotation ||
+                                  got.action_x != expected.action_x || got.done != expected.done ||
+                                  std::memcmp(&got.state, &expected.state, sizeof(PackedState)) != 0 ||
+                                  std::memcmp(&got.next_state, &expected.next_state, sizeof(PackedState)) != 0;
+            }
+        }
+    }
+    std::remove(path.c_str());
+    char line[200];
+    snprintf(line, sizeof(line), "Cold archive: %d errors | %.1f bytes per transition on disk (%d raw) | window %zu\n",
+             archive_errors, double(archive_bytes) / ARCHIVED,
+             int(2 * sizeof(PackedState) + sizeof(float) + 3), window);
+    std::cout << line;
+    
+    // N-step window against returns summed directly over whole episodes
+    int n_step_errors = 0;
+    const double GAMMA = 0.95;
+    std::uniform_real_distribution<double> reward_dist(-10.0, 10.0);
+    for (int steps : {1, 3, 5}) {
+        NStepWindow window(steps);
+        std::vector<Experience> emitted;
+        for (int episode = 0; episode < 200; episode++) {
+            const int length = 1 + int(gen() % 12);
+            std::vector<Experience> episode_steps(length);
+            emitted.clear();
+            for (int t = 0; t < length; t++) {
+                Experience& step = episode_steps[t];
+                step.state.clear();
+                step.next_state.clear();
+                step.next_state.cells[0] = uint8_t(t);  // Identifies s_t+1
+                step.action_rotation = 0;
+                step.action_x = t;
+                step.reward = reward_dist(gen);
+                step.done = t == length - 1;
+                window.push(step, GAMMA, emitted);
+            }
+            n_step_errors += int(emitted.size()) != length;
+            for (int t = 0; t < length && t < int(emitted.size()); t++) {
+                const int last = std::min(t + steps, length) - 1;  // Step whose next state ends the window
+                double expected = 0.0, discount = 1.0;
+                for (int k = t; k <= last; k++) {
+                    expected += discount * episode_steps[k].reward;
+                    discount *= GAMMA;
+                }
+                n_step_errors += emitted[t].action_x != t || std::abs(emitted[t].reward - expected) > 1e-9 ||
+                                 emitted[t].next_state.cells[0] != uint8_t(last) ||
+                                 emitted[t].done != (last == length - 1);
+            }
+        }
+    }
+    std::cout << "N-step returns: " << n_step_errors << " errors over 600 episodes (n = 1, 3, 5)\n";
+    
+    // Deduplication: 50 distinct transitions pushed j + 1 times each (interleaved) become 50
+    // counted entries, sampled in proportion to their counts; wrapping around with new
+    // transitions drops the merged entries and their counts
+    const int DISTINCT = 50;
+    std::mt19937 dedup_gen(4343);  // Own stream: the checks below keep their draws
+    int dedup_errors = 0;
+    RLAgent dedup_agent("");
+    dedup_agent.setReplayCapacity(RLAgent::MIN_BUFFER_SIZE);
+    dedup_agent.enableReplayDeduplication();
+    ReplayBuffer& deduplicated = dedup_agent.replay_buffer;
+    std::vector<PackedState> distinct;
+    for (int j = 0; j < DISTINCT; j++) distinct.push_back(randomPackedState(dedup_gen, j % 7));
+    for (int round = 0; round < DISTINCT; round++) {
+        for (int j = round; j < DISTINCT; j++) {
+            deduplicated.push(distinct[j], j % 4, j % 10, j, distinct[(j + 1) % DISTINCT], false);
+        }
+    }
+    dedup_errors += deduplicated.size() != size_t(DISTINCT) ||
+                    deduplicated.transitions() != size_t(DISTINCT * (DISTINCT + 1) / 2);
+    for (size_t age = 0; age < deduplicated.size(); age++) {
+        size_t slot = deduplicated.slot(age);
+        dedup_errors += deduplicated.copies(slot) != uint32_t(deduplicated.reward(slot)) + 1;
+    }
+    std::vector<long long> dedup_hits(DISTINCT, 0);
+    long long dedup_sampled = 0;
+    RLAgent::TrainingBatch dedup_batch;
+    while (dedup_sampled < draws) {
+        dedup_agent.sampleBatch(dedup_batch, &dedup_gen);
+        dedup_errors += !dedup_batch.weights.empty();  // No priorities, so no IS weights
+        for (uint32_t slot : dedup_batch.slots) dedup_hits[int(deduplicated.reward(slot))]++;
+        dedup_sampled += int(dedup_batch.slots.size());
+    }
+    double dedup_worst_z = 0.0;
+    for (int j = 0; j < DISTINCT; j++) {
+        double p = double(j + 1) / deduplicated.transitions();
+        double expected = p * dedup_sampled;
+        dedup_worst_z = std::max(dedup_worst_z, std::abs((dedup_hits[j] - expected) / std::sqrt(expected * (1.0 - p))));
+    }
+    for (int n = 0; n < RLAgent::MIN_BUFFER_SIZE; n++) {
+        PackedState fresh = randomPackedState(dedup_gen, n % 7);
+        deduplicated.push(fresh, 0, 0, 1000.0 + n, fresh, n % 5 == 0);
+    }
+    deduplicated.push(deduplicated.state(deduplicated.slot(0)), 0, 0, 1000.0, deduplicated.state(deduplicated.slot(0)), true);
+    dedup_errors += deduplicated.size() != size_t(RLAgent::MIN_BUFFER_SIZE) ||
+                    deduplicated.transitions() != deduplicated.size() + 1 ||
+                    deduplicated.copies(deduplicated.slot(0)) != 2 ||
+                    deduplicated.transitionCount(true) != deduplicated.terminalCount() + 1 ||
+                    deduplicated.transitionCount(false) != deduplicated.nonTerminalCount() ||
+                    std::abs(deduplicated.priorityTotal(true) + deduplicated.priorityTotal(false) -
+                             double(deduplicated.transitions())) > 1e-6;
+    snprintf(line, sizeof(line), "Deduplication: %d errors | worst count deviation %.2f sigma\n",
+             dedup_errors, dedup_worst_z);
+    std::cout << line;
+    
+    // Stratification: a batch takes min(terminal share of the buffer, MAX_TERMINAL_SHARE)
+    // terminal samples, randomly rounded to one of the two nearest counts, uniform and
+    // prioritized; an all-terminal buffer gives all-terminal batches
+    int strata_errors = 0;
+    double worst_share_error = 0.0;
+    {
+        std::mt19937 strata_gen(4646);
+        for (int prioritized = 0; prioritized < 2; prioritized++) {
+            for (double buffer_share : {0.1, 0.6, 1.0}) {
+                RLAgent strata_agent("");
+                strata_agent.setReplayCapacity(RLAgent::MIN_BUFFER_SIZE);
+                if (prioritized) strata_agent.enablePrioritizedReplay(0.6, 0.4);
+                const int terminal_rows = int(buffer_share * RLAgent::MIN_BUFFER_SIZE);
+                for (int n = 0; n < RLAgent::MIN_BUFFER_SIZE; n++) {
+                    PackedState state = randomPackedState(strata_gen, n % 7);
+                    strata_agent.replay_buffer.push(state, 0, 0, n, state, n < terminal_rows);
+                }
+                const double share = buffer_share < 1.0 ? std::min(buffer_share, RLAgent::MAX_TERMINAL_SHARE) : 1.0;
+                const double expected = share * strata_agent.batch_size;
+                RLAgent::TrainingBatch strata_batch;
+                long long terminal_samples = 0;
+                const int BATCHES = 2000;
+                for (int b = 0; b < BATCHES; b++) {
+                    strata_agent.sampleBatch(strata_batch, &strata_gen);
+                    int terminal = 0;
+                    for (int i = 0; i < strata_agent.batch_size; i++) {
+                        terminal += strata_batch.done[i] != 0;
+                        strata_errors += (strata_batch.done[i] != 0) !=
+                                         strata_agent.replay_buffer.done(strata_batch.slots[i]);
+                    }
+                    strata_errors += terminal < int(std::floor(expected)) || terminal > int(std::ceil(expected));
+                    terminal_samples += terminal;
+                }
+                worst_share_error = std::max(worst_share_error,
+                                             std::abs(double(terminal_samples) / BATCHES - expected) / strata_agent.batch_size);
+            }
+        }
+    }
+    snprintf(line, sizeof(line), "Stratification: %d errors | worst mean terminal share error %.4f\n",
+             strata_errors, worst_share_error);
+    std::cout << line;
+    std::uniform_real_distribution<double> priority_dist(0.01, 5.0);
+    
+    // Sum-tree against brute force: totals after random updates, and find() against a linear scan
+    const size_t LEAVES = 1000;
+    SumTree tree;
+    tree.reset(LEAVES);
+    std::vector<double> leaves(LEAVES, 0.0);
+    int tree_errors = 0;
+    for (int update = 0; update < 20000; update++) {
+        size_t leaf = gen() % LEAVES;
+        leaves[leaf] = (gen() % 4 == 0) ? 0.0 : priority_dist(gen);
+        tree.set(leaf, leaves[leaf]);
+        if (update % 100 != 0) continue;
+        double total = 0.0;
+        for (double value : leaves) total += value;
+        if (std::abs(tree.total() - total) > 1e-9 * total) tree_errors++;
+        double mass = std::uniform_real_distribution<double>(0.0, tree.total())(gen);
+        double before = 0.0;
+        size_t expected = 0;
+        while (expected < LEAVES && before + leaves[expected] <= mass) before += leaves[expected++];
+        if (tree.find(mass) != expected) tree_errors++;
+    }
+    std::cout << "Sum-tree: " << tree_errors << " mismatches against brute force\n";
+    
+    // Prioritized sampleBatch on a full buffer of non-terminal transitions (one stratum):
+    // every slot's sampling frequency should match priority / total, and each batch's
+    // importance-sampling weights should be proportional to priority^-beta
+    agent.enablePrioritizedReplay(0.6, 0.4);
+    PackedState state = randomPackedState(gen, 0);
+    for (int n = 0; n < RLAgent::DEFAULT_BUFFER_SIZE + 500; n++) {  // Wraps around once
+        agent.replay_buffer.push(state, 0, 0, 0.0, state, false);
+    }
+    const size_t slots = agent.replay_buffer.capacity();
+    for (size_t slot = 0; slot < slots; slot++) {
+        agent.replay_buffer.setPriority(slot, (slot % 10 == 0) ? 20.0 : priority_dist(gen));
+    }
+    std::vector<long long> hits(slots, 0);
+    RLAgent::TrainingBatch batch;
+    double worst_weight_error = 0.0;
+    long long sampled = 0;
+    while (sampled < draws) {
+        agent.sampleBatch(batch, &gen);
+        double reference = 0.0;
+        for (int i = 0; i < agent.batch_size; i++) {
+            hits[batch.slots[i]]++;
+            double scaled = batch.weights[i] * std::pow(agent.replay_buffer.priority(batch.slots[i]), agent.priority_beta);
+            if (i == 0) reference = scaled;
+            worst_weight_error = std::max(worst_weight_error, std::abs(scaled / reference - 1.0));
+        }
+        sampled += agent.batch_size;
+    }
+    const double total = agent.replay_buffer.priorityTotal(false);
+    double worst_z = 0.0;
+    for (size_t slot = 0; slot < slots; slot++) {
+        double p = agent.replay_buffer.priority(slot) / total;
+        double expected = p * sampled;
+        double z = (hits[slot] - expected) / std::sqrt(expected * (1.0 - p));
+        worst_z = std::max(worst_z, std::abs(z));
+    }
+    char buffer[200];
+    snprintf(buffer, sizeof(buffer), "Sampling: worst slot deviation %.2f sigma | IS weight error %.2g\n",
+             worst_z, worst_weight_error);
+    std::cout << buffer;
+    
+    // Stratified segments are less noisy than independent draws, so 5 sigma is generous
+    bool ok = decode_errors == 0 && mirror_errors == 0 && file_errors == 0 && pool_errors == 0 &&
+              resize_errors == 0 &&
+              archive_errors == 0 && n_step_errors == 0 && dedup_errors == 0 && dedup_worst_z < 5.0 &&
+              strata_errors == 0 && worst_share_error < 0.01 && tree_errors == 0 && worst_z < 5.0 &&
+              worst_weight_error < 1e-9;
+    std::cout << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
+
+int runTrainingCheck() {
+    std::cout << "Training check: optimizer state, update rules, batch producer and target network\n";
+    const int I = NeuralNetwork::INPUT_SIZE;
+    const int H = 32;
+    const std::string path = "training_check_" + std::to_string(getpid()) + ".tmp";
+    // Reference arithmetic is double; a float build rounds every moment and parameter
+    const double tolerance = (sizeof(nn_accum) == sizeof(float)) ? 1e-5 : 1e-12;
+    
+    // A model trained a few batches with each rule reloads with the same rule, step count
+    // and moment buffers (saved at full precision), whatever rule the loader had before
+    std::mt19937 opt_gen(5151);
+    std::uniform_real_distribution<double> target_dist(-20.0, 20.0);
+    const int BATCH = 16;
+    std::vector<nn_real> states(size_t(BATCH) * I);
+    std::vector<double> targets(BATCH);
+    NeuralNetwork::BatchWorkspace ws;
+    auto trainSteps = [&](NeuralNetwork& net, int batches) {
+        for (int b = 0; b < batches; b++) {
+            for (int n = 0; n < BATCH; n++) {
+                decodeState(randomPackedState(opt_gen, n % 7), &states[size_t(n) * I]);
+                targets[n] = target_dist(opt_gen);
+            }
+            net.trainBatch(states.data(), targets.data(), BATCH, 0.001, ws);
+        }
+    };
+    auto sameState = [](const Optimizer& a, const Optimizer& b) {
+        bool same = a.type == b.type && a.steps == b.steps;
+        for (int g = 0; g < Optimizer::GROUP_COUNT; g++) {
+            same = same && a.first_moment[g] == b.first_moment[g] && a.second_moment[g] == b.second_moment[g];
+        }
+        return same;
+    };
+    auto isReset = [&](const Optimizer& opt, OptimizerType type, int hidden) {
+        Optimizer fresh(type);
+        fresh.reset(hidden);
+        return sameState(opt, fresh);
+    };
+    auto readText = [](const std::string& filename) {
+        std::ifstream file(filename);
+        std::ostringstream text;
+        text << file.rdbuf();
+        return text.str();
+    };
+    auto writeText = [](const std::string& filename, const std::string& text) {
+        std::ofstream file(filename);
+        file << text;
+    };
+    int persist_errors = 0;
+    for (int t = 0; t < OPTIMIZER_COUNT; t++) {
+        NeuralNetwork net(H);
+        net.optimizer.select(OptimizerType(t), H);
+        trainSteps(net, 5);
+        net.save(path);
+        NeuralNetwork loaded(H);
+        loaded.optimizer.select(t == OPTIMIZER_ADAM ? OPTIMIZER_MOMENTUM : OPTIMIZER_ADAM, H);
+        trainSteps(loaded, 2);
+        persist_errors += !loaded.load(path) || net.optimizer.steps != 5 || !sameState(net.optimizer, loaded.optimizer);
+    }
+    
+    // Files whose state does not fit the network load with the optimizer reset (the
+    // loader's rule, zero steps and moments): Adam state saved for a smaller and for a
+    // larger shape, a moment line cut short, a file cut between moment lines, and an older
+    // file without the section
+    NeuralNetwork small(32), large(64);
+    small.optimizer.select(OPTIMIZER_ADAM, 32);
+    large.optimizer.select(OPTIMIZER_ADAM, 64);
+    trainSteps(small, 3);
+    trainSteps(large, 3);
+    std::ostringstream small_state, large_state;
+    small.optimizer.save(small_state);
+    large.optimizer.save(large_state);
+    large.save(path);
+    const std::string large_text = readText(path);
+    small.save(path);
+    const std::string small_text = readText(path);
+    const size_t large_section = large_text.find("# Optimizer State");
+    const size_t small_section = small_text.find("# Optimizer State");
+    const size_t cut_line = small_text.find("SECOND_MOMENT 0");
+    const size_t cut_end = small_text.find('\n', cut_line);
+    const size_t last_line = small_text.rfind("SECOND_MOMENT");
+    struct Mismatch {
+        std::string text;
+        int hidden;
+    };
+    const Mismatch mismatches[] = {
+        {large_text.substr(0, large_section) + small_state.str(), 64},
+        {small_text.substr(0, small_section) + large_state.str(), 32},
+        {small_text.substr(0, (cut_line + cut_end) / 2) + small_text.substr(cut_end), 32},
+        {small_text.substr(0, last_line), 32},
+        {small_text.substr(0, small_section), 32},
+    };
+    int fallback_errors = 0;
+    for (const Mismatch& mismatch : mismatches) {
+        writeText(path, mismatch.text);
+        NeuralNetwork loaded(mismatch.hidden);
+        loaded.optimizer.select(OPTIMIZER_RMSPROP, mismatch.hidden);
+        trainSteps(loaded, 2);
+        fallback_errors += !loaded.load(path) || loaded.hidden_size != mismatch.hidden ||
+                           !isReset(loaded.optimizer, OPTIMIZER_RMSPROP, mismatch.hidden);
+    }
+    std::remove(path.c_str());
+    char line[200];
+    snprintf(line, sizeof(line), "Optimizer state: %d/%d rules reload differently | %d/%d mismatched files not reset\n",
+             persist_errors, int(OPTIMIZER_COUNT), fallback_errors, int(sizeof(mismatches) / sizeof(mismatches[0])));
+    std::cout << line;
+    
+    // One RMSProp and one Adam step against the update written out in double precision
+    // (Adam in the form with the bias correction folded into the step size), from random
+    // moments several steps in, with gradients past the clip, a NaN gradient and a
+    // parameter pushed into the limit
+    std::mt19937 rule_gen(5252);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    const int SAMPLES = 16;
+    const double learning_rate = 0.01;
+    UpdateRule rule;
+    rule.grad_scale = nn_accum(1.0) / SAMPLES;
+    rule.max_gradient = 5.0;
+    rule.step = nn_accum(learning_rate) * SAMPLES;
+    rule.limit = 2.0;
+    double worst_rule_error = 0.0;
+    for (OptimizerType type : {OPTIMIZER_RMSPROP, OPTIMIZER_ADAM}) {
+        Optimizer opt(type);
+        opt.reset(H);
+        std::vector<nn_accum>& m = opt.first_moment[Optimizer::BIAS1];
+        std::vector<nn_accum>& v = opt.second_moment[Optimizer::BIAS1];
+        for (nn_accum& value : m) value = unit(rule_gen);  // Adam only
+        for (nn_accum& value : v) value = std::abs(unit(rule_gen));
+        opt.steps = 3;
+        std::vector<nn_real> params(H);
+        std::vector<nn_accum> grad_sums(H);
+        for (int k = 0; k < H; k++) {
+            params[k] = nn_real(unit(rule_gen));
+            grad_sums[k] = nn_accum(200.0 * unit(rule_gen));
+        }
+        grad_sums[0] = std::numeric_limits<nn_accum>::quiet_NaN();
+        params[1] = nn_real(1.999);
+        grad_sums[1] = 100.0;
+        const std::vector<double> m0(m.begin(), m.end()), v0(v.begin(), v.end());
+        const std::vector<double> p0(params.begin(), params.end());
+        
+        opt.beginStep();
+        opt.apply(Optimizer::BIAS1, params.data(), grad_sums.data(), H, rule, learning_rate);
+        
+        const double t = double(opt.steps);
+        const double adam_lr = learning_rate * std::sqrt(1.0 - std::pow(opt.beta2, t)) / (1.0 - std::pow(opt.beta1, t));
+        for (int k = 0; k < H; k++) {
+            double g = double(grad_sums[k]) / SAMPLES;
+            if (std::isnan(g)) g = 0.0;
+            g = std::max(-5.0, std::min(5.0, g));
+            const double v_ref = opt.beta2 * v0[k] + (1.0 - opt.beta2) * g * g;
+            double delta;
+            if (type == OPTIMIZER_ADAM) {
+                const double m_ref = opt.beta1 * m0[k] + (1.0 - opt.beta1) * g;
+                delta = adam_lr * m_ref / (std::sqrt(v_ref) + opt.epsilon);
+                worst_rule_error = std::max(worst_rule_error, std::abs(m[k] - m_ref) / std::max(1.0, std::abs(m_ref)));
+            } else {
+                delta = learning_rate * g / (std::sqrt(v_ref) + opt.epsilon);
+            }
+            const double p_ref = std::max(-2.0, std::min(2.0, p0[k] + delta));
+            worst_rule_error = std::max(worst_rule_error, std::abs(v[k] - v_ref) / std::max(1.0, std::abs(v_ref)));
+            worst_rule_error = std::max(worst_rule_error, std::abs(params[k] - p_ref) / std::max(1.0, std::abs(p_ref)));
+        }
+    }
+    snprintf(line, sizeof(line), "Update rules: RMSProp and Adam step vs double reference, worst relative error %.2g\n",
+             worst_rule_error);
+    std::cout << line;
+    
+    // Batch producer at depth 1 with no pushes between batches: train() gets exactly the
+    // batches sampleBatch draws with the producer's generator (seeded from rand() when it
+    // starts). A new batch size or capacity, or turning on priorities, stops the producer and
+    // the next train() restarts it on the changed buffer. With priorities only the first
+    // batch after the restart is compared: the producer samples the next one while train()
+    // rewrites the priorities
+    auto fillReplay = [&](RLAgent& filled, std::mt19937& gen) {
+        for (int n = 0; n < 3000; n++) {
+            filled.replay_buffer.push(randomPackedState(gen, n % 7), 0, 0, target_dist(gen),
+                                      randomPackedState(gen, (n + 1) % 7), gen() % 10 == 0);
+        }
+    };
+    std::mt19937 producer_gen(5353);
+    RLAgent agent("", H);
+    fillReplay(agent, producer_gen);
+    agent.enableBatchProducer(1);
+    auto sameBatch = [](const RLAgent::TrainingBatch& a, const RLAgent::TrainingBatch& b) {
+        return a.states == b.states && a.rewards == b.rewards && a.done == b.done && a.next_states == b.next_states &&
+               a.slots == b.slots && a.weights == b.weights;
+    };
+    int producer_errors = 0, producer_batches = 0;
+    RLAgent::TrainingBatch expected;
+    auto trainAndCompare = [&](unsigned restart_seed, int batches) {
+        producer_errors += agent.producer_thread.joinable();  // Stopped until train() restarts it
+        srand(restart_seed);
+        std::mt19937 reference(static_cast<unsigned>(rand()));
+        srand(restart_seed);
+        for (int b = 0; b < batches; b++) {
+            agent.sampleBatch(expected, &reference);
+            agent.train();
+            const RLAgent::TrainingBatch& got = agent.train_batch;
+            bool valid = agent.producer_thread.joinable() && int(got.slots.size()) == agent.batch_size &&
+                         got.states.size() == size_t(agent.batch_size) * I &&
+                         got.weights.size() == (agent.prioritized_replay ? got.slots.size() : 0);
+            for (uint32_t slot : got.slots) valid = valid && slot < agent.replay_buffer.size();
+            producer_errors += !valid || ((b == 0 || !agent.prioritized_replay) && !sameBatch(expected, got));
+            producer_batches++;
+        }
+    };
+    trainAndCompare(6161, 20);
+    agent.setBatchSize(48);
+    trainAndCompare(6262, 20);
+    producer_errors += !agent.setReplayCapacity(1500) || agent.replay_buffer.size() != 1500;
+    trainAndCompare(6363, 20);
+    agent.enablePrioritizedReplay(0.6, 0.4);
+    std::uniform_real_distribution<double> priority_dist(0.1, 5.0);
+    for (size_t slot = 0; slot < agent.replay_buffer.size(); slot++) {
+        agent.replay_buffer.setPriority(slot, priority_dist(producer_gen));
+    }
+    trainAndCompare(6464, 20);
+    agent.enableBatchProducer(0);
+    producer_errors += agent.producer_thread.joinable();
+    snprintf(line, sizeof(line), "Batch producer: %d/%d batches differ from sampleBatch or do not fit the buffer "
+             "(batch 32 then 48, capacity 1500, then priorities)\n", producer_errors, producer_batches);
+    std::cout << line;
+    
+    // Target network: with a sync interval it is a hard copy of q_network taken exactly every
+    // interval batches (and differs from it in between); with tau it becomes
+    // tau * online + (1 - tau) * target after every batch. Either way the targets the worker
+    // computes for the next batch equal targets computed here from the same frozen network,
+    // and are the ones that batch trains with
+    std::mt19937 target_gen(5454);
+    auto sameParameters = [](const NeuralNetwork& a, const NeuralNetwork& b) {
+        return a.weights1 == b.weights1 && a.bias1 == b.bias1 && a.weights2 == b.weights2 && a.bias2 == b.bias2;
+    };
+    const int SYNC_INTERVAL = 5;
+    const double TAU = 0.05;
+    const int TARGET_BATCHES = 40;
+    int sync_errors = 0, async_errors = 0;
+    double worst_blend_error = 0.0;
+    for (int polyak = 0; polyak < 2; polyak++) {
+        RLAgent learner("", H);
+        fillReplay(learner, target_gen);
+        learner.enableTargetNetwork(SYNC_INTERVAL, polyak ? TAU : 0.0);
+        NeuralNetwork synced = learner.q_network;
+        RLAgent::TrainingBatch frozen;
+        for (int b = 1; b <= TARGET_BATCHES; b++) {
+            const NeuralNetwork before = learner.target_network;
+            learner.train();
+            const NeuralNetwork& online = learner.q_network;
+            const NeuralNetwork& target = learner.target_network;
+            if (polyak) {
+                auto blended = [&](const nn_real* result, const nn_real* old_target, const nn_real* current, size_t count) {
+                    for (size_t k = 0; k < count; k++) {
+                        const double expected_value = TAU * current[k] + (1.0 - TAU) * old_target[k];
+                        worst_blend_error = std::max(worst_blend_error, std::abs(result[k] - expected_value) /
+                                                                            std::max(1.0, std::abs(expected_value)));
+                    }
+                };
+                blended(target.weights1.data(), before.weights1.data(), online.weights1.data(), online.weights1Count());
+                blended(target.bias1.data(), before.bias1.data(), online.bias1.data(), H);
+                blended(target.weights2.data(), before.weights2.data(), online.weights2.data(), H);
+                blended(target.bias2.data(), before.bias2.data(), online.bias2.data(), 1);
+            } else {
+                if (b % SYNC_INTERVAL == 0) synced = online;
+                sync_errors += !sameParameters(target, synced) ||
+                               (b % SYNC_INTERVAL != 0 && sameParameters(target, online));
+            }
+            
+            // The batch just trained is the one prefetched after the previous batch
+            if (b > 1) {
+                async_errors += learner.train_batch.slots != frozen.slots || learner.train_batch.targets != frozen.targets;
+            }
+            learner.pending_targets.wait();
+            frozen = learner.pending_batch;
+            RLAgent::computeTargets(frozen, target, learner.bootstrapDiscount());
+            async_errors += frozen.targets != learner.pending_batch.targets;
+        }
+    }
+    snprintf(line, sizeof(line), "Target network: %d/%d batches with a wrong hard sync (every %d) | Polyak error %.2g "
+             "(tau %g) | %d/%d async target mismatches\n", sync_errors, TARGET_BATCHES, SYNC_INTERVAL,
+             worst_blend_error, TAU, async_errors, 2 * (2 * TARGET_BATCHES - 1));
+    std::cout << line;
+    
+    bool ok = persist_errors == 0 && fallback_errors == 0 && worst_rule_error < tolerance && producer_errors == 0 &&
+              sync_errors == 0 && worst_blend_error < tolerance && async_errors == 0;
+    std::cout << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <string>
+
+// Offline checks run from the command line (before the game UI starts).
+// Each returns a process exit code: 0 when the check passes, 1 otherwise.
+
+// Compare the network's Q-values (nn_real build precision) against a
+// double-precision reference loaded from the same model file
+int runPrecisionCheck(const std::string& model_file, int samples);
+
+// Check every SIMD kernel this CPU supports (forward single and batched, gradient
+// accumulation and update, for every supported network shape) for bit-identical
+// results against the scalar kernels
+int runKernelCheck(const std::string& model_file, int samples);
+
+// Compare move selection with the quantized (int16 fixed-point) network against the float path on a
+// position corpus: every afterstate findBestMove scored, grouped by decision. The corpus
+// is read from corpus_file if it exists, otherwise recorded by playing `decisions` greedy
+// moves with the model and saved there (not saved when corpus_file is empty). Outputs are
+// compared before the Q-value clamp, for the model and for a freshly initialized network
+int runQuantizedCheck(const std::string& model_file, int decisions, const std::string& corpus_file);
+
+// Train copies of the model for `seconds` each with 1 and with `learners` Hogwild learners
+// on a regression task with a known answer, and report minibatches per second and the
+// held-out error over time. Fails if the Hogwild run diverges
+int runHogwildBench(const std::string& model_file, int learners, double seconds);
+
+// Stress the snapshot publisher: a learner thread publishes version-stamped networks as
+// fast as it can while reader threads check every snapshot they hold for torn or
+// out-of-order weights
+int runSnapshotCheck(int readers, double seconds);
+
+// Choose moves for a set of positions from `threads` game threads sharing one const agent,
+// each with its own scratch and generator, and check every decision (greedy and exploring)
+// against the same decisions made on one thread
+int runSharedAgentCheck(const std::string& model_file, int threads, int positions);
+
+// Check the replay buffer's sum-tree against brute force, and that prioritized sampling
+// picks every transition in proportion to its priority with consistent importance weights
+int runReplayCheck(int draws);
+
+// Check that optimizer state survives a model save and load with every update rule, that
+// state which does not fit the network loads as a reset optimizer, one RMSProp and Adam
+// step against a double-precision reference, and that the batch producer hands train() the
+// batches sampleBatch draws, across restarts after the batch size or buffer changes. Also
+// checks the target network's hard sync interval, its Polyak averaging, and the targets
+// computed for the next batch in the background against the same frozen network
+int runTrainingCheck();
+
+#endif // DIAGNOSTICS_H
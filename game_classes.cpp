@@ -0,0 +1,407 @@
+#include "game_classes.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+// Tetris pieces (tetrominoes) - each piece is defined by its shape
+// Format: [rotations][y][x] where each rotation is a 4x4 grid
+const int PIECES[7][4][4][4] = {
+    // I piece
+    {
+        {{0,0,0,0}, {1,1,1,1}, {0,0,0,0}, {0,0,0,0}},
+        {{0,0,1,0}, {0,0,1,0}, {0,0,1,0}, {0,0,1,0}},
+        {{0,0,0,0}, {0,0,0,0}, {1,1,1,1}, {0,0,0,0}},
+        {{0,1,0,0}, {0,1,0,0}, {0,1,0,0}, {0,1,0,0}}
+    },
+    // O piece
+    {
+        {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}},
+        {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}},
+        {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}},
+        {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}}
+    },
+    // T piece
+    {
+        {{0,0,0,0}, {0,1,0,0}, {1,1,1,0}, {0,0,0,0}},
+        {{0,0,0,0}, {0,1,0,0}, {0,1,1,0}, {0,1,0,0}},
+        {{0,0,0,0}, {0,0,0,0}, {1,1,1,0}, {0,1,0,0}},
+        {{0,0,0,0}, {0,1,0,0}, {1,1,0,0}, {0,1,0,0}}
+    },
+    // S piece
+    {
+        {{0,0,0,0}, {0,1,1,0}, {1,1,0,0}, {0,0,0,0}},
+        {{0,0,0,0}, {0,1,0,0}, {0,1,1,0}, {0,0,1,0}},
+        {{0,0,0,0}, {0,0,0,0}, {0,1,1,0}, {1,1,0,0}},
+        {{0,0,0,0}, {1,0,0,0}, {1,1,0,0}, {0,1,0,0}}
+    },
+    // Z piece
+    {
+        {{0,0,0,0}, {1,1,0,0}, {0,1,1,0}, {0,0,0,0}},
+        {{0,0,0,0}, {0,0,1,0}, {0,1,1,0}, {0,1,0,0}},
+        {{0,0,0,0}, {0,0,0,0}, {1,1,0,0}, {0,1,1,0}},
+        {{0,0,0,0}, {0,1,0,0}, {1,1,0,0}, {1,0,0,0}}
+    },
+    // J piece
+    {
+        {{0,0,0,0}, {1,0,0,0}, {1,1,1,0}, {0,0,0,0}},
+        {{0,0,0,0}, {0,1,1,0}, {0,1,0,0}, {0,1,0,0}},
+        {{0,0,0,0}, {0,0,0,0}, {1,1,1,0}, {0,0,1,0}},
+        {{0,0,0,0}, {0,1,0,0}, {0,1,0,0}, {1,1,0,0}}
+    },
+    // L piece
+    {
+        {{0,0,0,0}, {0,0,1,0}, {1,1,1,0}, {0,0,0,0}},
+        {{0,0,0,0}, {0,1,0,0}, {0,1,0,0}, {0,1,1,0}},
+        {{0,0,0,0}, {0,0,0,0}, {1,1,1,0}, {1,0,0,0}},
+        {{0,0,0,0}, {1,1,0,0}, {0,1,0,0}, {0,1,0,0}}
+    }
+};
+
+// Colors for each piece type
+const int PIECE_COLORS[7] = {
+    1,  // I - Cyan
+    2,  // O - Yellow
+    3,  // T - Magenta
+    4,  // S - Green
+    5,  // Z - Red
+    6,  // J - Blue
+    7   // L - White
+};
+
+TetrisPiece::TetrisPiece(int piece_type, int x, int y) 
+    : type(piece_type), x(x), y(y), rotation(0), color(PIECE_COLORS[piece_type]) {}
+
+void TetrisPiece::getShape(int shape[4][4]) const {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            shape[i][j] = PIECES[type][rotation][i][j];
+        }
+    }
+}
+
+void TetrisPiece::rotate() {
+    rotation = (rotation + 1) % 4;
+}
+
+std::vector<Point> TetrisPiece::getBlocks() const {
+    std::vector<Point> blocks;
+    int shape[4][4];
+    getShape(shape);
+    for (int dy = 0; dy < 4; dy++) {
+        for (int dx = 0; dx < 4; dx++) {
+            if (shape[dy][dx]) {
+                blocks.push_back(Point(x + dx, y + dy));
+            }
+        }
+    }
+    return blocks;
+}
+
+TetrisGame::TetrisGame() 
+    : board(HEIGHT, std::vector<int>(WIDTH, 0)),
+      current_piece(nullptr),
+      next_piece(nullptr),
+      score(0),
+      lines_cleared(0),
+      level(1),
+      game_over(false),
+      paused(false),
+      ai_enabled(false),
+      training_mode(false),
+      last_score(0),
+      last_lines(0),
+      fall_delay(0.5),
+      last_fall_time(std::chrono::steady_clock::now()),
+      last_ai_time(std::chrono::steady_clock::now()) {
+    spawnPiece();
+}
+
+TetrisGame::~TetrisGame() {
+    // Only delete if pointers are different to avoid double deletion
+    if (current_piece != nullptr) {
+        delete current_piece;
+        current_piece = nullptr;
+    }
+    if (next_piece != nullptr && next_piece != current_piece) {
+        delete next_piece;
+        next_piece = nullptr;
+    }
+}
+
+void TetrisGame::spawnPiece() {
+    // Delete old current_piece if it exists (shouldn't happen, but safety check)
+    if (current_piece != nullptr && current_piece != next_piece) {
+        delete current_piece;
+    }
+    
+    if (next_piece == nullptr) {
+        int piece_type = rand() % 7;
+        next_piece = new TetrisPiece(piece_type);
+    }
+    
+    // Take ownership of next_piece
+    current_piece = next_piece;
+    next_piece = nullptr;  // Clear next_piece so we don't double-delete
+    
+    current_piece->x = WIDTH / 2 - 2;
+    current_piece->y = 0;
+    
+    // Check if game over
+    if (checkCollision(*current_piece)) {
+        game_over = true;
+    }
+    
+    // Generate next piece
+    int piece_type = rand() % 7;
+    next_piece = new TetrisPiece(piece_type);
+}
+
+bool TetrisGame::checkCollision(const TetrisPiece& piece, int dx, int dy) const {
+        std::vector<Point> blocks = piece.getBlocks();
+        for (const auto& block : blocks) {
+            int nx = block.x + dx;
+            int ny = block.y + dy;
+            // Check boundaries
+            if (nx < 0 || nx >= WIDTH || ny >= HEIGHT) {
+                return true;
+            }
+            // Check placed blocks (only check if within board)
+            if (ny >= 0 && board[ny][nx] != 0) {
+                return true;
+        }
+    }
+    return false;
+}
+
+void TetrisGame::placePiece() {
+        if (current_piece == nullptr) return;
+        
+        std::vector<Point> blocks = current_piece->getBlocks();
+        for (const auto& block : blocks) {
+            if (block.y >= 0 && block.y < HEIGHT && block.x >= 0 && block.x < WIDTH) {
+                board[block.y][block.x] = current_piece->color;
+            }
+        }
+        
+        // Clear lines
+        int cleared = clearLines();
+        lines_cleared += cleared;
+        
+        // Update score
+        if (cleared > 0) {
+            int points[] = {0, 100, 300, 500, 800};
+            score += points[std::min(cleared, 4)] * level;
+        }
+        
+        // Update level (every 10 lines)
+        level = lines_cleared / 10 + 1;
+        fall_delay = std::max(0.05, 0.5 - (level - 1) * 0.05);
+        
+    delete current_piece;
+    current_piece = nullptr;
+}
+
+int TetrisGame::clearLines() {
+    std::vector<int> lines_to_clear;
+    for (int y = 0; y < HEIGHT; y++) {
+        bool full = true;
+        for (int x = 0; x < WIDTH; x++) {
+            if (board[y][x] == 0) {
+                full = false;
+                break;
+            }
+        }
+        if (full) {
+            lines_to_clear.push_back(y);
+        }
+    }
+    
+    // Remove lines from bottom to top
+    for (auto it = lines_to_clear.rbegin(); it != lines_to_clear.rend(); ++it) {
+        board.erase(board.begin() + *it);
+        board.insert(board.begin(), std::vector<int>(WIDTH, 0));
+    }
+    
+    return lines_to_clear.size();
+}
+
+bool TetrisGame::movePiece(int dx, int dy) {
+    if (current_piece == nullptr) return false;
+    
+    if (!checkCollision(*current_piece, dx, dy)) {
+        current_piece->x += dx;
+        current_piece->y += dy;
+        return true;
+    }
+    return false;
+}
+
+bool TetrisGame::rotatePiece() {
+        if (current_piece == nullptr) return false;
+        
+        int old_rotation = current_piece->rotation;
+        current_piece->rotate();
+        
+        if (checkCollision(*current_piece)) {
+            // Try wall kicks
+            int kicks[] = {-1, 1, -2, 2};
+            for (int dx : kicks) {
+                if (!checkCollision(*current_piece, dx, 0)) {
+                    current_piece->x += dx;
+                    return true;
+                }
+            }
+            // Rotation failed, revert
+            current_piece->rotation = old_rotation;
+            return false;
+        }
+        return true;
+}
+
+void TetrisGame::hardDrop() {
+    if (current_piece == nullptr) return;
+    
+    // Safety limit to prevent infinite loop
+    int drop_attempts = 0;
+    while (movePiece(0, 1) && drop_attempts < HEIGHT * 2) {
+        score += 2;  // Bonus points for hard drop
+        drop_attempts++;
+    }
+    if (drop_attempts >= HEIGHT * 2) {
+        // Safety: force place piece if stuck
+        placePiece();
+        spawnPiece();
+        return;
+    }
+    placePiece();
+    spawnPiece();
+}
+
+void TetrisGame::update() {
+    if (game_over || paused) return;
+    
+    auto current_time = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        current_time - last_fall_time).count() / 1000.0;
+    
+    if (elapsed >= fall_delay) {
+        if (current_piece == nullptr) {
+            spawnPiece();
+        } else if (!movePiece(0, 1)) {
+            placePiece();
+            spawnPiece();
+        }
+        last_fall_time = current_time;
+    }
+}
+
+void TetrisGame::executeAIMove(int rotation, int x_pos) {
+    if (current_piece == nullptr) return;
+    
+    // Rotate to desired rotation (with safety limit)
+    int rotation_attempts = 0;
+    while (current_piece->rotation != rotation && rotation_attempts < 10) {
+        rotatePiece();
+        rotation_attempts++;
+    }
+    if (rotation_attempts >= 10) {
+        // Debug: rotation stuck
+        static int debug_count = 0;
+        if (debug_count++ % 100 == 0) {
+            // Could log to file or screen, but avoiding I/O for now
+        }
+    }
+    
+    // Move to desired x position (with safety limits)
+    int target_x = x_pos;
+    int move_attempts = 0;
+    while (current_piece->x < target_x && movePiece(1, 0) && move_attempts < WIDTH * 2) {
+        move_attempts++;
+    }
+    move_attempts = 0;
+    while (current_piece->x > target_x && movePiece(-1, 0) && move_attempts < WIDTH * 2) {
+        move_attempts++;
+    }
+    
+    // Hard drop
+    hardDrop();
+}
+
+std::vector<std::vector<int>> TetrisGame::simulatePlacePiece(const TetrisPiece& piece, int drop_y) const {
+        std::vector<std::vector<int>> sim_board = board;
+        std::vector<Point> blocks = piece.getBlocks();
+        for (const auto& block : blocks) {
+            int y = block.y + drop_y - piece.y;
+            int x = block.x;
+            if (y >= 0 && y < HEIGHT && x >= 0 && x < WIDTH) {
+                sim_board[y][x] = piece.color;
+            }
+        }
+    return sim_board;
+}
+
+int TetrisGame::simulateClearLines(std::vector<std::vector<int>>& sim_board) const {
+        std::vector<int> lines_to_clear;
+        for (int y = 0; y < HEIGHT; y++) {
+            bool full = true;
+            for (int x = 0; x < WIDTH; x++) {
+                if (sim_board[y][x] == 0) {
+                    full = false;
+                    break;
+                }
+            }
+            if (full) {
+                lines_to_clear.push_back(y);
+            }
+        }
+        
+        for (auto it = lines_to_clear.rbegin(); it != lines_to_clear.rend(); ++it) {
+            sim_board.erase(sim_board.begin() + *it);
+            sim_board.insert(sim_board.begin(), std::vector<int>(WIDTH, 0));
+        }
+        
+    return lines_to_clear.size();
+}
+
+int TetrisGame::getColumnHeight(int x, const std::vector<std::vector<int>>& sim_board) const {
+        for (int y = 0; y < HEIGHT; y++) {
+            if (sim_board[y][x] != 0) {
+                return HEIGHT - y;
+            }
+        }
+    return 0;
+}
+
+int TetrisGame::countHoles(const std::vector<std::vector<int>>& sim_board) const {
+        int holes = 0;
+        for (int x = 0; x < WIDTH; x++) {
+            bool block_found = false;
+            for (int y = 0; y < HEIGHT; y++) {
+                if (sim_board[y][x] != 0) {
+                    block_found = true;
+                } else if (block_found) {
+                    holes++;
+                }
+            }
+        }
+    return holes;
+}
+
+int TetrisGame::calculateBumpiness(const std::vector<std::vector<int>>& sim_board) const {
+        int bumpiness = 0;
+        for (int x = 0; x < WIDTH - 1; x++) {
+            int h1 = getColumnHeight(x, sim_board);
+            int h2 = getColumnHeight(x + 1, sim_board);
+            bumpiness += abs(h1 - h2);
+        }
+    return bumpiness;
+}
+
+int TetrisGame::getAggregateHeight(const std::vector<std::vector<int>>& sim_board) const {
+    int height = 0;
+    for (int x = 0; x < WIDTH; x++) {
+        height += getColumnHeight(x, sim_board);
+    }
+    return height;
+}
@@ -0,0 +1,203 @@
+#include "nn_kernels.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Only for applyUpdateElement (shared with the SIMD tails); the templates are not instantiated here
+namespace {
+#include "nn_kernels_impl.h"
+} // namespace
+
+// Scalar reference kernels. The SIMD versions (nn_kernels_*.cpp) follow exactly the
+// same summation order, so they must produce bit-identical results.
+
+template <int IN, int HID>
+static nn_accum forwardScalar(const NetworkView& net, const nn_real* input, nn_accum* pre_activation) {
+    static_assert(HID % NN_OUTPUT_LANES == 0, "hidden size must be a multiple of NN_OUTPUT_LANES");
+    nn_accum partial[NN_OUTPUT_LANES] = {};
+
+    for (int i = 0; i < HID; i++) {
+        nn_accum sum = net.bias1[i];
+        for (int j = 0; j < IN; j++) {
+            sum += nn_accum(input[j]) * nn_accum(net.weights1[j * HID + i]);
+        }
+        if (pre_activation) pre_activation[i] = sum;
+        nn_accum hidden = std::max(nn_accum(0.2) * sum, sum);  // Leaky ReLU
+        partial[i % NN_OUTPUT_LANES] += hidden * nn_accum(net.weights2[i]);
+    }
+
+    nn_accum output = net.bias2;
+    for (int k = 0; k < NN_OUTPUT_LANES; k++) {
+        output += partial[k];
+    }
+    return output;
+}
+
+template <int IN, int HID>
+static void forwardBatchScalar(const NetworkView& net, const nn_real* inputs, int count,
+                               nn_accum* outputs, nn_accum* pre_activations) {
+    for (int n = 0; n < count; n++) {
+        outputs[n] = forwardScalar<IN, HID>(net, inputs + n * IN,
+                                            pre_activations ? pre_activations + n * HID : nullptr);
+    }
+}
+
+template <int HID>
+static nn_accum forwardDeltaScalar(const NetworkView& net, const nn_accum* base_pre_activation,
+                                   const int* changed, const nn_accum* delta, int change_count) {
+    nn_accum partial[NN_OUTPUT_LANES] = {};
+    
+    for (int i = 0; i < HID; i++) {
+        nn_accum sum = base_pre_activation[i];
+        for (int c = 0; c < change_count; c++) {
+            sum += delta[c] * nn_accum(net.weights1[changed[c] * HID + i]);
+        }
+        nn_accum hidden = std::max(nn_accum(0.2) * sum, sum);  // Leaky ReLU
+        partial[i % NN_OUTPUT_LANES] += hidden * nn_accum(net.weights2[i]);
+    }
+    
+    nn_accum output = net.bias2;
+    for (int k = 0; k < NN_OUTPUT_LANES; k++) {
+        output += partial[k];
+    }
+    return output;
+}
+
+template <int HID>
+static float forwardQuantizedScalar(const QuantizedView& net, const int16_t* input) {
+    float partial[NN_OUTPUT_LANES] = {};
+    
+    for (int i = 0; i < HID; i++) {
+        int32_t sum = net.bias1[i];
+        for (int p = 0; p < NN_INPUT_PAIRS; p++) {
+            const int16_t* w = net.weights1 + (p * HID + i) * 2;
+            sum += int32_t(input[2 * p]) * w[0] + int32_t(input[2 * p + 1]) * w[1];
+        }
+        float h = float(sum);
+        float hidden = std::max(0.2f * h, h);  // Leaky ReLU (the scale is folded into weights2)
+        partial[i % NN_OUTPUT_LANES] += hidden * net.weights2[i];
+    }
+    
+    float output = net.bias2;
+    for (int k = 0; k < NN_OUTPUT_LANES; k++) {
+        output += partial[k];
+    }
+    return output;
+}
+
+template <int IN, int HID>
+static void accumulateGradientsScalar(const nn_real* input, const nn_accum* delta, nn_accum* grad_weights1) {
+    for (int j = 0; j < IN; j++) {
+        if (input[j] == 0) continue;  // One-hot and empty-column features add nothing
+        nn_accum x = input[j];
+        nn_accum* row = grad_weights1 + j * HID;
+        for (int i = 0; i < HID; i++) {
+            row[i] += delta[i] * x;
+        }
+    }
+}
+
+static void applyUpdateScalar(nn_real* params, const nn_accum* grad_sums, int count, const UpdateRule& rule) {
+    for (int k = 0; k < count; k++) {
+        params[k] = applyUpdateElement(params[k], grad_sums[k], rule);
+    }
+}
+
+#define NN_SCALAR_KERNELS(shape) \
+    { "scalar", forwardScalar<NN_INPUT_SIZE, NN_HIDDEN_SIZES[shape]>, \
+      forwardBatchScalar<NN_INPUT_SIZE, NN_HIDDEN_SIZES[shape]>, \
+      forwardDeltaScalar<NN_HIDDEN_SIZES[shape]>, \
+      forwardQuantizedScalar<NN_HIDDEN_SIZES[shape]>, \
+      accumulateGradientsScalar<NN_INPUT_SIZE, NN_HIDDEN_SIZES[shape]>, \
+      applyUpdateScalar }
+
+static_assert(NN_SHAPE_COUNT == 3, "add the new shape to the kernel tables");
+static const NNKernels nn_kernels_scalar[NN_SHAPE_COUNT] = {
+    NN_SCALAR_KERNELS(0),
+    NN_SCALAR_KERNELS(1),
+    NN_SCALAR_KERNELS(2)
+};
+
+#if defined(__x86_64__)
+extern const NNKernels nn_kernels_sse42[NN_SHAPE_COUNT];
+extern const NNKernels nn_kernels_avx2[NN_SHAPE_COUNT];
+extern const NNKernels nn_kernels_avx512[NN_SHAPE_COUNT];
+#endif
+
+void nnQuantizeInput(const nn_real* input, int16_t* quantized) {
+    // Padded to an even count, plain comparisons and a truncating conversion (rounds half
+    // away from zero) so the loop has a fixed trip count and vectorizes; NaN -> 0
+    nn_accum x[NN_INPUT_PAIRS * 2];
+    for (int j = 0; j < NN_INPUT_SIZE; j++) {
+        x[j] = nn_accum(input[j]);
+    }
+    for (int j = NN_INPUT_SIZE; j < NN_INPUT_PAIRS * 2; j++) {
+        x[j] = 0;
+    }
+    for (int j = 0; j < NN_INPUT_PAIRS * 2; j++) {
+        nn_accum v = x[j] * nn_accum(NN_QUANT_INPUT_SCALE);
+        v = (v == v) ? v : nn_accum(0);
+        v = (v < nn_accum(32767)) ? v : nn_accum(32767);
+        v = (v > nn_accum(-32767)) ? v : nn_accum(-32767);
+        quantized[j] = int16_t(int32_t(v + (v < 0 ? nn_accum(-0.5) : nn_accum(0.5))));
+    }
+}
+
+int nnShapeIndex(int input_size, int hidden_size) {
+    if (input_size != NN_INPUT_SIZE) return -1;
+    for (int shape = 0; shape < NN_SHAPE_COUNT; shape++) {
+        if (NN_HIDDEN_SIZES[shape] == hidden_size) return shape;
+    }
+    return -1;
+}
+
+// Kernel table for an instruction set (one entry per shape), or nullptr
+static const NNKernels* kernelTableFor(NNIsa isa) {
+    switch (isa) {
+        case NN_ISA_SCALAR:
+            return nn_kernels_scalar;
+#if defined(__x86_64__)
+        case NN_ISA_SSE42:
+            return __builtin_cpu_supports("sse4.2") ? nn_kernels_sse42 : nullptr;
+        case NN_ISA_AVX2:
+            return __builtin_cpu_supports("avx2") ? nn_kernels_avx2 : nullptr;
+        case NN_ISA_AVX512:
+            return (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) ? nn_kernels_avx512 : nullptr;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const NNKernels* nnKernelsFor(NNIsa isa, int shape) {
+    if (shape < 0 || shape >= NN_SHAPE_COUNT) return nullptr;
+    const NNKernels* table = kernelTableFor(isa);
+    return table ? &table[shape] : nullptr;
+}
+
+static const NNKernels* selectKernelTable() {
+    // Explicit override (for benchmarking or to work around a misbehaving CPU)
+    const char* forced = std::getenv("TETRIS_NN_ISA");
+    if (forced != nullptr) {
+        for (int isa = 0; isa < NN_ISA_COUNT; isa++) {
+            const NNKernels* table = kernelTableFor(static_cast<NNIsa>(isa));
+            if (table != nullptr && std::strcmp(table->name, forced) == 0) {
+                return table;
+            }
+        }
+    }
+
+    // Otherwise the widest instruction set this CPU supports
+    for (int isa = NN_ISA_COUNT - 1; isa > NN_ISA_SCALAR; isa--) {
+        const NNKernels* table = kernelTableFor(static_cast<NNIsa>(isa));
+        if (table != nullptr) {
+            return table;
+        }
+    }
+    return nn_kernels_scalar;
+}
+
+const NNKernels& nnKernels(int shape) {
+    static const NNKernels* selected = selectKernelTable();
+    return selected[shape];
+}
@@ -0,0 +1,130 @@
+#ifndef NN_KERNELS_H
+#define NN_KERNELS_H
+
+#include <cstdint>
+
+// Network precision: double by default, float with PRECISION=float (-DTETRIS_NN_FLOAT32)
+// nn_accum is the type used for dot-product sums; float builds can keep it in double
+// with ACCUM=double (-DTETRIS_NN_DOUBLE_ACCUM) while weights and states stay float
+#ifdef TETRIS_NN_FLOAT32
+typedef float nn_real;
+#else
+typedef double nn_real;
+#endif
+#if defined(TETRIS_NN_FLOAT32) && !defined(TETRIS_NN_DOUBLE_ACCUM)
+typedef float nn_accum;
+#else
+typedef double nn_accum;
+#endif
+
+// Raw view of the network parameters used by the kernels
+struct NetworkView {
+    const nn_real* weights1;  // Input-major: weights1[j * hidden_size + i]
+    const nn_real* bias1;     // hidden_size
+    const nn_real* weights2;  // hidden_size (single output)
+    nn_real bias2;
+    int input_size;
+    int hidden_size;          // Must be a multiple of NN_OUTPUT_LANES
+};
+
+// Supported network shapes. Every kernel set is instantiated once per hidden size so
+// the loops have compile-time trip counts; models select their entry by shape index.
+// Adding a shape means adding it here and to the kernel tables (see nnShapeIndex)
+const int NN_INPUT_SIZE = 27;
+const int NN_SHAPE_COUNT = 3;
+constexpr int NN_HIDDEN_SIZES[NN_SHAPE_COUNT] = {32, 64, 128};
+const int NN_MAX_HIDDEN_SIZE = 128;
+
+// The output layer sums hidden units into NN_OUTPUT_LANES partial sums (unit i goes to
+// lane i % NN_OUTPUT_LANES), then adds the partials to bias2 in lane order. Every
+// kernel uses this order, so all instruction sets give bit-identical Q-values.
+const int NN_OUTPUT_LANES = 16;
+
+// Quantized copy of the network for move selection (NeuralNetwork::quantize). Inputs and
+// first-layer weights are int16 fixed point, multiplied with the SIMD multiply-add of
+// adjacent int16 pairs into exact int32 hidden sums (so every kernel agrees bit for bit);
+// the output layer runs in float in NN_OUTPUT_LANES order.
+// The input scale is the LCM of the feature denominators (heights / 20, holes / 200,
+// bumpiness / 180), so board features quantize exactly. The weights use one scale for the
+// layer with 14-bit magnitudes: with weights clipped at +/-20 an int8 range rounds them
+// to steps of 0.16, which changed the chosen move in ~4% of decisions.
+// Worst-case sum: 28 * 1800 * 8191 + bias, well inside int32
+const int NN_INPUT_PAIRS = (NN_INPUT_SIZE + 1) / 2;  // Inputs padded to an even count
+const int NN_QUANT_INPUT_SCALE = 1800;
+const int NN_QUANT_WEIGHT_MAX = 8191;
+
+struct QuantizedView {
+    const int16_t* weights1;  // Pair-interleaved: weights1[(p * hidden_size + i) * 2 + k] = W1[2p + k][i]
+    const int32_t* bias1;     // bias1 in accumulator units (input scale * weight scale)
+    const float* weights2;    // weights2 with the dequantisation factor folded in
+    float bias2;
+    int hidden_size;
+};
+
+// Quantize one input row into NN_INPUT_PAIRS * 2 int16 values (padding and NaN -> 0)
+void nnQuantizeInput(const nn_real* input, int16_t* quantized);
+
+// Forward pass for one quantized input (from nnQuantizeInput). Returns the raw output
+typedef float (*QuantizedForwardKernel)(const QuantizedView& net, const int16_t* input);
+
+// Forward pass for one input. Returns the raw output (before Q-value clipping) and,
+// when pre_activation is not null, stores the hidden pre-activations (hidden_size values)
+typedef nn_accum (*ForwardKernel)(const NetworkView& net, const nn_real* input, nn_accum* pre_activation);
+
+// Forward pass for `count` inputs stored row by row (input_size values each).
+// pre_activations, when not null, receives count * hidden_size values
+typedef void (*ForwardBatchKernel)(const NetworkView& net, const nn_real* inputs, int count,
+                                   nn_accum* outputs, nn_accum* pre_activations);
+
+// Forward pass from precomputed hidden pre-activations (incremental evaluation).
+// Starts from base_pre_activation (hidden_size values, e.g. from `forward` on a reference
+// input), adds delta[c] * weights1 row changed[c] for c = 0..change_count-1 in that order,
+// then applies the activation and the output layer. Returns the raw output
+typedef nn_accum (*ForwardDeltaKernel)(const NetworkView& net, const nn_accum* base_pre_activation,
+                                       const int* changed, const nn_accum* delta, int change_count);
+
+// Backward pass for one sample: adds delta[i] * input[j] to grad_weights1[j * hidden_size + i]
+// (delta = hidden-layer deltas, hidden_size values). Zero inputs are skipped
+typedef void (*AccumulateGradientsKernel)(const nn_real* input, const nn_accum* delta, nn_accum* grad_weights1);
+
+// One clipped SGD step, applied element by element:
+//   g = clip(grad_sum * grad_scale, +/-max_gradient)      (NaN gradient -> 0)
+//   param = clip(param + step * g, +/-limit)              (NaN parameter -> 0)
+struct UpdateRule {
+    nn_accum grad_scale;    // 1 / samples in the batch (turns the sums into means)
+    nn_accum max_gradient;
+    nn_accum step;          // Learning rate times samples in the batch
+    nn_accum limit;
+};
+typedef void (*ApplyUpdateKernel)(nn_real* params, const nn_accum* grad_sums, int count, const UpdateRule& rule);
+
+struct NNKernels {
+    const char* name;
+    ForwardKernel forward;
+    ForwardBatchKernel forward_batch;
+    ForwardDeltaKernel forward_delta;
+    QuantizedForwardKernel forward_quantized;
+    AccumulateGradientsKernel accumulate_gradients;
+    ApplyUpdateKernel apply_update;  // Branch-free clip, clamp and NaN repair
+};
+
+enum NNIsa {
+    NN_ISA_SCALAR,
+    NN_ISA_SSE42,
+    NN_ISA_AVX2,
+    NN_ISA_AVX512,
+    NN_ISA_COUNT
+};
+
+// Index into NN_HIDDEN_SIZES for a network shape, or -1 if the shape is not supported
+int nnShapeIndex(int input_size, int hidden_size);
+
+// Kernels for a specific instruction set and shape index, or nullptr if not built or
+// not supported by this CPU
+const NNKernels* nnKernelsFor(NNIsa isa, int shape);
+
+// Best kernels for this CPU and shape index; the instruction set is chosen once on first use.
+// TETRIS_NN_ISA=scalar|sse4.2|avx2|avx512 forces a (supported) instruction set.
+const NNKernels& nnKernels(int shape);
+
+#endif // NN_KERNELS_H
@@ -0,0 +1,84 @@
+// AVX-512 network kernels (built with -mavx512f -mavx512bw, selected at runtime by nnKernels())
+#include "nn_kernels.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <cstring>
+
+namespace {
+
+#if defined(TETRIS_NN_FLOAT32) && !defined(TETRIS_NN_DOUBLE_ACCUM)
+struct Ops {
+    typedef __m512 vec;
+    static const int WIDTH = 16;
+    static inline vec zero() { return _mm512_setzero_ps(); }
+    static inline vec set1(nn_accum v) { return _mm512_set1_ps(v); }
+    static inline vec load(const nn_real* p) { return _mm512_loadu_ps(p); }
+    static inline void store(nn_accum* p, vec v) { _mm512_storeu_ps(p, v); }
+    static inline vec add(vec a, vec b) { return _mm512_add_ps(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm512_mul_ps(a, b); }
+    // maskz form: same result, avoids GCC 12's -Wmaybe-uninitialized false positive on _mm512_max_*
+    static inline vec max(vec a, vec b) { return _mm512_maskz_max_ps(0xFFFF, a, b); }
+    static inline vec min(vec a, vec b) { return _mm512_maskz_min_ps(0xFFFF, a, b); }
+    static inline vec load_accum(const nn_accum* p) { return _mm512_loadu_ps(p); }
+    static inline void store_real(nn_real* p, vec v) { _mm512_storeu_ps(p, v); }
+    static inline vec zero_nan(vec v) { return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(v, v, _CMP_ORD_Q), v); }
+};
+#else
+struct Ops {
+    typedef __m512d vec;
+    static const int WIDTH = 8;
+    static inline vec zero() { return _mm512_setzero_pd(); }
+    static inline vec set1(nn_accum v) { return _mm512_set1_pd(v); }
+#ifdef TETRIS_NN_FLOAT32
+    static inline vec load(const nn_real* p) { return _mm512_maskz_cvtps_pd(0xFF, _mm256_loadu_ps(p)); }  // float weights, double sums
+#else
+    static inline vec load(const nn_real* p) { return _mm512_loadu_pd(p); }
+#endif
+    static inline void store(nn_accum* p, vec v) { _mm512_storeu_pd(p, v); }
+    static inline vec add(vec a, vec b) { return _mm512_add_pd(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm512_mul_pd(a, b); }
+    static inline vec max(vec a, vec b) { return _mm512_maskz_max_pd(0xFF, a, b); }
+    static inline vec min(vec a, vec b) { return _mm512_maskz_min_pd(0xFF, a, b); }
+    static inline vec load_accum(const nn_accum* p) { return _mm512_loadu_pd(p); }
+#ifdef TETRIS_NN_FLOAT32
+    static inline void store_real(nn_real* p, vec v) { _mm256_storeu_ps(p, _mm512_maskz_cvtpd_ps(0xFF, v)); }
+#else
+    static inline void store_real(nn_real* p, vec v) { _mm512_storeu_pd(p, v); }
+#endif
+    static inline vec zero_nan(vec v) { return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(v, v, _CMP_ORD_Q), v); }
+};
+#endif
+
+// Quantized forward pass: int32 sums from int16 pair products (vpmaddwd, AVX-512BW), float output layer
+struct QOps {
+    typedef __m512i ivec;
+    typedef __m512 fvec;
+    static const int WIDTH = 16;
+    static inline ivec load_i32(const int32_t* p) { return _mm512_loadu_si512(p); }
+    static inline ivec load_i16(const int16_t* p) { return _mm512_loadu_si512(p); }
+    static inline ivec set1_i32(int32_t v) { return _mm512_set1_epi32(v); }
+    static inline ivec madd_i16(ivec a, ivec b) { return _mm512_madd_epi16(a, b); }
+    static inline ivec add_i32(ivec a, ivec b) { return _mm512_add_epi32(a, b); }
+    static inline fvec to_float(ivec v) { return _mm512_maskz_cvtepi32_ps(0xFFFF, v); }
+    static inline fvec fzero() { return _mm512_setzero_ps(); }
+    static inline fvec fset1(float v) { return _mm512_set1_ps(v); }
+    static inline fvec fload(const float* p) { return _mm512_loadu_ps(p); }
+    static inline void fstore(float* p, fvec v) { _mm512_storeu_ps(p, v); }
+    static inline fvec fadd(fvec a, fvec b) { return _mm512_add_ps(a, b); }
+    static inline fvec fmul(fvec a, fvec b) { return _mm512_mul_ps(a, b); }
+    static inline fvec fmax(fvec a, fvec b) { return _mm512_maskz_max_ps(0xFFFF, a, b); }
+};
+
+#include "nn_kernels_impl.h"
+
+} // namespace
+
+static_assert(NN_SHAPE_COUNT == 3, "add the new shape to the kernel table");
+extern const NNKernels nn_kernels_avx512[NN_SHAPE_COUNT] = {
+    NN_SIMD_KERNELS("avx512", 0),
+    NN_SIMD_KERNELS("avx512", 1),
+    NN_SIMD_KERNELS("avx512", 2)
+};
+
+#endif // __x86_64__
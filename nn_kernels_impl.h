@@ -0,0 +1,219 @@
+// Shared body of the SIMD kernels. Each instruction-set translation unit
+// defines an Ops struct (vector type, lane count, load/store/arithmetic) and a
+// QOps struct (int32 lanes and float lanes of the same width, for the quantized
+// forward pass), and then
+// includes this file inside an anonymous namespace, so the instantiations stay
+// local to the unit that was compiled with the matching -m flags.
+//
+// Lanes run over hidden units, so every hidden sum is accumulated in the same
+// input order as the scalar kernel (no FMA: these units build with
+// -ffp-contract=off), which keeps the results bit-identical to nn_kernels.cpp.
+// IN and HID are the layer sizes of one NN_HIDDEN_SIZES entry; with constant trip
+// counts the compiler unrolls the group loops and keeps the sums in registers.
+
+template <class Ops, int IN, int HID>
+inline nn_accum forwardSimd(const NetworkView& net, const nn_real* input, nn_accum* pre_activation) {
+    static_assert(HID % NN_OUTPUT_LANES == 0, "hidden size must be a multiple of NN_OUTPUT_LANES");
+    typedef typename Ops::vec vec;
+    const int W = Ops::WIDTH;
+    const int GROUPS = NN_OUTPUT_LANES / W;
+    const int H = HID;
+    const vec leak = Ops::set1(nn_accum(0.2));
+    
+    vec partial[GROUPS];
+    for (int g = 0; g < GROUPS; g++) {
+        partial[g] = Ops::zero();
+    }
+    
+    for (int base = 0; base < H; base += NN_OUTPUT_LANES) {
+        vec sum[GROUPS];
+        for (int g = 0; g < GROUPS; g++) {
+            sum[g] = Ops::load(net.bias1 + base + g * W);
+        }
+        const nn_real* w = net.weights1 + base;
+#pragma GCC unroll 32  // Unrolls the whole input loop (IN = 27)
+        for (int j = 0; j < IN; j++, w += H) {
+            vec x = Ops::set1(nn_accum(input[j]));
+            for (int g = 0; g < GROUPS; g++) {
+                sum[g] = Ops::add(sum[g], Ops::mul(x, Ops::load(w + g * W)));
+            }
+        }
+        for (int g = 0; g < GROUPS; g++) {
+            if (pre_activation) Ops::store(pre_activation + base + g * W, sum[g]);
+            vec hidden = Ops::max(Ops::mul(leak, sum[g]), sum[g]);  // Fused leaky ReLU
+            partial[g] = Ops::add(partial[g], Ops::mul(hidden, Ops::load(net.weights2 + base + g * W)));
+        }
+    }
+    
+    nn_accum lanes[NN_OUTPUT_LANES];
+    for (int g = 0; g < GROUPS; g++) {
+        Ops::store(lanes + g * W, partial[g]);
+    }
+    nn_accum output = net.bias2;
+    for (int k = 0; k < NN_OUTPUT_LANES; k++) {
+        output += lanes[k];
+    }
+    return output;
+}
+
+template <class Ops, int IN, int HID>
+void forwardBatchSimd(const NetworkView& net, const nn_real* inputs, int count,
+                      nn_accum* outputs, nn_accum* pre_activations) {
+    // Even the largest shape (27x128) fits in L1, so per-sample passes keep the weights hot
+    for (int n = 0; n < count; n++) {
+        outputs[n] = forwardSimd<Ops, IN, HID>(net, inputs + n * IN,
+                                               pre_activations ? pre_activations + n * HID : nullptr);
+    }
+}
+
+template <class Ops, int HID>
+nn_accum forwardDeltaSimd(const NetworkView& net, const nn_accum* base_pre_activation,
+                          const int* changed, const nn_accum* delta, int change_count) {
+    typedef typename Ops::vec vec;
+    const int W = Ops::WIDTH;
+    const int GROUPS = NN_OUTPUT_LANES / W;
+    const vec leak = Ops::set1(nn_accum(0.2));
+    
+    vec partial[GROUPS];
+    for (int g = 0; g < GROUPS; g++) {
+        partial[g] = Ops::zero();
+    }
+    
+    for (int base = 0; base < HID; base += NN_OUTPUT_LANES) {
+        vec sum[GROUPS];
+        for (int g = 0; g < GROUPS; g++) {
+            sum[g] = Ops::load_accum(base_pre_activation + base + g * W);
+        }
+        for (int c = 0; c < change_count; c++) {
+            vec x = Ops::set1(delta[c]);
+            const nn_real* w = net.weights1 + changed[c] * HID + base;
+            for (int g = 0; g < GROUPS; g++) {
+                sum[g] = Ops::add(sum[g], Ops::mul(x, Ops::load(w + g * W)));
+            }
+        }
+        for (int g = 0; g < GROUPS; g++) {
+            vec hidden = Ops::max(Ops::mul(leak, sum[g]), sum[g]);  // Fused leaky ReLU
+            partial[g] = Ops::add(partial[g], Ops::mul(hidden, Ops::load(net.weights2 + base + g * W)));
+        }
+    }
+    
+    nn_accum lanes[NN_OUTPUT_LANES];
+    for (int g = 0; g < GROUPS; g++) {
+        Ops::store(lanes + g * W, partial[g]);
+    }
+    nn_accum output = net.bias2;
+    for (int k = 0; k < NN_OUTPUT_LANES; k++) {
+        output += lanes[k];
+    }
+    return output;
+}
+
+template <class QOps, int HID>
+float forwardQuantizedSimd(const QuantizedView& net, const int16_t* input) {
+    typedef typename QOps::ivec ivec;
+    typedef typename QOps::fvec fvec;
+    const int W = QOps::WIDTH;
+    const int GROUPS = NN_OUTPUT_LANES / W;
+    const fvec leak = QOps::fset1(0.2f);
+    
+    // Each adjacent input pair is broadcast as one int32; the multiply-add then gives
+    // x[2p] * W1[2p][i] + x[2p+1] * W1[2p+1][i] per hidden unit
+    int32_t pairs[NN_INPUT_PAIRS];
+    std::memcpy(pairs, input, sizeof(pairs));
+    
+    fvec partial[GROUPS];
+    for (int g = 0; g < GROUPS; g++) {
+        partial[g] = QOps::fzero();
+    }
+    
+    for (int base = 0; base < HID; base += NN_OUTPUT_LANES) {
+        ivec sum[GROUPS];
+        for (int g = 0; g < GROUPS; g++) {
+            sum[g] = QOps::load_i32(net.bias1 + base + g * W);
+        }
+        const int16_t* w = net.weights1 + base * 2;
+#pragma GCC unroll 16  // Unrolls the whole pair loop (NN_INPUT_PAIRS = 14)
+        for (int p = 0; p < NN_INPUT_PAIRS; p++, w += HID * 2) {
+            ivec x = QOps::set1_i32(pairs[p]);
+            for (int g = 0; g < GROUPS; g++) {
+                sum[g] = QOps::add_i32(sum[g], QOps::madd_i16(x, QOps::load_i16(w + g * W * 2)));
+            }
+        }
+        for (int g = 0; g < GROUPS; g++) {
+            fvec h = QOps::to_float(sum[g]);
+            fvec hidden = QOps::fmax(QOps::fmul(leak, h), h);
+            partial[g] = QOps::fadd(partial[g], QOps::fmul(hidden, QOps::fload(net.weights2 + base + g * W)));
+        }
+    }
+    
+    float lanes[NN_OUTPUT_LANES];
+    for (int g = 0; g < GROUPS; g++) {
+        QOps::fstore(lanes + g * W, partial[g]);
+    }
+    float output = net.bias2;
+    for (int k = 0; k < NN_OUTPUT_LANES; k++) {
+        output += lanes[k];
+    }
+    return output;
+}
+
+template <class Ops, int IN, int HID>
+void accumulateGradientsSimd(const nn_real* input, const nn_accum* delta, nn_accum* grad_weights1) {
+    const int W = Ops::WIDTH;
+    for (int j = 0; j < IN; j++) {
+        if (input[j] == 0) continue;  // One-hot and empty-column features add nothing
+        typename Ops::vec x = Ops::set1(nn_accum(input[j]));
+        nn_accum* row = grad_weights1 + j * HID;
+        for (int i = 0; i < HID; i += W) {
+            Ops::store(row + i, Ops::add(Ops::load_accum(row + i), Ops::mul(Ops::load_accum(delta + i), x)));
+        }
+    }
+}
+
+// Scalar form of one apply_update element, also used for the tail of the SIMD loop.
+// Plain comparisons rather than std::min/max: min(a, b) here is (a < b ? a : b), the
+// same operand order as the vector min/max instructions, so both paths agree bit for bit
+inline nn_real applyUpdateElement(nn_real param, nn_accum grad_sum, const UpdateRule& rule) {
+    nn_accum g = grad_sum * rule.grad_scale;
+    g = (g == g) ? g : nn_accum(0);
+    g = (g < rule.max_gradient) ? g : rule.max_gradient;
+    g = (g > -rule.max_gradient) ? g : -rule.max_gradient;
+    nn_accum w = nn_accum(param) + rule.step * g;
+    w = (w == w) ? w : nn_accum(0);
+    w = (w < rule.limit) ? w : rule.limit;
+    w = (w > -rule.limit) ? w : -rule.limit;
+    return nn_real(w);
+}
+
+template <class Ops>
+void applyUpdateSimd(nn_real* params, const nn_accum* grad_sums, int count, const UpdateRule& rule) {
+    typedef typename Ops::vec vec;
+    const int W = Ops::WIDTH;
+    const vec scale = Ops::set1(rule.grad_scale);
+    const vec step = Ops::set1(rule.step);
+    const vec max_gradient = Ops::set1(rule.max_gradient);
+    const vec min_gradient = Ops::set1(-rule.max_gradient);
+    const vec max_param = Ops::set1(rule.limit);
+    const vec min_param = Ops::set1(-rule.limit);
+    
+    int k = 0;
+    for (; k + W <= count; k += W) {
+        vec g = Ops::zero_nan(Ops::mul(Ops::load_accum(grad_sums + k), scale));
+        g = Ops::max(Ops::min(g, max_gradient), min_gradient);
+        vec w = Ops::zero_nan(Ops::add(Ops::load(params + k), Ops::mul(step, g)));
+        w = Ops::max(Ops::min(w, max_param), min_param);
+        Ops::store_real(params + k, w);
+    }
+    for (; k < count; k++) {
+        params[k] = applyUpdateElement(params[k], grad_sums[k], rule);
+    }
+}
+
+// Kernel table entry for shape index `shape` (see NN_HIDDEN_SIZES)
+#define NN_SIMD_KERNELS(name, shape) \
+    { name, forwardSimd<Ops, NN_INPUT_SIZE, NN_HIDDEN_SIZES[shape]>, \
+      forwardBatchSimd<Ops, NN_INPUT_SIZE, NN_HIDDEN_SIZES[shape]>, \
+      forwardDeltaSimd<Ops, NN_HIDDEN_SIZES[shape]>, \
+      forwardQuantizedSimd<QOps, NN_HIDDEN_SIZES[shape]>, \
+      accumulateGradientsSimd<Ops, NN_INPUT_SIZE, NN_HIDDEN_SIZES[shape]>, \
+      applyUpdateSimd<Ops> }
@@ -0,0 +1,83 @@
+// SSE4.2 network kernels (built with -msse4.2, selected at runtime by nnKernels())
+#include "nn_kernels.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <cstring>
+
+namespace {
+
+#if defined(TETRIS_NN_FLOAT32) && !defined(TETRIS_NN_DOUBLE_ACCUM)
+struct Ops {
+    typedef __m128 vec;
+    static const int WIDTH = 4;
+    static inline vec zero() { return _mm_setzero_ps(); }
+    static inline vec set1(nn_accum v) { return _mm_set1_ps(v); }
+    static inline vec load(const nn_real* p) { return _mm_loadu_ps(p); }
+    static inline void store(nn_accum* p, vec v) { _mm_storeu_ps(p, v); }
+    static inline vec add(vec a, vec b) { return _mm_add_ps(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm_mul_ps(a, b); }
+    static inline vec max(vec a, vec b) { return _mm_max_ps(a, b); }
+    static inline vec min(vec a, vec b) { return _mm_min_ps(a, b); }
+    static inline vec load_accum(const nn_accum* p) { return _mm_loadu_ps(p); }
+    static inline void store_real(nn_real* p, vec v) { _mm_storeu_ps(p, v); }
+    static inline vec zero_nan(vec v) { return _mm_and_ps(v, _mm_cmpord_ps(v, v)); }
+};
+#else
+struct Ops {
+    typedef __m128d vec;
+    static const int WIDTH = 2;
+    static inline vec zero() { return _mm_setzero_pd(); }
+    static inline vec set1(nn_accum v) { return _mm_set1_pd(v); }
+#ifdef TETRIS_NN_FLOAT32
+    static inline vec load(const nn_real* p) { return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)))); }  // float weights, double sums
+#else
+    static inline vec load(const nn_real* p) { return _mm_loadu_pd(p); }
+#endif
+    static inline void store(nn_accum* p, vec v) { _mm_storeu_pd(p, v); }
+    static inline vec add(vec a, vec b) { return _mm_add_pd(a, b); }
+    static inline vec mul(vec a, vec b) { return _mm_mul_pd(a, b); }
+    static inline vec max(vec a, vec b) { return _mm_max_pd(a, b); }
+    static inline vec min(vec a, vec b) { return _mm_min_pd(a, b); }
+    static inline vec load_accum(const nn_accum* p) { return _mm_loadu_pd(p); }
+#ifdef TETRIS_NN_FLOAT32
+    static inline void store_real(nn_real* p, vec v) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_castps_si128(_mm_cvtpd_ps(v))); }
+#else
+    static inline void store_real(nn_real* p, vec v) { _mm_storeu_pd(p, v); }
+#endif
+    static inline vec zero_nan(vec v) { return _mm_and_pd(v, _mm_cmpord_pd(v, v)); }
+};
+#endif
+
+// Quantized forward pass: int32 sums from int16 pair products (pmaddwd), float output layer
+struct QOps {
+    typedef __m128i ivec;
+    typedef __m128 fvec;
+    static const int WIDTH = 4;
+    static inline ivec load_i32(const int32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static inline ivec load_i16(const int16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static inline ivec set1_i32(int32_t v) { return _mm_set1_epi32(v); }
+    static inline ivec madd_i16(ivec a, ivec b) { return _mm_madd_epi16(a, b); }
+    static inline ivec add_i32(ivec a, ivec b) { return _mm_add_epi32(a, b); }
+    static inline fvec to_float(ivec v) { return _mm_cvtepi32_ps(v); }
+    static inline fvec fzero() { return _mm_setzero_ps(); }
+    static inline fvec fset1(float v) { return _mm_set1_ps(v); }
+    static inline fvec fload(const float* p) { return _mm_loadu_ps(p); }
+    static inline void fstore(float* p, fvec v) { _mm_storeu_ps(p, v); }
+    static inline fvec fadd(fvec a, fvec b) { return _mm_add_ps(a, b); }
+    static inline fvec fmul(fvec a, fvec b) { return _mm_mul_ps(a, b); }
+    static inline fvec fmax(fvec a, fvec b) { return _mm_max_ps(a, b); }
+};
+
+#include "nn_kernels_impl.h"
+
+} // namespace
+
+static_assert(NN_SHAPE_COUNT == 3, "add the new shape to the kernel table");
+extern const NNKernels nn_kernels_sse42[NN_SHAPE_COUNT] = {
+    NN_SIMD_KERNELS("sse4.2", 0),
+    NN_SIMD_KERNELS("sse4.2", 1),
+    NN_SIMD_KERNELS("sse4.2", 2)
+};
+
+#endif // __x86_64__
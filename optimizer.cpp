@@ -0,0 +1,181 @@
+#include "optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+static const char* const OPTIMIZER_NAMES[OPTIMIZER_COUNT] = {"sgd", "momentum", "rmsprop", "adam"};
+
+const char* optimizerName(OptimizerType type) {
+    return (type >= 0 && type < OPTIMIZER_COUNT) ? OPTIMIZER_NAMES[type] : "unknown";
+}
+
+bool parseOptimizer(const std::string& name, OptimizerType& type) {
+    for (int t = 0; t < OPTIMIZER_COUNT; t++) {
+        if (name == OPTIMIZER_NAMES[t]) {
+            type = static_cast<OptimizerType>(t);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parameters per group for a network with `hidden_size` hidden units (single output)
+static size_t groupSize(Optimizer::Group group, int hidden_size) {
+    switch (group) {
+        case Optimizer::WEIGHTS1: return size_t(NN_INPUT_SIZE) * hidden_size;
+        case Optimizer::BIAS1:    return hidden_size;
+        case Optimizer::WEIGHTS2: return hidden_size;
+        case Optimizer::BIAS2:    return 1;
+        default:                  return 0;
+    }
+}
+
+Optimizer::Optimizer(OptimizerType t)
+    : type(t), momentum(0.9), beta1(0.9), beta2(0.999), epsilon(1e-8), steps(0) {
+}
+
+void Optimizer::reset(int hidden_size) {
+    steps = 0;
+    bool uses_first = (type == OPTIMIZER_MOMENTUM || type == OPTIMIZER_ADAM);
+    bool uses_second = (type == OPTIMIZER_RMSPROP || type == OPTIMIZER_ADAM);
+    for (int g = 0; g < GROUP_COUNT; g++) {
+        size_t size = groupSize(static_cast<Group>(g), hidden_size);
+        first_moment[g].assign(uses_first ? size : 0, 0.0);
+        second_moment[g].assign(uses_second ? size : 0, 0.0);
+    }
+}
+
+void Optimizer::select(OptimizerType t, int hidden_size) {
+    if (t == type) return;
+    type = t;
+    reset(hidden_size);
+}
+
+void Optimizer::apply(Group group, nn_real* params, const nn_accum* grad_sums, int count,
+                      const UpdateRule& rule, double learning_rate) {
+    nn_accum* m = first_moment[group].data();
+    nn_accum* v = second_moment[group].data();
+    const nn_accum lr = learning_rate;
+    const nn_accum mu = momentum;
+    const nn_accum b1 = beta1;
+    const nn_accum b2 = beta2;
+    const nn_accum eps = epsilon;
+    // Adam bias correction folded into the step size
+    const nn_accum adam_lr = nn_accum(learning_rate * std::sqrt(1.0 - std::pow(beta2, double(steps))) /
+                                      (1.0 - std::pow(beta1, double(steps))));
+
+    for (int k = 0; k < count; k++) {
+        // Same gradient clipping as the SGD kernel: mean of the batch, +/-max_gradient, NaN -> 0
+        nn_accum g = grad_sums[k] * rule.grad_scale;
+        if (std::isnan(g)) g = 0.0;
+        g = std::max(-rule.max_gradient, std::min(rule.max_gradient, g));
+
+        nn_accum delta;
+        switch (type) {
+            case OPTIMIZER_MOMENTUM:
+                m[k] = mu * m[k] + g;
+                delta = rule.step * m[k];
+                break;
+            case OPTIMIZER_RMSPROP:
+                v[k] = b2 * v[k] + (1 - b2) * g * g;
+                delta = lr * g / (std::sqrt(v[k]) + eps);
+                break;
+            case OPTIMIZER_ADAM:
+                m[k] = b1 * m[k] + (1 - b1) * g;
+                v[k] = b2 * v[k] + (1 - b2) * g * g;
+                delta = adam_lr * m[k] / (std::sqrt(v[k]) + eps);
+                break;
+            default:
+                delta = rule.step * g;
+                break;
+        }
+
+        // Same parameter clamp and NaN repair as the SGD kernel
+        nn_accum w = nn_accum(params[k]) + delta;
+        if (std::isnan(w)) w = 0.0;
+        params[k] = nn_real(std::max(-rule.limit, std::min(rule.limit, w)));
+    }
+}
+
+void Optimizer::save(std::ostream& out) const {
+    out << "# Optimizer State\n";
+    out << "OPTIMIZER " << optimizerName(type) << "\n";
+    out << "STEPS " << steps << "\n";
+    std::streamsize old_precision = out.precision(std::numeric_limits<nn_accum>::max_digits10);
+    for (int g = 0; g < GROUP_COUNT; g++) {
+        if (!first_moment[g].empty()) {
+            out << "FIRST_MOMENT " << g;
+            for (nn_accum value : first_moment[g]) out << " " << value;
+            out << "\n";
+        }
+        if (!second_moment[g].empty()) {
+            out << "SECOND_MOMENT " << g;
+            for (nn_accum value : second_moment[g]) out << " " << value;
+            out << "\n";
+        }
+    }
+    out.precision(old_precision);
+}
+
+bool Optimizer::load(const std::string& filename, int hidden_size) {
+    std::ifstream file(filename);
+    if (!file.is_open()) return false;
+
+    std::string line;
+    bool in_section = false;
+    bool found = false;
+    int moment_lines = 0;
+    Optimizer loaded;
+    while (std::getline(file, line)) {
+        if (line.find("# Optimizer State") != std::string::npos) {
+            in_section = true;
+            continue;
+        }
+        if (!in_section) continue;
+        if (!line.empty() && line[0] == '#') break;  // Next section
+
+        std::istringstream iss(line);
+        std::string key;
+        iss >> key;
+        if (key == "OPTIMIZER") {
+            std::string name;
+            iss >> name;
+            if (!parseOptimizer(name, loaded.type)) return false;
+            loaded.reset(hidden_size);
+            found = true;
+        } else if (found && key == "STEPS") {
+            iss >> loaded.steps;
+        } else if (found && (key == "FIRST_MOMENT" || key == "SECOND_MOMENT")) {
+            int g = -1;
+            iss >> g;
+            if (g < 0 || g >= GROUP_COUNT) return false;
+            std::vector<nn_accum>& buffer = (key == "FIRST_MOMENT") ? loaded.first_moment[g] : loaded.second_moment[g];
+            for (size_t k = 0; k < buffer.size(); k++) {
+                double value;
+                if (!(iss >> value)) return false;  // Truncated or shape mismatch
+                buffer[k] = nn_accum(value);
+            }
+            double extra;
+            if (buffer.empty() || iss >> extra) return false;  // Not this rule's, or state of a larger shape
+            moment_lines++;
+        }
+    }
+    if (!found) return false;
+    int expected_lines = 0;
+    for (int g = 0; g < GROUP_COUNT; g++) {
+        expected_lines += !loaded.first_moment[g].empty() + !loaded.second_moment[g].empty();
+    }
+    if (moment_lines != expected_lines) return false;  // File cut short between lines
+
+    // Keep this optimizer's hyperparameters; only the rule and its state come from the file
+    type = loaded.type;
+    steps = loaded.steps;
+    for (int g = 0; g < GROUP_COUNT; g++) {
+        first_moment[g].swap(loaded.first_moment[g]);
+        second_moment[g].swap(loaded.second_moment[g]);
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "nn_kernels.h"
+
+enum OptimizerType {
+    OPTIMIZER_SGD,       // Plain clipped SGD (the apply_update kernel)
+    OPTIMIZER_MOMENTUM,  // SGD with heavy-ball momentum
+    OPTIMIZER_RMSPROP,
+    OPTIMIZER_ADAM,
+    OPTIMIZER_COUNT
+};
+
+const char* optimizerName(OptimizerType type);
+bool parseOptimizer(const std::string& name, OptimizerType& type);  // sgd|momentum|rmsprop|adam
+
+// Update rule under NeuralNetwork::trainBatch. Moment buffers mirror the network's flat
+// parameter arrays (one per group, same layout and length as the used part of the group).
+// Gradients arrive as batch sums and are clipped at the mean exactly like plain SGD.
+class Optimizer {
+public:
+    // Parameter groups, in model file order
+    enum Group {
+        WEIGHTS1,
+        BIAS1,
+        WEIGHTS2,
+        BIAS2,
+        GROUP_COUNT
+    };
+
+    OptimizerType type;
+    double momentum;      // Momentum coefficient (OPTIMIZER_MOMENTUM)
+    double beta1;         // Adam first-moment decay
+    double beta2;         // Adam / RMSProp second-moment decay
+    double epsilon;       // Denominator guard for RMSProp / Adam
+    long long steps;      // Batches applied since the state was reset (Adam bias correction)
+    std::vector<nn_accum> first_moment[GROUP_COUNT];   // Velocity (momentum) or m (Adam)
+    std::vector<nn_accum> second_moment[GROUP_COUNT];  // Mean squared gradient (RMSProp, Adam)
+
+    explicit Optimizer(OptimizerType t = OPTIMIZER_SGD);
+
+    // Size and zero the moment buffers for a network with `hidden_size` hidden units
+    void reset(int hidden_size);
+    // Switch update rule; the state is reset when the type changes
+    void select(OptimizerType t, int hidden_size);
+
+    // Called once per batch before the groups are applied
+    void beginStep() { steps++; }
+    // Apply one batch to a parameter group. rule.step is learning_rate * samples (the SGD
+    // step); the adaptive rules (RMSProp, Adam) normalise the step themselves and use
+    // learning_rate alone
+    void apply(Group group, nn_real* params, const nn_accum* grad_sums, int count,
+               const UpdateRule& rule, double learning_rate);
+
+    // "# Optimizer State" section of the model file
+    void save(std::ostream& out) const;
+    // Restore the section from a model file; false (state reset) if missing or mismatched
+    bool load(const std::string& filename, int hidden_size);
+};
+
+#endif // OPTIMIZER_H
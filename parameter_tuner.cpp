@@ -10,7 +10,8 @@ ParameterTuner::ParameterTuner()
     : current_iteration(0),
       last_evaluation_iteration(0),
       current_param_set_index(0),
-      auto_tuning_enabled(true) {
+      auto_tuning_enabled(true),
+      tune_batch_size(true) {
     
     // Define parameter sets to test (grid search approach)
     // Format: (learning_rate, gamma, epsilon_decay, epsilon_min, batch_size)
@@ -198,9 +199,9 @@ void ParameterTuner::applyParameters(ParameterSet& params, RLAgent& agent) {
     agent.gamma = params.gamma;
     agent.epsilon_decay = params.epsilon_decay;
     agent.epsilon_min = params.epsilon_min;
-    
-    // Note: batch_size is a static const, so we can't change it easily
-    // But we can log it for reference
+    if (tune_batch_size) {
+        agent.setBatchSize(params.batch_size);
+    }
 }
 
 std::string ParameterTuner::generateReport() {
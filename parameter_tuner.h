@@ -49,6 +49,7 @@ public:
     std::vector<ParameterSet> parameter_sets;  // Different parameter combinations to try
     int current_param_set_index;
     bool auto_tuning_enabled;
+    bool tune_batch_size;  // Apply each set's batch_size (off when the batch size was chosen explicitly)
     
     ParameterTuner();
     
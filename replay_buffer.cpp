@@ -0,0 +1,699 @@
+#include "replay_buffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void PackedState::clear() {
+    std::memset(this, 0, sizeof(*this));
+    current_piece = -1;
+    next_piece = -1;
+}
+
+void PackedState::setCell(int x, int y) {
+    const int bit = ROWS * x + y;
+    cells[bit / 8] |= uint8_t(1u << (bit % 8));
+}
+
+static_assert(NN_INPUT_SIZE == PackedState::COLUMNS + 3 + 2 * 7, "decodeState writes the 27-feature layout");
+
+void decodeState(const PackedState& packed, nn_real* features) {
+    // Same normalisation (in double) as the feature extraction this replaced
+    int heights[PackedState::COLUMNS];
+    int max_height = 0;
+    int total_holes = 0;
+    for (int x = 0; x < PackedState::COLUMNS; x++) {
+        uint32_t column = packed.column(x);
+        // Topmost filled row = trailing zeros; every empty cell below it is a hole
+        int height = column ? PackedState::ROWS - __builtin_ctz(column) : 0;
+        total_holes += height - __builtin_popcount(column);
+        heights[x] = height;
+        max_height = std::max(max_height, height);
+        features[x] = height / 20.0;
+    }
+    int total_bumpiness = 0;
+    for (int x = 0; x + 1 < PackedState::COLUMNS; x++) {
+        total_bumpiness += std::abs(heights[x] - heights[x + 1]);
+    }
+    features[10] = max_height / 20.0;
+    features[11] = std::min(1.0, total_holes / 200.0);
+    features[12] = std::min(1.0, total_bumpiness / 180.0);
+    for (int i = 0; i < 7; i++) {
+        features[13 + i] = (packed.current_piece == i) ? 1.0 : 0.0;
+        features[20 + i] = (packed.next_piece == i) ? 1.0 : 0.0;
+    }
+}
+
+int mirrorPiece(int type) {
+    // I O T S Z J L
+    static const int MIRRORED[7] = {0, 1, 2, 4, 3, 6, 5};
+    return (type >= 0 && type < 7) ? MIRRORED[type] : type;
+}
+
+PackedState mirrorState(const PackedState& packed) {
+    PackedState mirrored;
+    mirrored.clear();
+    for (int x = 0; x < PackedState::COLUMNS; x++) {
+        uint32_t column = packed.column(x);
+        while (column != 0) {
+            mirrored.setCell(PackedState::COLUMNS - 1 - x, __builtin_ctz(column));
+            column &= column - 1;
+        }
+    }
+    mirrored.current_piece = int8_t(mirrorPiece(packed.current_piece));
+    mirrored.next_piece = int8_t(mirrorPiece(packed.next_piece));
+    return mirrored;
+}
+
+void mirrorFeatures(nn_real* features) {
+    // Heights reversed; max height, holes and bumpiness do not depend on the direction
+    std::reverse(features, features + PackedState::COLUMNS);
+    for (int offset : {13, 20}) {  // Current and next piece one-hot
+        std::swap(features[offset + 3], features[offset + 4]);
+        std::swap(features[offset + 5], features[offset + 6]);
+    }
+}
+
+void SumTree::reset(size_t size) {
+    leaves = 1;
+    while (leaves < size) leaves *= 2;
+    nodes.assign(2 * leaves, 0.0);
+}
+
+void SumTree::set(size_t leaf, double value) {
+    size_t node = leaves + leaf;
+    nodes[node] = value;
+    for (node /= 2; node >= 1; node /= 2) {
+        nodes[node] = nodes[2 * node] + nodes[2 * node + 1];
+    }
+}
+
+size_t SumTree::find(double mass) const {
+    size_t node = 1;
+    while (node < leaves) {
+        // Rounding can leave mass just past the left sum; never step into an empty subtree
+        if (mass < nodes[2 * node] || nodes[2 * node + 1] <= 0.0) {
+            node = 2 * node;
+        } else {
+            mass -= nodes[2 * node];
+            node = 2 * node + 1;
+        }
+    }
+    return node - leaves;
+}
+
+ReplayBuffer::ReplayBuffer(size_t capacity)
+    : mapping(nullptr), mapping_size(0), file_descriptor(-1), read_only(false), header(nullptr), slots(0),
+      states(nullptr), next_states(nullptr), rewards(nullptr), action_rotations(nullptr), action_xs(nullptr),
+      dones(nullptr), max_priority(1.0), deduplicate(false), head(0), count(0) {
+    reset(capacity);
+}
+
+ReplayBuffer::~ReplayBuffer() {
+    closeFile();
+}
+
+static size_t alignBlock(size_t bytes) {
+    return (bytes + 63) / 64 * 64;
+}
+
+// First 64-byte boundary in a heap arena allocated 63 bytes larger than the storage (like a
+// mapping, so no 32-byte state row straddles two cache lines)
+static uint8_t* alignedBase(std::vector<uint8_t>& arena) {
+    return reinterpret_cast<uint8_t*>(alignBlock(reinterpret_cast<uintptr_t>(arena.data())));
+}
+
+size_t ReplayBuffer::storageSize(size_t capacity) {
+    return 2 * alignBlock(capacity * sizeof(PackedState)) + alignBlock(capacity * sizeof(float)) +
+           3 * alignBlock(capacity);
+}
+
+void ReplayBuffer::layout(uint8_t* base, size_t capacity) {
+    slots = capacity;
+    states = reinterpret_cast<PackedState*>(base);
+    base += alignBlock(capacity * sizeof(PackedState));
+    next_states = reinterpret_cast<PackedState*>(base);
+    base += alignBlock(capacity * sizeof(PackedState));
+    rewards = reinterpret_cast<float*>(base);
+    base += alignBlock(capacity * sizeof(float));
+    action_rotations = reinterpret_cast<int8_t*>(base);
+    base += alignBlock(capacity);
+    action_xs = reinterpret_cast<int8_t*>(base);
+    base += alignBlock(capacity);
+    dones = base;
+}
+
+void ReplayBuffer::reset(size_t capacity) {
+    closeFile();
+    arena.assign(storageSize(capacity) + 63, 0);  // All-zero rows are valid (empty boards)
+    layout(alignedBase(arena), capacity);
+    head = 0;
+    count = 0;
+    rebuildIndex();
+}
+
+bool ReplayBuffer::resize(size_t new_capacity) {
+    if (mapped()) return false;
+    const size_t kept = std::min(count, new_capacity);
+    const size_t first = count - kept;  // Age of the oldest transition kept
+    const bool had_priorities = weighted();
+    std::vector<double> kept_priorities;
+    std::vector<uint32_t> kept_counts;
+    for (size_t age = first; age < count; age++) {
+        if (had_priorities) kept_priorities.push_back(priority(slot(age)));
+        kept_counts.push_back(counts[slot(age)]);
+    }
+    const double kept_max_priority = max_priority;
+    
+    // The old arrays stay valid in old_arena while the kept rows are copied out in age order
+    std::vector<uint8_t> old_arena;
+    old_arena.swap(arena);
+    const PackedState* old_states = states;
+    const PackedState* old_next_states = next_states;
+    const float* old_rewards = rewards;
+    const int8_t* old_action_rotations = action_rotations;
+    const int8_t* old_action_xs = action_xs;
+    const uint8_t* old_dones = dones;
+    const size_t old_head = head;
+    const size_t old_capacity = slots;
+    
+    arena.assign(storageSize(new_capacity) + 63, 0);
+    layout(alignedBase(arena), new_capacity);
+    for (size_t k = 0; k < kept; k++) {
+        const size_t from = (old_head + first + k) % old_capacity;
+        states[k] = old_states[from];
+        next_states[k] = old_next_states[from];
+        rewards[k] = old_rewards[from];
+        action_rotations[k] = old_action_rotations[from];
+        action_xs[k] = old_action_xs[from];
+        dones[k] = old_dones[from];
+    }
+    head = 0;
+    count = kept;
+    rebuildIndex();  // Counts and priorities restart at 1, then get their old values back
+    for (size_t k = 0; k < kept; k++) {
+        pool_transitions[kind(k)] += kept_counts[k] - 1;
+        counts[k] = kept_counts[k];
+        if (had_priorities) setPriority(k, kept_priorities[k]);
+    }
+    if (had_priorities) max_priority = kept_max_priority;
+    return true;
+}
+
+size_t ReplayBuffer::memoryFor(size_t capacity, bool prioritized, bool deduplicated) {
+    // Both pools reserve room for every slot (see rebuildIndex), plus the position and count of each slot
+    size_t bytes = storageSize(capacity) + 63 + 4 * capacity * sizeof(uint32_t);
+    if (deduplicated) {
+        bytes += capacity * 48;  // Hash node (key, slot, link, allocation overhead) and bucket, roughly
+    }
+    if (prioritized) {
+        size_t leaves = 1;
+        while (leaves < capacity) leaves *= 2;
+        bytes += 2 * 2 * leaves * sizeof(double);  // Two trees of 2 * leaves nodes
+    }
+    return bytes;
+}
+
+void ReplayBuffer::closeFile() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        header = nullptr;
+    }
+    if (file_descriptor >= 0) {
+        close(file_descriptor);  // Releases the write lock
+        file_descriptor = -1;
+    }
+    read_only = false;
+}
+
+bool ReplayBuffer::openFile(const std::string& path, size_t capacity, bool read_only_file, std::string& error) {
+    int fd = open(path.c_str(), read_only_file ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+    if (fd < 0) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    // One writer per file (readers do not lock and see the file as of their open)
+    if (!read_only_file && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        error = path + ": already open for writing by another process";
+        close(fd);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = path + ": " + std::strerror(errno);
+        close(fd);
+        return false;
+    }
+    
+    FileHeader expected;
+    std::memset(&expected, 0, sizeof(expected));
+    std::memcpy(expected.magic, "TTRREPLY", sizeof(expected.magic));
+    expected.version = FILE_VERSION;
+    expected.record_size = sizeof(PackedState);
+    size_t file_capacity = capacity;
+    if (info.st_size == 0) {
+        // New file: header, then zero-filled (empty) rows
+        if (read_only_file) {
+            error = path + ": empty replay file";
+            close(fd);
+            return false;
+        }
+        expected.capacity = capacity;
+        if (ftruncate(fd, off_t(sizeof(FileHeader) + storageSize(capacity))) != 0 ||
+            pwrite(fd, &expected, sizeof(expected), 0) != ssize_t(sizeof(expected))) {
+            error = path + ": " + std::strerror(errno);
+            close(fd);
+            return false;
+        }
+    } else {
+        FileHeader existing;
+        if (pread(fd, &existing, sizeof(existing), 0) != ssize_t(sizeof(existing)) ||
+            std::memcmp(existing.magic, expected.magic, sizeof(expected.magic)) != 0) {
+            error = path + ": not a replay file";
+            close(fd);
+            return false;
+        }
+        if (existing.version != expected.version || existing.record_size != expected.record_size) {
+            error = path + ": replay file format " + std::to_string(existing.version) + " is not supported";
+            close(fd);
+            return false;
+        }
+        file_capacity = size_t(existing.capacity);
+        if (size_t(info.st_size) != sizeof(FileHeader) + storageSize(file_capacity) ||
+            existing.count > existing.capacity || (existing.capacity > 0 && existing.head >= existing.capacity)) {
+            error = path + ": truncated or corrupt replay file";
+            close(fd);
+            return false;
+        }
+    }
+    
+    size_t size = sizeof(FileHeader) + storageSize(file_capacity);
+    void* map = mmap(nullptr, size, read_only_file ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        error = path + ": " + std::strerror(errno);
+        close(fd);
+        return false;
+    }
+    
+    closeFile();
+    arena.clear();
+    arena.shrink_to_fit();
+    mapping = map;
+    mapping_size = size;
+    file_descriptor = fd;
+    read_only = read_only_file;
+    header = static_cast<FileHeader*>(map);
+    layout(static_cast<uint8_t*>(map) + sizeof(FileHeader), file_capacity);
+    head = size_t(header->head);
+    count = size_t(header->count);
+    rebuildIndex();
+    return true;
+}
+
+void ReplayBuffer::rebuildIndex() {
+    pool_position.assign(slots, 0);
+    for (std::vector<uint32_t>& pool : pools) {
+        pool.clear();
+        pool.reserve(slots);
+    }
+    counts.assign(slots, 1);
+    dedup_index.clear();
+    for (size_t age = 0; age < count; age++) {
+        size_t row = slot(age);
+        pool_position[row] = uint32_t(pools[kind(row)].size());
+        pools[kind(row)].push_back(uint32_t(row));
+        if (deduplicate) dedup_index[transitionKey(row)] = uint32_t(row);
+    }
+    pool_transitions[0] = pools[0].size();
+    pool_transitions[1] = pools[1].size();
+    if (weighted()) enablePriorities();
+}
+
+void ReplayBuffer::enablePriorities() {
+    max_priority = 1.0;
+    for (int kind = 0; kind < 2; kind++) {
+        priority_trees[kind].reset(capacity());
+        for (uint32_t slot : pools[kind]) priority_trees[kind].set(slot, counts[slot]);
+    }
+}
+
+void ReplayBuffer::setPriority(size_t slot, double priority) {
+    priority_trees[kind(slot)].set(slot, priority * counts[slot]);
+    max_priority = std::max(max_priority, priority);
+}
+
+void ReplayBuffer::enableDeduplication() {
+    if (deduplicate) return;
+    deduplicate = true;
+    dedup_index.reserve(capacity());
+    for (size_t age = 0; age < count; age++) {
+        dedup_index[transitionKey(slot(age))] = uint32_t(slot(age));
+    }
+    if (!weighted()) enablePriorities();  // Sampling by count needs the trees
+}
+
+uint64_t ReplayBuffer::transitionKey(const PackedState& state, int action_rotation, int action_x, float reward,
+                                     const PackedState& next_state, bool done) {
+    // Multiply-xorshift over the 8-byte words of the transition
+    uint64_t words[9];
+    std::memcpy(words, &state, sizeof(PackedState));
+    std::memcpy(words + 4, &next_state, sizeof(PackedState));
+    uint32_t reward_bits;
+    std::memcpy(&reward_bits, &reward, sizeof(reward_bits));
+    words[8] = uint64_t(reward_bits) << 32 | uint64_t(uint8_t(action_rotation)) << 16 |
+               uint64_t(uint8_t(action_x)) << 8 | (done ? 1u : 0u);
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+    for (uint64_t word : words) {
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
+uint64_t ReplayBuffer::transitionKey(size_t slot) const {
+    return transitionKey(states[slot], action_rotations[slot], action_xs[slot], rewards[slot], next_states[slot],
+                         dones[slot] != 0);
+}
+
+bool ReplayBuffer::sameTransition(size_t slot, const PackedState& state, int action_rotation, int action_x,
+                                  float reward, const PackedState& next_state, bool done) const {
+    return std::memcmp(&states[slot], &state, sizeof(PackedState)) == 0 &&
+           std::memcmp(&next_states[slot], &next_state, sizeof(PackedState)) == 0 &&
+           rewards[slot] == reward && action_rotations[slot] == int8_t(action_rotation) &&
+           action_xs[slot] == int8_t(action_x) && (dones[slot] != 0) == done;
+}
+
+void ReplayBuffer::clear() {
+    if (read_only) return;
+    head = 0;
+    count = 0;
+    if (header != nullptr) {
+        header->head = 0;
+        header->count = 0;
+    }
+    rebuildIndex();
+}
+
+void ReplayBuffer::push(const PackedState& state, int action_rotation, int action_x, double reward,
+                        const PackedState& next_state, bool done) {
+    if (capacity() == 0 || read_only) return;
+    uint64_t key = 0;
+    if (deduplicate) {
+        // A copy of a stored transition only raises that entry's count (and sampling weight)
+        key = transitionKey(state, action_rotation, action_x, float(reward), next_state, done);
+        std::unordered_map<uint64_t, uint32_t>::const_iterator found = dedup_index.find(key);
+        if (found != dedup_index.end() &&
+            sameTransition(found->second, state, action_rotation, action_x, float(reward), next_state, done)) {
+            const size_t row = found->second;
+            const double row_priority = weighted() ? priority(row) : 1.0;
+            counts[row]++;
+            pool_transitions[kind(row)]++;
+            if (weighted()) priority_trees[kind(row)].set(row, row_priority * counts[row]);
+            return;
+        }
+    }
+    size_t row;
+    if (full()) {
+        row = head;  // Overwrite the oldest
+        head = (head + 1) % capacity();
+        pool_transitions[kind(row)] -= counts[row];
+        if (deduplicate) {
+            std::unordered_map<uint64_t, uint32_t>::iterator old = dedup_index.find(transitionKey(row));
+            if (old != dedup_index.end() && old->second == row) dedup_index.erase(old);
+        }
+        // Swap-remove it from its pool
+        std::vector<uint32_t>& pool = pools[kind(row)];
+        uint32_t moved = pool.back();
+        pool[pool_position[row]] = moved;
+        pool_position[moved] = pool_position[row];
+        pool.pop_back();
+    } else {
+        row = slot(count);
+        count++;
+    }
+    states[row] = state;
+    next_states[row] = next_state;
+    rewards[row] = float(reward);
+    action_rotations[row] = int8_t(action_rotation);
+    action_xs[row] = int8_t(action_x);
+    dones[row] = done ? 1 : 0;
+    pool_position[row] = uint32_t(pools[kind(row)].size());
+    pools[kind(row)].push_back(uint32_t(row));
+    counts[row] = 1;
+    pool_transitions[kind(row)]++;
+    if (deduplicate) dedup_index[key] = uint32_t(row);
+    if (weighted()) {
+        priority_trees[1 - kind(row)].set(row, 0.0);
+        priority_trees[kind(row)].set(row, max_priority);
+    }
+    if (header != nullptr) {
+        // The row is written before the counters that cover it
+        header->head = head;
+        header->count = count;
+    }
+}
+
+// Archive record: flags (bit 0 = done), rotation, x, reward, then the state and the XOR of
+// the next state with it, each as a 32-bit mask of its non-zero bytes followed by those bytes
+
+static void encodeBytes(const uint8_t* bytes, std::vector<uint8_t>& out) {
+    static_assert(sizeof(PackedState) == 32, "one mask bit per byte");
+    uint32_t mask = 0;
+    for (int k = 0; k < 32; k++) {
+        if (bytes[k] != 0) mask |= 1u << k;
+    }
+    for (int k = 0; k < 4; k++) out.push_back(uint8_t(mask >> (8 * k)));
+    for (int k = 0; k < 32; k++) {
+        if (bytes[k] != 0) out.push_back(bytes[k]);
+    }
+}
+
+// nullptr when the record runs past `end`
+static const uint8_t* decodeBytes(const uint8_t* in, const uint8_t* end, uint8_t* bytes) {
+    if (end - in < 4) return nullptr;
+    uint32_t mask = uint32_t(in[0]) | uint32_t(in[1]) << 8 | uint32_t(in[2]) << 16 | uint32_t(in[3]) << 24;
+    in += 4;
+    if (end - in < __builtin_popcount(mask)) return nullptr;
+    for (int k = 0; k < 32; k++) {
+        bytes[k] = (mask >> k & 1u) ? *in++ : 0;
+    }
+    return in;
+}
+
+static uint32_t checksum(const uint8_t* data, size_t bytes) {
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (size_t k = 0; k < bytes; k++) {
+        hash = (hash ^ data[k]) * 16777619u;
+    }
+    return hash;
+}
+
+ReplayArchive::ReplayArchive()
+    : file_descriptor(-1), file_bytes(0), archived(0), pending_transitions(0), window_size(0), window_next(0),
+      read_ahead(-1) {
+}
+
+ReplayArchive::~ReplayArchive() {
+    close();
+}
+
+bool ReplayArchive::open(const std::string& path, std::string& error) {
+    close();
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        error = path + ": already open in another process";
+        ::close(fd);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = path + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    
+    FileHeader expected;
+    std::memset(&expected, 0, sizeof(expected));
+    std::memcpy(expected.magic, "TTRARCHV", sizeof(expected.magic));
+    expected.version = FILE_VERSION;
+    expected.block_transitions = BLOCK_TRANSITIONS;
+    long long size = info.st_size;
+    if (size == 0) {
+        if (pwrite(fd, &expected, sizeof(expected), 0) != ssize_t(sizeof(expected))) {
+            error = path + ": " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        size = sizeof(expected);
+    } else {
+        FileHeader existing;
+        if (pread(fd, &existing, sizeof(existing), 0) != ssize_t(sizeof(existing)) ||
+            std::memcmp(existing.magic, expected.magic, sizeof(expected.magic)) != 0) {
+            error = path + ": not a replay archive";
+            ::close(fd);
+            return false;
+        }
+        if (existing.version != expected.version) {
+            error = path + ": replay archive format " + std::to_string(existing.version) + " is not supported";
+            ::close(fd);
+            return false;
+        }
+    }
+    
+    // Index the blocks (headers only). Blocks are written one after the other, so only the
+    // last one can be torn: check its payload and cut off anything after the last good block
+    const long long header_bytes = sizeof(BlockHeader);
+    std::vector<Block> index;
+    size_t transitions = 0;
+    long long offset = sizeof(FileHeader);
+    BlockHeader block;
+    while (offset + header_bytes <= size &&
+           pread(fd, &block, sizeof(block), offset) == ssize_t(sizeof(block)) &&
+           block.magic == BLOCK_MAGIC && block.transitions > 0 &&
+           offset + header_bytes + block.bytes <= size) {
+        index.push_back(Block{offset + header_bytes, block.transitions, block.bytes, block.checksum});
+        transitions += block.transitions;
+        offset += header_bytes + block.bytes;
+    }
+    if (!index.empty()) {
+        const Block& last = index.back();
+        read_buffer.resize(last.bytes);
+        if (pread(fd, read_buffer.data(), last.bytes, last.offset) != ssize_t(last.bytes) ||
+            checksum(read_buffer.data(), last.bytes) != last.checksum) {
+            offset = last.offset - header_bytes;
+            transitions -= last.transitions;
+            index.pop_back();
+        }
+    }
+    if (offset < size && ftruncate(fd, off_t(offset)) != 0) {
+        error = path + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    
+    file_descriptor = fd;
+    file_bytes = offset;
+    blocks.swap(index);
+    archived = transitions;
+    return true;
+}
+
+void ReplayArchive::close() {
+    if (file_descriptor < 0) return;
+    flush();
+    ::close(file_descriptor);  // Releases the lock
+    file_descriptor = -1;
+    file_bytes = 0;
+    blocks.clear();
+    archived = 0;
+    for (std::vector<ArchivedTransition>& block : window) block.clear();
+    window_size = 0;
+    window_next = 0;
+    read_ahead = -1;
+}
+
+void ReplayArchive::append(const ArchivedTransition& transition) {
+    if (file_descriptor < 0) return;
+    pending.push_back(transition.done ? 1 : 0);
+    pending.push_back(uint8_t(transition.action_rotation));
+    pending.push_back(uint8_t(transition.action_x));
+    uint8_t reward[sizeof(float)];
+    std::memcpy(reward, &transition.reward, sizeof(reward));
+    pending.insert(pending.end(), reward, reward + sizeof(reward));
+    const uint8_t* state = reinterpret_cast<const uint8_t*>(&transition.state);
+    const uint8_t* next_state = reinterpret_cast<const uint8_t*>(&transition.next_state);
+    uint8_t difference[sizeof(PackedState)];
+    for (size_t k = 0; k < sizeof(PackedState); k++) {
+        difference[k] = state[k] ^ next_state[k];
+    }
+    encodeBytes(state, pending);
+    encodeBytes(difference, pending);
+    if (++pending_transitions == uint32_t(BLOCK_TRANSITIONS)) flush();
+}
+
+void ReplayArchive::flush() {
+    if (file_descriptor < 0 || pending_transitions == 0) return;
+    BlockHeader header;
+    header.magic = BLOCK_MAGIC;
+    header.transitions = pending_transitions;
+    header.bytes = uint32_t(pending.size());
+    header.checksum = checksum(pending.data(), pending.size());
+    // A failed write (e.g. disk full) loses this block only; the torn end is cut off on the next open
+    if (pwrite(file_descriptor, &header, sizeof(header), off_t(file_bytes)) == ssize_t(sizeof(header)) &&
+        pwrite(file_descriptor, pending.data(), pending.size(), off_t(file_bytes + sizeof(header))) ==
+            ssize_t(pending.size())) {
+        Block written = {file_bytes + long(sizeof(header)), header.transitions, header.bytes, header.checksum};
+        blocks.push_back(written);
+        archived += header.transitions;
+        file_bytes += sizeof(header) + pending.size();
+    }
+    pending.clear();
+    pending_transitions = 0;
+}
+
+bool ReplayArchive::readBlock(size_t block, std::vector<ArchivedTransition>& out) {
+    const Block& info = blocks[block];
+    read_buffer.resize(info.bytes);
+    if (pread(file_descriptor, read_buffer.data(), info.bytes, off_t(info.offset)) != ssize_t(info.bytes) ||
+        checksum(read_buffer.data(), info.bytes) != info.checksum) {
+        return false;
+    }
+    out.resize(info.transitions);
+    const uint8_t* in = read_buffer.data();
+    const uint8_t* end = in + info.bytes;
+    for (ArchivedTransition& transition : out) {
+        if (end - in < 3 + long(sizeof(float))) return false;
+        transition.done = (in[0] & 1) != 0;
+        transition.action_rotation = int8_t(in[1]);
+        transition.action_x = int8_t(in[2]);
+        std::memcpy(&transition.reward, in + 3, sizeof(float));
+        in += 3 + sizeof(float);
+        uint8_t* state = reinterpret_cast<uint8_t*>(&transition.state);
+        uint8_t* next_state = reinterpret_cast<uint8_t*>(&transition.next_state);
+        in = decodeBytes(in, end, state);
+        if (in == nullptr) return false;
+        in = decodeBytes(in, end, next_state);
+        if (in == nullptr) return false;
+        for (size_t k = 0; k < sizeof(PackedState); k++) {
+            next_state[k] ^= state[k];
+        }
+    }
+    return true;
+}
+
+bool ReplayArchive::advance() {
+    if (file_descriptor < 0 || blocks.empty()) return false;
+    if (read_ahead < 0) read_ahead = rand() % blocks.size();
+    std::vector<ArchivedTransition>& slot = window[window_next];
+    if (!readBlock(size_t(read_ahead), slot)) {
+        slot.clear();  // Unreadable block: leave its window slot empty
+    }
+    window_next = (window_next + 1) % WINDOW_BLOCKS;
+    window_size = 0;
+    for (const std::vector<ArchivedTransition>& block : window) window_size += block.size();
+    
+    // Ask the OS to start reading the next block now, so the next advance finds it cached
+    read_ahead = rand() % blocks.size();
+    const Block& next = blocks[size_t(read_ahead)];
+    posix_fadvise(file_descriptor, off_t(next.offset), off_t(next.bytes), POSIX_FADV_WILLNEED);
+    return true;
+}
+
+const ArchivedTransition& ReplayArchive::sample(size_t k) const {
+    int block = 0;
+    while (k >= window[block].size()) {
+        k -= window[block].size();
+        block++;
+    }
+    return window[block][k];
+}
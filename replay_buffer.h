@@ -0,0 +1,310 @@
+#ifndef REPLAY_BUFFER_H
+#define REPLAY_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "nn_kernels.h"
+
+// Compact replay encoding of a game state, 32 bytes: the board's occupancy column by column
+// (20 bits per column, bit y set when row y is filled, row 0 at the top) and the current
+// and next piece (-1 = none, e.g. for afterstates). The network features are rebuilt by
+// decodeState when a batch is sampled, so the feature set can change without invalidating
+// stored experience
+struct PackedState {
+    static const int COLUMNS = 10;
+    static const int ROWS = 20;
+    uint8_t cells[26];      // COLUMNS * ROWS bits, column x from bit ROWS * x (LSB first)
+    int8_t current_piece;
+    int8_t next_piece;
+    uint8_t reserved[4];    // Zero; pads the record to 32 bytes
+
+    void clear();           // Empty board, no pieces
+    void setCell(int x, int y);
+    uint32_t column(int x) const {
+        // Any column lies within 4 bytes starting at its first byte (ROWS * x is a multiple of 4)
+        const int bit = ROWS * x;
+        const uint8_t* p = cells + bit / 8;
+        uint32_t bits = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+        return (bits >> (bit % 8)) & ((1u << ROWS) - 1);
+    }
+};
+static_assert(sizeof(PackedState) == 32, "PackedState must stay 32 bytes");
+
+// The NN_INPUT_SIZE network features of a packed state (layout of RLAgent::extractState):
+// column heights, max height, holes and bumpiness (normalised), then the current and next
+// piece one-hot. Heights and holes come straight from the column bits (count trailing
+// zeros and population count)
+void decodeState(const PackedState& packed, nn_real* features);
+
+// Left-right mirror images. The board is symmetric once S <-> Z and J <-> L are swapped
+// (the other pieces are their own mirror images), so a mirrored transition is as valid as
+// the original. mirrorState reverses the columns; mirrorFeatures is the same map on decoded
+// features, a permutation: decodeState(mirrorState(s)) == mirrorFeatures(decodeState(s)).
+// Both are their own inverse
+int mirrorPiece(int type);  // -1 (no piece) stays -1
+PackedState mirrorState(const PackedState& packed);
+void mirrorFeatures(nn_real* features);
+
+// Binary tree of partial sums over `size` non-negative leaves: set() and find() are
+// O(log n), total() is O(1). Parents are recomputed from their children on every set, so
+// the sums do not drift
+class SumTree {
+public:
+    void reset(size_t size);  // All leaves 0
+    void set(size_t leaf, double value);
+    double get(size_t leaf) const { return nodes[leaves + leaf]; }
+    double total() const { return nodes.empty() ? 0.0 : nodes[1]; }
+    // Leaf whose cumulative range [sum before it, sum including it) contains mass,
+    // for 0 <= mass < total(); never a zero leaf
+    size_t find(double mass) const;
+
+    bool empty() const { return nodes.empty(); }
+
+private:
+    std::vector<double> nodes;  // Heap layout: root at 1, leaf k at leaves + k
+    size_t leaves;              // Power of two >= size
+};
+
+// Experience replay storage: a ring buffer preallocated for `capacity` transitions, kept in
+// structure-of-arrays form. States and next states are arrays of PackedState (32 bytes
+// each, decoded to features at sample time), actions, rewards and done flags are packed
+// arrays: about 80 bytes per transition. Adding is O(1) and overwrites the oldest
+// transition once the buffer is full, so nothing is allocated after construction.
+//
+// The arrays live in one block, on the heap or, with openFile(), in a memory-mapped file
+// (header + the same arrays), so the experience survives restarts: reopening the file
+// resumes with its contents, paged in by the OS as they are sampled. One process at a time
+// may open a file for writing; any number may open it read-only (e.g. for offline training).
+// A reader's count and head are those at its open; rows a writer overwrites afterwards
+// change under it (a reader may see a mix of old and new fields in such a row).
+//
+// Transitions are addressed by age (0 = oldest, size() - 1 = newest); slot(age) maps that
+// to the row in the arrays. The rows are also indexed by kind in two pools, terminal and
+// non-terminal (unordered, swap-remove on overwrite), for stratified sampling in O(1).
+//
+// With enablePriorities() every transition also has a sampling priority (prioritized
+// replay), kept in one sum-tree per pool so each pool can be sampled in proportion to its
+// priorities in O(log n). New transitions get the largest priority seen so far, so each
+// is likely to be replayed at least once before its priority reflects its error.
+//
+// With enableDeduplication() a transition identical to a stored one (same state, action,
+// reward, next state and done flag, looked up by a hash of them) is not stored again: the
+// stored entry's count goes up instead. Entries are then sampled in proportion to count
+// (times priority), so a merged entry stands in for all of its copies; the sum-trees are
+// turned on for this if priorities are not. size() counts entries, transitions() copies.
+// The index, the priorities and the counts are rebuilt when a file is opened, not stored in it.
+class ReplayBuffer {
+public:
+    explicit ReplayBuffer(size_t capacity = 0);
+    ~ReplayBuffer();
+    ReplayBuffer(const ReplayBuffer&) = delete;
+    ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+    void reset(size_t capacity);  // Empty heap storage for `capacity` transitions (closes any file)
+    // Reallocate heap storage for `capacity` transitions, keeping the newest ones and their
+    // priorities. False (and nothing changes) for a mapped file, whose capacity is fixed
+    bool resize(size_t capacity);
+    // Bytes used for `capacity` transitions: the arrays plus the pools and, if prioritized,
+    // the sum-trees and, if deduplicated, the hash index (e.g. to size the buffer from a
+    // memory budget)
+    static size_t memoryFor(size_t capacity, bool prioritized, bool deduplicated = false);
+
+    // Map `path`, creating it for `capacity` transitions if it does not exist (an existing
+    // file keeps its own capacity). Read-only buffers cannot be pushed to. On failure the
+    // buffer is left as it was and `error` says why
+    bool openFile(const std::string& path, size_t capacity, bool read_only, std::string& error);
+    bool mapped() const { return mapping != nullptr; }
+    bool readOnly() const { return read_only; }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return slots; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == capacity(); }
+    size_t terminalCount() const { return pools[1].size(); }
+    size_t nonTerminalCount() const { return pools[0].size(); }
+    size_t terminalSlot(size_t k) const { return pools[1][k]; }      // k < terminalCount()
+    size_t nonTerminalSlot(size_t k) const { return pools[0][k]; }  // k < nonTerminalCount()
+    void clear();
+
+    void enablePriorities();  // Every stored transition starts at priority 1
+    // Sampled through the sum-trees (by priority and duplicate count), not uniformly per entry
+    bool weighted() const { return !priority_trees[0].empty(); }
+    double priority(size_t slot) const { return priority_trees[kind(slot)].get(slot) / counts[slot]; }
+    void setPriority(size_t slot, double priority);  // > 0; O(log n)
+    // Sum of priority * count over a pool
+    double priorityTotal(bool terminal) const { return priority_trees[terminal ? 1 : 0].total(); }
+    // Slot of the given pool whose cumulative priority range contains mass (0 <= mass < priorityTotal)
+    size_t findPrioritized(bool terminal, double mass) const { return priority_trees[terminal ? 1 : 0].find(mass); }
+    
+    void enableDeduplication();
+    bool deduplicated() const { return deduplicate; }
+    uint32_t copies(size_t slot) const { return counts[slot]; }  // 1 unless deduplicated
+    size_t transitions() const { return pool_transitions[0] + pool_transitions[1]; }
+    size_t transitionCount(bool terminal) const { return pool_transitions[terminal ? 1 : 0]; }
+
+    // Copy one transition in; overwrites the oldest when full. O(1), O(log n) with priorities.
+    // Ignored by read-only buffers
+    void push(const PackedState& state, int action_rotation, int action_x, double reward,
+              const PackedState& next_state, bool done);
+
+    size_t slot(size_t age) const { return (head + age) % capacity(); }
+    const PackedState& state(size_t slot) const { return states[slot]; }
+    const PackedState& nextState(size_t slot) const { return next_states[slot]; }
+    float reward(size_t slot) const { return rewards[slot]; }
+    bool done(size_t slot) const { return dones[slot] != 0; }
+    int actionRotation(size_t slot) const { return action_rotations[slot]; }
+    int actionX(size_t slot) const { return action_xs[slot]; }
+    // Ask the CPU to start loading a row that is about to be sampled (states, reward, done)
+    void prefetch(size_t slot) const {
+        __builtin_prefetch(&states[slot]);
+        __builtin_prefetch(&next_states[slot]);
+        __builtin_prefetch(&rewards[slot]);
+        __builtin_prefetch(&dones[slot]);
+    }
+
+private:
+    // First 64 bytes of a replay file; the arrays follow in the order below, each at a
+    // 64-byte boundary. head and count are rewritten by every push
+    struct FileHeader {
+        char magic[8];            // "TTRREPLY"
+        uint32_t version;         // FILE_VERSION
+        uint32_t record_size;     // sizeof(PackedState)
+        uint64_t capacity;
+        uint64_t head;
+        uint64_t count;
+        uint8_t reserved[24];
+    };
+    static_assert(sizeof(FileHeader) == 64, "the arrays start at a 64-byte boundary");
+    static const uint32_t FILE_VERSION = 1;
+    static size_t storageSize(size_t capacity);  // Arrays only, header excluded
+    void layout(uint8_t* base, size_t capacity);  // Point the arrays into a block
+    void closeFile();
+    int kind(size_t slot) const { return dones[slot] != 0 ? 1 : 0; }  // Pool of a slot
+    void rebuildIndex();  // Pools, counts, hash index and priorities from the stored rows
+    static uint64_t transitionKey(const PackedState& state, int action_rotation, int action_x, float reward,
+                                  const PackedState& next_state, bool done);
+    uint64_t transitionKey(size_t slot) const;
+    bool sameTransition(size_t slot, const PackedState& state, int action_rotation, int action_x, float reward,
+                        const PackedState& next_state, bool done) const;
+
+    // Storage: `arena` on the heap, or the mapping (header first) of a replay file
+    std::vector<uint8_t> arena;
+    void* mapping;
+    size_t mapping_size;
+    int file_descriptor;  // Kept open while mapped for the write lock
+    bool read_only;
+    FileHeader* header;   // In the mapping; nullptr on the heap
+    size_t slots;
+    PackedState* states;
+    PackedState* next_states;
+    float* rewards;
+    int8_t* action_rotations;
+    int8_t* action_xs;
+    uint8_t* dones;
+
+    std::vector<uint32_t> pools[2];      // Slots of the non-terminal [0] and terminal [1] transitions
+    std::vector<uint32_t> pool_position;  // Index of each slot in its pool
+    SumTree priority_trees[2];  // Per pool, leaf = slot: priority * count (0 for slots of the other pool); empty when off
+    double max_priority;
+    std::vector<uint32_t> counts;                       // Copies each slot stands for
+    size_t pool_transitions[2];                         // Sum of counts per pool
+    bool deduplicate;
+    std::unordered_map<uint64_t, uint32_t> dedup_index;  // transitionKey -> slot
+    size_t head;   // Slot of the oldest transition
+    size_t count;
+};
+
+// One transition as stored in a ReplayArchive
+struct ArchivedTransition {
+    PackedState state;
+    PackedState next_state;
+    float reward;
+    int8_t action_rotation;
+    int8_t action_x;
+    bool done;
+};
+
+// Cold tier of the replay memory: an append-only file of the transitions the in-memory ring
+// overwrites, so rare positions stay available for replay after they leave the ring.
+//
+// Transitions are compressed (each board stored as a mask of its non-zero bytes plus those
+// bytes, the next state as its difference from the state: typically about 40 bytes instead
+// of 71) and written in blocks of BLOCK_TRANSITIONS with a checksum. Only whole blocks are
+// read back: advance() replaces one of the WINDOW_BLOCKS blocks kept decoded in memory with
+// a randomly chosen block, whose read was requested from the OS (read-ahead) one advance
+// earlier, and sample() draws from that window. Sampling is O(1) and each advance costs one
+// block read, however large the file grows.
+//
+// One process may open a file (write lock); a torn block at the end, e.g. after a crash,
+// is cut off on open. Blocks still being filled are written by flush() and on close
+class ReplayArchive {
+public:
+    static const int BLOCK_TRANSITIONS = 256;
+    static const int WINDOW_BLOCKS = 8;
+
+    ReplayArchive();
+    ~ReplayArchive();  // Flushes and closes
+    ReplayArchive(const ReplayArchive&) = delete;
+    ReplayArchive& operator=(const ReplayArchive&) = delete;
+
+    // Open `path` for appending, creating it if it does not exist. On failure nothing is
+    // open and `error` says why
+    bool open(const std::string& path, std::string& error);
+    void close();
+    bool isOpen() const { return file_descriptor >= 0; }
+
+    void append(const ArchivedTransition& transition);
+    void flush();  // Write the block being filled, even if partial
+
+    size_t size() const { return archived + pending_transitions; }  // Including the unflushed block
+    size_t blockCount() const { return blocks.size(); }
+    long long fileBytes() const { return file_bytes; }
+
+    // Load the block read ahead last time into the window (replacing its oldest block) and
+    // read ahead the next one, picked with rand(). False when nothing is archived yet
+    bool advance();
+    size_t windowSize() const { return window_size; }
+    // Transition k of the window, 0 <= k < windowSize()
+    const ArchivedTransition& sample(size_t k) const;
+
+private:
+    struct FileHeader {
+        char magic[8];          // "TTRARCHV"
+        uint32_t version;       // FILE_VERSION
+        uint32_t block_transitions;
+        uint8_t reserved[48];
+    };
+    struct BlockHeader {
+        uint32_t magic;         // BLOCK_MAGIC
+        uint32_t transitions;
+        uint32_t bytes;         // Compressed payload that follows
+        uint32_t checksum;      // FNV-1a of the payload
+    };
+    static_assert(sizeof(FileHeader) == 64, "archive header layout");
+    static_assert(sizeof(BlockHeader) == 16, "block header layout");
+    static const uint32_t FILE_VERSION = 1;
+    static const uint32_t BLOCK_MAGIC = 0x4b4c4254;  // "TBLK"
+    struct Block {
+        long long offset;       // Of the payload
+        uint32_t transitions;
+        uint32_t bytes;
+        uint32_t checksum;
+    };
+    bool readBlock(size_t block, std::vector<ArchivedTransition>& out);
+
+    int file_descriptor;
+    long long file_bytes;
+    std::vector<Block> blocks;
+    size_t archived;                      // Transitions in blocks
+    std::vector<uint8_t> pending;         // Compressed transitions of the block being filled
+    uint32_t pending_transitions;
+    std::vector<uint8_t> read_buffer;
+    std::vector<ArchivedTransition> window[WINDOW_BLOCKS];
+    size_t window_size;
+    int window_next;                      // Window block replaced by the next advance
+    long long read_ahead;                 // Block whose read was requested, -1 = none
+};
+
+#endif // REPLAY_BUFFER_H
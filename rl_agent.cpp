@@ -1,6 +1,8 @@
 #include "rl_agent.h"
 #include "game_classes.h"
+#include "weight_snapshot.h"
 #include <random>
+#include <chrono>
 #include <fstream>
 #include <algorithm>
 #include <cmath>
@@ -12,226 +14,306 @@
 #include <deque>
 #include <dirent.h>
 #include <cstring>
+#include <cstdio>
 
 // Neural Network Implementation
-NeuralNetwork::NeuralNetwork() {
+NeuralNetwork::NeuralNetwork(int hidden)
+    : hidden_size(hidden), shape_index(nnShapeIndex(INPUT_SIZE, hidden)) {
+    if (shape_index < 0) {
+        // Unsupported shape: fall back to the default so the kernels always match the storage
+        hidden_size = DEFAULT_HIDDEN_SIZE;
+        shape_index = nnShapeIndex(INPUT_SIZE, hidden_size);
+    }
+    optimizer.reset(hidden_size);
+    weights1.fill(0.0);
+    bias1.fill(0.0);
+    weights2.fill(0.0);
+    bias2.fill(0.0);
+    
     std::random_device rd;
     std::mt19937 gen(rd());
     
     // COMPLETE REWRITE: Clean initialization - He initialization for Leaky ReLU
     double stddev1 = std::sqrt(2.0 / INPUT_SIZE);
-    double stddev2 = std::sqrt(2.0 / HIDDEN_SIZE);
+    double stddev2 = std::sqrt(2.0 / hidden_size);
     
     std::normal_distribution<double> dist1(0.0, stddev1);
     std::normal_distribution<double> dist2(0.0, stddev2);
     std::normal_distribution<double> bias_dist(0.0, 0.1);
     
     // Initialize weights1 (Input -> Hidden) with He initialization
-    weights1.resize(INPUT_SIZE, std::vector<double>(HIDDEN_SIZE));
-    for (auto& row : weights1) {
-        for (auto& w : row) {
-            w = dist1(gen);
-        }
+    for (size_t k = 0; k < weights1Count(); k++) {
+        weights1[k] = dist1(gen);
     }
     
     // Initialize bias1
-    bias1.resize(HIDDEN_SIZE, 0.0);
-    for (auto& b : bias1) {
-        b = bias_dist(gen);
+    for (int i = 0; i < hidden_size; i++) {
+        bias1[i] = bias_dist(gen);
     }
     
     // Initialize weights2 (Hidden -> Output) with He initialization
-    weights2.resize(HIDDEN_SIZE, std::vector<double>(OUTPUT_SIZE));
-    for (auto& row : weights2) {
-        for (auto& w : row) {
-            w = dist2(gen);
-        }
+    for (int i = 0; i < hidden_size * OUTPUT_SIZE; i++) {
+        weights2[i] = dist2(gen);
     }
     
     // Initialize bias2 with positive value to prevent all Q-values being negative
     // FIX: Initialize bias2 to positive value (3.0) to ensure some positive Q-values initially
-    bias2.resize(OUTPUT_SIZE, 0.0);
     std::normal_distribution<double> bias2_dist(3.0, 0.2);  // FIX: Mean 3.0 (increased from 2.0) to ensure positive Q-values
-    bias2[0] = bias2_dist(gen);
     // Ensure bias2 is positive and within reasonable range
-    bias2[0] = std::max(1.0, std::min(5.0, bias2[0]));
+    bias2[0] = std::max(1.0, std::min(5.0, bias2_dist(gen)));
+    quantize();
 }
 
-double NeuralNetwork::relu(double x) const {
-    return std::max(0.0, x);
+nn_accum NeuralNetwork::relu(nn_accum x) const {
+    return std::max(nn_accum(0), x);
 }
 
-double NeuralNetwork::leaky_relu(double x) const {
+nn_accum NeuralNetwork::leaky_relu(nn_accum x) const {
     // Leaky ReLU: allows small negative gradients to flow through
     // Prevents "dead neurons" that output 0 for all inputs
-    return std::max(0.2 * x, x);  // Leak factor: 0.2 (20% of negative values) - standard value
+    return std::max(nn_accum(0.2) * x, x);  // Leak factor: 0.2 (20% of negative values) - standard value
 }
 
-double NeuralNetwork::forward(const std::vector<double>& input) {
-    // Hidden layer - use Leaky ReLU to prevent dead neurons
-    std::vector<double> hidden(HIDDEN_SIZE);
-    for (int i = 0; i < HIDDEN_SIZE; i++) {
-        double sum = bias1[i];
-        for (int j = 0; j < INPUT_SIZE; j++) {
-            sum += input[j] * weights1[j][i];
-        }
-        hidden[i] = leaky_relu(sum);  // Use Leaky ReLU instead of ReLU
-    }
-    
-    // Output layer
-    double output = bias2[0];
-    for (int i = 0; i < HIDDEN_SIZE; i++) {
-        output += hidden[i] * weights2[i][0];
-    }
-    
-    // Clip output Q-value to prevent unbounded growth (new: Q-value clipping)
+NetworkView NeuralNetwork::view() const {
+    NetworkView v;
+    v.weights1 = weights1.data();
+    v.bias1 = bias1.data();
+    v.weights2 = weights2.data();
+    v.bias2 = bias2[0];
+    v.input_size = INPUT_SIZE;
+    v.hidden_size = hidden_size;
+    return v;
+}
+
+// Clip output Q-value to prevent unbounded growth (new: Q-value clipping)
+static double clipQValue(nn_accum output) {
     const double MAX_Q_VALUE = 200.0;
     const double MIN_Q_VALUE = -200.0;
-    output = std::max(MIN_Q_VALUE, std::min(MAX_Q_VALUE, output));
-    
-    return output;
+    return std::max(MIN_Q_VALUE, std::min(MAX_Q_VALUE, double(output)));
+}
+
+double NeuralNetwork::forward(const nn_real* input) const {
+    // Hidden layer (Leaky ReLU) and output layer in one pass, vectorized for this CPU
+    return clipQValue(kernels().forward(view(), input, nullptr));
+}
+
+void NeuralNetwork::forwardBatch(const nn_real* inputs, int count, double* q_values) const {
+    // Raw outputs go through a stack buffer in fixed chunks, so no allocation per call
+    const int CHUNK = 64;
+    nn_accum outputs[CHUNK];
+    for (int start = 0; start < count; start += CHUNK) {
+        int n_chunk = std::min(CHUNK, count - start);
+        kernels().forward_batch(view(), inputs + size_t(start) * INPUT_SIZE, n_chunk, outputs, nullptr);
+        for (int n = 0; n < n_chunk; n++) {
+            q_values[start + n] = clipQValue(outputs[n]);
+        }
+    }
+}
+
+void NeuralNetwork::initAccumulator(const nn_real* input, Accumulator& acc) const {
+    std::copy(input, input + INPUT_SIZE, acc.input.begin());
+    kernels().forward(view(), input, acc.pre_activation.data());
 }
 
-void NeuralNetwork::update(const std::vector<double>& input, double target, double learning_rate) {
-    // Forward pass - store intermediate values for backprop
-    std::vector<double> hidden_pre_activation(HIDDEN_SIZE);
-    std::vector<double> hidden(HIDDEN_SIZE);
-    for (int i = 0; i < HIDDEN_SIZE; i++) {
-        double sum = bias1[i];
-        for (int j = 0; j < INPUT_SIZE; j++) {
-            sum += input[j] * weights1[j][i];
+double NeuralNetwork::forwardFrom(const Accumulator& acc, const nn_real* input) const {
+    int changed[INPUT_SIZE];
+    nn_accum delta[INPUT_SIZE];
+    int change_count = 0;
+    for (int j = 0; j < INPUT_SIZE; j++) {
+        if (input[j] != acc.input[j]) {
+            changed[change_count] = j;
+            delta[change_count++] = nn_accum(input[j]) - nn_accum(acc.input[j]);
         }
-        hidden_pre_activation[i] = sum;
-        hidden[i] = leaky_relu(sum);  // Use Leaky ReLU instead of ReLU
     }
+    return clipQValue(kernels().forward_delta(view(), acc.pre_activation.data(), changed, delta, change_count));
+}
+
+void NeuralNetwork::quantize() {
+    const int H = hidden_size;
+    auto finite = [](double v) { return std::isfinite(v) ? v : 0.0; };
     
-    double output = bias2[0];
-    for (int i = 0; i < HIDDEN_SIZE; i++) {
-        output += hidden[i] * weights2[i][0];
+    // One scale for the whole first layer: the largest weight maps to NN_QUANT_WEIGHT_MAX
+    double max_abs = 0.0;
+    for (size_t k = 0; k < weights1Count(); k++) {
+        max_abs = std::max(max_abs, std::abs(finite(weights1[k])));
     }
+    double scale = (max_abs > 1e-6) ? NN_QUANT_WEIGHT_MAX / max_abs : 1.0;
+    double accum_scale = NN_QUANT_INPUT_SCALE * scale;  // Units of the int32 hidden sums
+    quantized.weight_scale = scale;
+    
+    quantized.weights1.fill(0);  // Also the padding input of the last pair
+    for (int j = 0; j < INPUT_SIZE; j++) {
+        for (int i = 0; i < H; i++) {
+            quantized.weights1[((j / 2) * H + i) * 2 + j % 2] = int16_t(std::lround(finite(weights1[j * H + i]) * scale));
+        }
+    }
+    for (int i = 0; i < H; i++) {
+        double b = std::max(-1e9, std::min(1e9, finite(bias1[i]) * accum_scale));
+        quantized.bias1[i] = int32_t(std::lround(b));
+        quantized.weights2[i] = float(finite(weights2[i]) / accum_scale);  // Dequantisation folded in
+    }
+    quantized.bias2 = float(finite(bias2[0]));
+}
+
+QuantizedView NeuralNetwork::quantizedView() const {
+    QuantizedView v;
+    v.weights1 = quantized.weights1.data();
+    v.bias1 = quantized.bias1.data();
+    v.weights2 = quantized.weights2.data();
+    v.bias2 = quantized.bias2;
+    v.hidden_size = hidden_size;
+    return v;
+}
+
+double NeuralNetwork::forwardQuantized(const nn_real* input) const {
+    int16_t q[NN_INPUT_PAIRS * 2];
+    nnQuantizeInput(input, q);
+    return clipQValue(kernels().forward_quantized(quantizedView(), q));
+}
+
+int NeuralNetwork::trainBatch(const nn_real* states, const double* targets, int count, double learning_rate,
+                              BatchWorkspace& ws, const double* sample_weights) {
+    const int H = hidden_size;
+    const int I = INPUT_SIZE;
+    const NNKernels& k = kernels();
     
     // FIX: Reduced clipping limits to prevent gradient explosion
-    const double MAX_ERROR = 25.0;      // Reduced from 50.0 to prevent extreme errors
-    const double MAX_GRADIENT = 5.0;    // Reduced from 10.0 to prevent gradient explosion
+    const nn_accum MAX_ERROR = 25.0;      // Reduced from 50.0 to prevent extreme errors
+    const nn_accum MAX_GRADIENT = 5.0;    // Reduced from 10.0 to prevent gradient explosion
     // FIX: Reduced weight limits to prevent saturation and weight explosion
     // Current model has bias2/weights2/bias1 hitting limits at 27.0/-27.0
-    const double MAX_WEIGHT = 25.0;     // FIX: Reduced from 30.0 to 25.0 (weights still hitting limits)
-    const double MIN_WEIGHT = -25.0;    // FIX: Reduced from -30.0 to -25.0 to match MAX_WEIGHT
-    
-    double error = target - output;
-    
-    // Clip error to prevent extreme gradients (prevents weight explosion)
-    error = std::max(-MAX_ERROR, std::min(MAX_ERROR, error));
-    
-    double output_gradient = error;
-    
-    // Update output layer weights and bias
-    for (int i = 0; i < HIDDEN_SIZE; i++) {
-        if (!std::isfinite(hidden[i])) continue;  // Skip if hidden value is invalid
-        
-        double weight_gradient = output_gradient * hidden[i];
-        
-        // Clip gradient to prevent explosion
-        weight_gradient = std::max(-MAX_GRADIENT, std::min(MAX_GRADIENT, weight_gradient));
-        
-        weights2[i][0] += learning_rate * weight_gradient;
-        
-        // Clip weights to prevent explosion (new: explicit weight clipping)
-        weights2[i][0] = std::max(MIN_WEIGHT, std::min(MAX_WEIGHT, weights2[i][0]));
-        
-        // FIX: More aggressive clipping for weights2 - clip at 80% of limit to prevent saturation
-        if (weights2[i][0] > MAX_WEIGHT * 0.8) {
-            weights2[i][0] = MAX_WEIGHT * 0.8;  // Clip at 20.0 (80% of 25.0)
-        }
-        if (weights2[i][0] < MIN_WEIGHT * 0.8) {
-            weights2[i][0] = MIN_WEIGHT * 0.8;  // Clip at -20.0 (80% of -25.0)
-        }
-        
-        // Check for NaN/Inf and fix if needed
-        if (!std::isfinite(weights2[i][0])) {
-            weights2[i][0] = 0.0;  // Reset to zero if invalid
+    const nn_real MAX_WEIGHT = 25.0;     // FIX: Reduced from 30.0 to 25.0 (weights still hitting limits)
+    
+    // Bulk non-finite scan of the inputs, once per batch: invalid features are zeroed in a
+    // copy so the backward kernels need no per-element checks
+    const size_t input_count = size_t(count) * I;
+    bool inputs_finite = true;
+    for (size_t n = 0; n < input_count; n++) {
+        inputs_finite = inputs_finite && std::isfinite(states[n]);
+    }
+    if (!inputs_finite) {
+        ws.clean_states.assign(states, states + input_count);
+        for (nn_real& x : ws.clean_states) {
+            if (!std::isfinite(x)) x = 0.0;  // Invalid input contributes nothing
+        }
+        states = ws.clean_states.data();
+    }
+    
+    // Forward pass for the whole batch - keep pre-activations for backprop
+    ws.outputs.resize(count);
+    ws.predictions.resize(count);
+    ws.errors.resize(count);
+    ws.pre_activations.resize(size_t(count) * H);
+    k.forward_batch(view(), states, count, ws.outputs.data(), ws.pre_activations.data());
+    
+    // Output errors, clipped to prevent extreme gradients (prevents weight explosion)
+    int valid = 0;
+    for (int n = 0; n < count; n++) {
+        ws.predictions[n] = clipQValue(ws.outputs[n]);
+        nn_accum error = nn_accum(targets[n]) - ws.outputs[n];
+        if (!std::isfinite(targets[n]) || !std::isfinite(ws.outputs[n]) || !std::isfinite(error)) {
+            ws.errors[n] = 0.0;  // Skip samples with invalid values
+            continue;
         }
+        ws.errors[n] = std::max(-MAX_ERROR, std::min(MAX_ERROR, error));
+        if (sample_weights) ws.errors[n] *= nn_accum(sample_weights[n]);
+        valid++;
     }
+    if (valid == 0) return 0;
     
-    // Clip output gradient for bias update
-    double bias2_gradient = std::max(-MAX_GRADIENT, std::min(MAX_GRADIENT, output_gradient));
-    bias2[0] += learning_rate * bias2_gradient;
-    
-    // Clip bias to prevent explosion (new: explicit bias clipping)
-    bias2[0] = std::max(MIN_WEIGHT, std::min(MAX_WEIGHT, bias2[0]));
-    
-    // FIX: More aggressive clipping for bias2 - clip at 80% of limit to prevent saturation
-    if (bias2[0] > MAX_WEIGHT * 0.8) {
-        bias2[0] = MAX_WEIGHT * 0.8;  // Clip at 20.0 (80% of 25.0)
-    }
-    if (bias2[0] < MIN_WEIGHT * 0.8) {
-        bias2[0] = MIN_WEIGHT * 0.8;  // Clip at -20.0 (80% of -25.0)
-    }
-    
-    if (!std::isfinite(bias2[0])) {
-        bias2[0] = 0.0;
-    }
+    // Accumulate gradients over the batch
+    ws.grad_weights1.assign(weights1Count(), 0.0);
+    ws.grad_bias1.assign(H, 0.0);
+    ws.grad_weights2.assign(H, 0.0);
+    nn_accum grad_bias2 = 0.0;
     
-    // Hidden layer gradients
-    for (int i = 0; i < HIDDEN_SIZE; i++) {
-        if (!std::isfinite(weights2[i][0])) continue;  // Skip if weight is invalid
+    for (int n = 0; n < count; n++) {
+        nn_accum output_gradient = ws.errors[n];
+        if (output_gradient == 0) continue;  // Skipped sample, or nothing to learn
+        grad_bias2 += output_gradient;
         
-        double hidden_gradient = output_gradient * weights2[i][0];
-        
-        // Clip hidden gradient
-        hidden_gradient = std::max(-MAX_GRADIENT, std::min(MAX_GRADIENT, hidden_gradient));
-        
-        double relu_derivative = (hidden_pre_activation[i] > 0) ? 1.0 : 0.2;
-        
-        // Update input-to-hidden weights
-        for (int j = 0; j < INPUT_SIZE; j++) {
-            if (!std::isfinite(input[j])) continue;  // Skip if input is invalid
-            
-            double weight_gradient = hidden_gradient * relu_derivative * input[j];
+        // Hidden deltas overwrite this sample's pre-activations
+        nn_accum* delta = &ws.pre_activations[size_t(n) * H];
+        for (int i = 0; i < H; i++) {
+            nn_accum hidden = leaky_relu(delta[i]);  // Use Leaky ReLU instead of ReLU
+            ws.grad_weights2[i] += output_gradient * hidden;
             
-            // Clip weight gradient
-            weight_gradient = std::max(-MAX_GRADIENT, std::min(MAX_GRADIENT, weight_gradient));
-            
-            weights1[j][i] += learning_rate * weight_gradient;
-            
-            // Clip weights to prevent explosion (new: explicit weight clipping)
-            weights1[j][i] = std::max(MIN_WEIGHT, std::min(MAX_WEIGHT, weights1[j][i]));
-            
-            // Check for NaN/Inf and fix if needed
-            if (!std::isfinite(weights1[j][i])) {
-                weights1[j][i] = 0.0;  // Reset to zero if invalid
-            }
-        }
-        
-        // Update hidden bias
-        double bias_gradient = hidden_gradient * relu_derivative;
-        bias_gradient = std::max(-MAX_GRADIENT, std::min(MAX_GRADIENT, bias_gradient));
-        
-        bias1[i] += learning_rate * bias_gradient;
-        
-        // Clip bias to prevent explosion (new: explicit bias clipping)
-        bias1[i] = std::max(MIN_WEIGHT, std::min(MAX_WEIGHT, bias1[i]));
-        
-        // FIX: Additional aggressive clipping for bias1 - clip at 80% of limit to prevent saturation
-        if (bias1[i] > MAX_WEIGHT * 0.8) {  // Clip at 20.0 (80% of 25.0)
-            bias1[i] = MAX_WEIGHT * 0.8;
-        }
-        if (bias1[i] < MIN_WEIGHT * 0.8) {  // Clip at -20.0 (80% of -25.0)
-            bias1[i] = MIN_WEIGHT * 0.8;
+            // Clip hidden gradient (per sample, as the error is)
+            nn_accum hidden_gradient = output_gradient * weights2[i];
+            hidden_gradient = std::max(-MAX_GRADIENT, std::min(MAX_GRADIENT, hidden_gradient));
+            nn_accum relu_derivative = (delta[i] > 0) ? 1.0 : 0.2;
+            delta[i] = hidden_gradient * relu_derivative;
+            ws.grad_bias1[i] += delta[i];
         }
         
-        // Check for NaN/Inf and fix if needed
-        if (!std::isfinite(bias1[i])) {
-            bias1[i] = 0.0;  // Reset to zero if invalid
-        }
-    }
-    if (!std::isfinite(bias2[0])) {
-        bias2[0] = ((rand() / (double)RAND_MAX) - 0.5) * 0.1;
-        bias2[0] = std::max(MIN_WEIGHT, std::min(MAX_WEIGHT, bias2[0]));  // Ensure within clipping range
+        // Input-to-hidden gradients: one row of the input-major matrix per input feature
+        k.accumulate_gradients(states + size_t(n) * I, delta, ws.grad_weights1.data());
+    }
+    
+    // Single weight update: each mean gradient is clipped, then applied with a step of
+    // learning_rate * valid so a batch moves the weights as far as `valid` per-sample updates.
+    // Plain SGD uses the kernel (clip, clamp and NaN repair without branches); the other
+    // optimizers apply the same clipping and limits around their own update rule
+    auto apply = [&](Optimizer::Group group, nn_real* params, const nn_accum* grad_sums, int n,
+                     const UpdateRule& rule) {
+        if (optimizer.type == OPTIMIZER_SGD) {
+            k.apply_update(params, grad_sums, n, rule);
+        } else {
+            optimizer.apply(group, params, grad_sums, n, rule, learning_rate);
+        }
+    };
+    optimizer.beginStep();
+    UpdateRule rule;
+    rule.grad_scale = nn_accum(1.0) / valid;
+    rule.max_gradient = MAX_GRADIENT;
+    rule.step = nn_accum(learning_rate) * valid;
+    
+    // FIX: More aggressive clipping for weights2, bias2 and bias1 - clip at 80% of limit
+    // to prevent saturation (20.0 = 80% of 25.0); weights1 keeps the full limit
+    rule.limit = MAX_WEIGHT * nn_real(0.8);
+    apply(Optimizer::WEIGHTS2, weights2.data(), ws.grad_weights2.data(), H, rule);
+    apply(Optimizer::BIAS2, bias2.data(), &grad_bias2, 1, rule);
+    apply(Optimizer::BIAS1, bias1.data(), ws.grad_bias1.data(), H, rule);
+    rule.limit = MAX_WEIGHT;
+    apply(Optimizer::WEIGHTS1, weights1.data(), ws.grad_weights1.data(), int(weights1Count()), rule);
+    
+    return valid;
+}
+
+void NeuralNetwork::update(const std::vector<nn_real>& input, double target, double learning_rate) {
+    BatchWorkspace ws;
+    trainBatch(input.data(), &target, 1, learning_rate, ws);
+}
+
+void NeuralNetwork::copyParametersFrom(const NeuralNetwork& other) {
+    hidden_size = other.hidden_size;
+    shape_index = other.shape_index;
+    weights1 = other.weights1;
+    bias1 = other.bias1;
+    weights2 = other.weights2;
+    bias2 = other.bias2;
+}
+
+void NeuralNetwork::blendParametersFrom(const NeuralNetwork& other, double tau) {
+    if (other.hidden_size != hidden_size) {
+        copyParametersFrom(other);  // Nothing to average against
+        return;
     }
+    const nn_real keep = nn_real(1.0 - tau);
+    const nn_real take = nn_real(tau);
+    auto blend = [&](nn_real* dst, const nn_real* src, size_t count) {
+        for (size_t k = 0; k < count; k++) {
+            dst[k] = keep * dst[k] + take * src[k];
+        }
+    };
+    blend(weights1.data(), other.weights1.data(), weights1Count());
+    blend(bias1.data(), other.bias1.data(), hidden_size);
+    blend(weights2.data(), other.weights2.data(), hidden_size * OUTPUT_SIZE);
+    blend(bias2.data(), other.bias2.data(), OUTPUT_SIZE);
 }
 
 void NeuralNetwork::save(const std::string& filename) {
+    quantize();  // Move selection with --quantized uses the saved weights
     std::ofstream file(filename);
     if (!file.is_open()) return;
     
@@ -241,26 +323,27 @@ void NeuralNetwork::save(const std::string& filename) {
     file << "# Neural Network Model File\n";
     file << "# Saved: " << std::put_time(&time_info, "%Y-%m-%d %H:%M:%S") << "\n";
     file << "# Filename: " << filename << "\n";
+    file << "# Shape: " << INPUT_SIZE << "x" << hidden_size << "\n";
     file << "#\n";
     
-    // Save weights1
-    for (const auto& row : weights1) {
-        for (double w : row) {
-            file << w << " ";
+    // Save weights1 (one row per input feature)
+    for (int j = 0; j < INPUT_SIZE; j++) {
+        for (int i = 0; i < hidden_size; i++) {
+            file << weights1[j * hidden_size + i] << " ";
         }
         file << "\n";
     }
     
     // Save bias1
-    for (double b : bias1) {
-        file << b << " ";
+    for (int i = 0; i < hidden_size; i++) {
+        file << bias1[i] << " ";
     }
     file << "\n";
     
-    // Save weights2
-    for (const auto& row : weights2) {
-        for (double w : row) {
-            file << w << " ";
+    // Save weights2 (one row per hidden neuron)
+    for (int i = 0; i < hidden_size; i++) {
+        for (int o = 0; o < OUTPUT_SIZE; o++) {
+            file << weights2[i * OUTPUT_SIZE + o] << " ";
         }
         file << "\n";
     }
@@ -270,112 +353,85 @@ void NeuralNetwork::save(const std::string& filename) {
         file << b << " ";
     }
     file << "\n";
+    
+    // Optimizer moments (loaders that only read the parameters stop before this section)
+    file << "\n";
+    optimizer.save(file);
 }
 
-bool NeuralNetwork::load(const std::string& filename) {
+bool NeuralNetwork::readParameters(const std::string& filename, size_t count, std::vector<double>& values) {
     std::ifstream file(filename);
     if (!file.is_open()) return false;
     
+    values.clear();
+    values.reserve(count);
+    
     // Skip header lines (lines starting with #)
     // This handles both old format (no header) and new format (with header)
     std::string line;
-    while (std::getline(file, line)) {
+    while (values.size() < count && std::getline(file, line)) {
         // Skip empty lines and comment lines
-        if (line.empty() || (line.length() > 0 && line[0] == '#')) {
+        if (line.empty() || line[0] == '#') {
             continue;
         }
-        // Found first data line - need to parse it
-        // Use stringstream to parse the line we just read
         std::istringstream iss(line);
         double w;
-        // Try to read first weight from this line
-        if (iss >> w) {
-            // This is a data line, put it back by resetting file position
-            // Get current position
-            std::streampos pos = file.tellg();
-            // Calculate position of start of this line
-            pos -= static_cast<std::streamoff>(line.length() + 1); // +1 for newline
-            file.seekg(pos);
-            break;
+        while (values.size() < count && iss >> w) {
+            values.push_back(w);
         }
     }
     
-    // Load weights1
-    for (auto& row : weights1) {
-        for (double& w : row) {
-            if (!(file >> w)) return false;
-            // FIX: Clip weights1 to valid range during load to fix corrupted models
-            // FIX: Reduced limits to match new MAX_WEIGHT (25.0)
-            w = std::max(-25.0, std::min(25.0, w));
-            // FIX: More aggressive clipping on load - clip at 80% of limit
-            if (w > 25.0 * 0.8) {
-                w = 25.0 * 0.8;  // Clip at 20.0 (80% of 25.0)
-            }
-            if (w < -25.0 * 0.8) {
-                w = -25.0 * 0.8;  // Clip at -20.0 (80% of -25.0)
-            }
-        }
-    }
+    return values.size() == count;
+}
+
+int NeuralNetwork::readHiddenSize(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) return -1;
     
-    // Load bias1
-    for (double& b : bias1) {
-        if (!(file >> b)) return false;
-        // FIX: Clip bias1 to valid range during load to fix corrupted models
-        // FIX: Reduced limits to match new MAX_WEIGHT (25.0)
-        b = std::max(-25.0, std::min(25.0, b));
-        // FIX: More aggressive clipping on load - clip at 80% of limit
-        if (b > 25.0 * 0.8) {
-            b = 25.0 * 0.8;  // Clip at 20.0 (80% of 25.0)
-        }
-        if (b < -25.0 * 0.8) {
-            b = -25.0 * 0.8;  // Clip at -20.0 (80% of -25.0)
-        }
-        // FIX: If bias1 was stuck at old limit, reduce it further
-        if (b > 26.0 || b < -26.0) {
-            b = b * 0.75;  // Reduce by 25% if it was stuck at old limit
+    // The shape header sits in the leading comment block; files without it are 27x64
+    std::string line;
+    while (std::getline(file, line) && (line.empty() || line[0] == '#')) {
+        int input = 0, hidden = 0;
+        if (std::sscanf(line.c_str(), "# Shape: %dx%d", &input, &hidden) == 2) {
+            return nnShapeIndex(input, hidden) >= 0 ? hidden : -1;
         }
     }
+    return DEFAULT_HIDDEN_SIZE;
+}
+
+bool NeuralNetwork::load(const std::string& filename) {
+    int hidden = readHiddenSize(filename);
+    if (hidden < 0) return false;
+    std::vector<double> values;
+    if (!readParameters(filename, parameterCount(hidden), values)) return false;
     
-    // Load weights2
-    for (auto& row : weights2) {
-        for (double& w : row) {
-            if (!(file >> w)) return false;
-            // FIX: Clip weights2 to valid range during load to fix corrupted models
-            // FIX: Reduced limits to match new MAX_WEIGHT (25.0)
-            w = std::max(-25.0, std::min(25.0, w));
-            // FIX: More aggressive clipping on load - clip at 80% of limit and reduce stuck weights
-            if (w > 25.0 * 0.8) {
-                w = 25.0 * 0.8;  // Clip at 20.0 (80% of 25.0)
-            }
-            if (w < -25.0 * 0.8) {
-                w = -25.0 * 0.8;  // Clip at -20.0 (80% of -25.0)
-            }
-            // FIX: If weight was stuck at old limit, reduce it further
-            if (w > 26.0 || w < -26.0) {
-                w = w * 0.75;  // Reduce by 25% if it was stuck at old limit
-            }
-        }
+    hidden_size = hidden;
+    shape_index = nnShapeIndex(INPUT_SIZE, hidden);
+    if (!optimizer.load(filename, hidden_size)) {
+        optimizer.reset(hidden_size);  // Older file, or state for another shape: start fresh
     }
     
-    // Load bias2
-    for (double& b : bias2) {
-        if (!(file >> b)) return false;
-            // FIX: Clip bias2 to valid range during load to fix corrupted models
-            // FIX: Reduced limits to match new MAX_WEIGHT (25.0)
-            b = std::max(-25.0, std::min(25.0, b));
-            // FIX: More aggressive clipping on load - clip at 80% of limit and reduce stuck weights
-            if (b > 25.0 * 0.8) {
-                b = 25.0 * 0.8;  // Clip at 20.0 (80% of 25.0)
-            }
-            if (b < -25.0 * 0.8) {
-                b = -25.0 * 0.8;  // Clip at -20.0 (80% of -25.0)
-            }
-            // FIX: If bias2 was stuck at old limit, reduce it further
-            if (b > 26.0 || b < -26.0) {
-                b = b * 0.75;  // Reduce by 25% if it was stuck at old limit
-            }
+    // FIX: Clip all parameters to valid range during load to fix corrupted models
+    // Same limit for every layer: 80% of MAX_WEIGHT (25.0) so stuck weights start below the limit
+    size_t idx = 0;
+    auto next_value = [&]() -> nn_real {
+        double v = values[idx++];
+        return nn_real(std::max(-LOAD_WEIGHT_LIMIT, std::min(LOAD_WEIGHT_LIMIT, v)));
+    };
+    
+    // Load weights1, bias1, weights2, bias2 (file order matches the flat layout)
+    for (size_t k = 0; k < weights1Count(); k++) {
+        weights1[k] = next_value();
+    }
+    for (int i = 0; i < hidden_size; i++) {
+        bias1[i] = next_value();
+    }
+    for (int i = 0; i < hidden_size * OUTPUT_SIZE; i++) {
+        weights2[i] = next_value();
     }
+    bias2[0] = next_value();
     
+    quantize();
     return true;
 }
 
@@ -384,55 +440,52 @@ void NeuralNetwork::logWeightChanges(const std::string& filename, int episode, d
     if (!logfile.is_open()) return;
     
     // Calculate weight statistics
-    double weights1_mean = 0.0, weights1_min = weights1[0][0], weights1_max = weights1[0][0];
+    double weights1_mean = 0.0, weights1_min = weights1[0], weights1_max = weights1[0];
     double weights1_std = 0.0;
     int weights1_count = 0;
     
-    for (const auto& row : weights1) {
-        for (double w : row) {
-            weights1_mean += w;
-            weights1_min = std::min(weights1_min, w);
-            weights1_max = std::max(weights1_max, w);
-            weights1_count++;
-        }
+    for (size_t k = 0; k < weights1Count(); k++) {
+        double w = weights1[k];
+        weights1_mean += w;
+        weights1_min = std::min(weights1_min, w);
+        weights1_max = std::max(weights1_max, w);
+        weights1_count++;
     }
     weights1_mean /= weights1_count;
     
-    for (const auto& row : weights1) {
-        for (double w : row) {
-            weights1_std += (w - weights1_mean) * (w - weights1_mean);
-        }
+    for (size_t k = 0; k < weights1Count(); k++) {
+        double w = weights1[k];
+        weights1_std += (w - weights1_mean) * (w - weights1_mean);
     }
     weights1_std = std::sqrt(weights1_std / weights1_count);
     
-    double weights2_mean = 0.0, weights2_min = weights2[0][0], weights2_max = weights2[0][0];
+    double weights2_mean = 0.0, weights2_min = weights2[0], weights2_max = weights2[0];
     double weights2_std = 0.0;
     int weights2_count = 0;
     
-    for (const auto& row : weights2) {
-        for (double w : row) {
-            weights2_mean += w;
-            weights2_min = std::min(weights2_min, w);
-            weights2_max = std::max(weights2_max, w);
-            weights2_count++;
-        }
+    for (size_t k = 0; k < size_t(hidden_size * OUTPUT_SIZE); k++) {
+        double w = weights2[k];
+        weights2_mean += w;
+        weights2_min = std::min(weights2_min, w);
+        weights2_max = std::max(weights2_max, w);
+        weights2_count++;
     }
     weights2_mean /= weights2_count;
     
-    for (const auto& row : weights2) {
-        for (double w : row) {
-            weights2_std += (w - weights2_mean) * (w - weights2_mean);
-        }
+    for (size_t k = 0; k < size_t(hidden_size * OUTPUT_SIZE); k++) {
+        double w = weights2[k];
+        weights2_std += (w - weights2_mean) * (w - weights2_mean);
     }
     weights2_std = std::sqrt(weights2_std / weights2_count);
     
     double bias1_mean = 0.0, bias1_min = bias1[0], bias1_max = bias1[0];
-    for (double b : bias1) {
+    for (size_t k = 0; k < size_t(hidden_size); k++) {
+        double b = bias1[k];
         bias1_mean += b;
         bias1_min = std::min(bias1_min, b);
         bias1_max = std::max(bias1_max, b);
     }
-    bias1_mean /= bias1.size();
+    bias1_mean /= hidden_size;
     
     double bias2_mean = bias2[0];
     
@@ -518,18 +571,18 @@ NeuralNetwork::SaturationMetrics NeuralNetwork::calculateSaturation() const {
     
     // Calculate for weights1 (flatten to vector) - COMPLETE REWRITE
     std::vector<double> w1_flat;
-    for (const auto& row : weights1) {
-        for (double w : row) {
-            if (std::isfinite(w)) {  // Only add finite values
-                w1_flat.push_back(w);
-            }
+    for (size_t k = 0; k < weights1Count(); k++) {
+        double w = weights1[k];
+        if (std::isfinite(w)) {  // Only add finite values
+            w1_flat.push_back(w);
         }
     }
     metrics.weights1_saturation = calcSaturation(w1_flat, metrics.weights1_variance);
     
     // Calculate for bias1 - COMPLETE REWRITE
     std::vector<double> b1_valid;
-    for (double b : bias1) {
+    for (size_t k = 0; k < size_t(hidden_size); k++) {
+        double b = bias1[k];
         if (std::isfinite(b)) {  // Only add finite values
             b1_valid.push_back(b);
         }
@@ -538,11 +591,10 @@ NeuralNetwork::SaturationMetrics NeuralNetwork::calculateSaturation() const {
     
     // Calculate for weights2 (flatten to vector)
     std::vector<double> w2_flat;
-    for (const auto& row : weights2) {
-        for (double w : row) {
-            if (std::isfinite(w)) {  // Only add finite values
-                w2_flat.push_back(w);
-            }
+    for (size_t k = 0; k < size_t(hidden_size * OUTPUT_SIZE); k++) {
+        double w = weights2[k];
+        if (std::isfinite(w)) {  // Only add finite values
+            w2_flat.push_back(w);
         }
     }
     metrics.weights2_saturation = calcSaturation(w2_flat, metrics.weights2_variance);
@@ -568,27 +620,25 @@ std::string NeuralNetwork::getWeightStatsString(int episode, double error, bool
     int weights1_count = 0;
     bool weights1_initialized = false;
     
-    for (const auto& row : weights1) {
-        for (double w : row) {
-            if (std::isfinite(w)) {
-                if (!weights1_initialized) {
-                    weights1_min = weights1_max = w;
-                    weights1_initialized = true;
-                }
-                weights1_mean += w;
-                weights1_min = std::min(weights1_min, w);
-                weights1_max = std::max(weights1_max, w);
-                weights1_count++;
+    for (size_t k = 0; k < weights1Count(); k++) {
+        double w = weights1[k];
+        if (std::isfinite(w)) {
+            if (!weights1_initialized) {
+                weights1_min = weights1_max = w;
+                weights1_initialized = true;
             }
+            weights1_mean += w;
+            weights1_min = std::min(weights1_min, w);
+            weights1_max = std::max(weights1_max, w);
+            weights1_count++;
         }
     }
     if (weights1_count > 0) {
         weights1_mean /= weights1_count;
-        for (const auto& row : weights1) {
-            for (double w : row) {
-                if (std::isfinite(w)) {
-                    weights1_std += (w - weights1_mean) * (w - weights1_mean);
-                }
+        for (size_t k = 0; k < weights1Count(); k++) {
+            double w = weights1[k];
+            if (std::isfinite(w)) {
+                weights1_std += (w - weights1_mean) * (w - weights1_mean);
             }
         }
         weights1_std = std::sqrt(weights1_std / weights1_count);
@@ -599,27 +649,25 @@ std::string NeuralNetwork::getWeightStatsString(int episode, double error, bool
     int weights2_count = 0;
     bool weights2_initialized = false;
     
-    for (const auto& row : weights2) {
-        for (double w : row) {
-            if (std::isfinite(w)) {
-                if (!weights2_initialized) {
-                    weights2_min = weights2_max = w;
-                    weights2_initialized = true;
-                }
-                weights2_mean += w;
-                weights2_min = std::min(weights2_min, w);
-                weights2_max = std::max(weights2_max, w);
-                weights2_count++;
+    for (size_t k = 0; k < size_t(hidden_size * OUTPUT_SIZE); k++) {
+        double w = weights2[k];
+        if (std::isfinite(w)) {
+            if (!weights2_initialized) {
+                weights2_min = weights2_max = w;
+                weights2_initialized = true;
             }
+            weights2_mean += w;
+            weights2_min = std::min(weights2_min, w);
+            weights2_max = std::max(weights2_max, w);
+            weights2_count++;
         }
     }
     if (weights2_count > 0) {
         weights2_mean /= weights2_count;
-        for (const auto& row : weights2) {
-            for (double w : row) {
-                if (std::isfinite(w)) {
-                    weights2_std += (w - weights2_mean) * (w - weights2_mean);
-                }
+        for (size_t k = 0; k < size_t(hidden_size * OUTPUT_SIZE); k++) {
+            double w = weights2[k];
+            if (std::isfinite(w)) {
+                weights2_std += (w - weights2_mean) * (w - weights2_mean);
             }
         }
         weights2_std = std::sqrt(weights2_std / weights2_count);
@@ -628,7 +676,8 @@ std::string NeuralNetwork::getWeightStatsString(int episode, double error, bool
     double bias1_mean = 0.0, bias1_min = 0.0, bias1_max = 0.0;
     int bias1_count = 0;
     bool bias1_initialized = false;
-    for (double b : bias1) {
+    for (size_t k = 0; k < size_t(hidden_size); k++) {
+        double b = bias1[k];
         if (std::isfinite(b)) {
             if (!bias1_initialized) {
                 bias1_min = bias1_max = b;
@@ -664,12 +713,35 @@ std::string NeuralNetwork::getWeightStatsString(int episode, double error, bool
 }
 
 // RL Agent Implementation
-RLAgent::RLAgent(const std::string& model_file) 
-    : epsilon(1.0),
+RLAgent::RLAgent(const std::string& model_file, int hidden_size) 
+    : q_network(hidden_size),
+    quantized_inference(false),
+    replay_buffer(DEFAULT_BUFFER_SIZE),
+    batch_size(DEFAULT_BATCH_SIZE),
+    cold_share(0.0),
+    mirror_augmentation(false),
+    prioritized_replay(false),
+    priority_alpha(0.6),
+    priority_beta(0.4),
+    priority_beta_step(0.0),
+    target_network(hidden_size),
+    target_sync_interval(0),
+    target_tau(0.0),
+    batches_since_target_sync(0),
+    target_network_enabled(false),
+    hogwild_round(0),
+    hogwild_running(0),
+    hogwild_stop(false),
+    producer_stop(false),
+    producer_depth(0),
+    snapshot_interval(0),
+    batches_since_snapshot(0),
+    epsilon(1.0),
     epsilon_min(0.15),        // FIX: Increased from 0.10 to 0.15 for better exploration (prevents premature convergence)
     epsilon_decay(0.9995),    // Slow decay (reaches min in ~9000 games) - allows extensive exploration
     learning_rate(0.001),     // FIX: Reduced from 0.002 to 0.001 (0.003 was too high, causing instability)
     gamma(0.95),              // Standard discount factor (balances immediate and future rewards)
+    n_steps(1),
     training_episodes(0),
     total_games(0),
     best_score(0),
@@ -687,7 +759,8 @@ RLAgent::RLAgent(const std::string& model_file)
     epsilon_at_score_100(-1.0),
     epsilon_at_score_500(-1.0),
     epsilon_at_score_1000(-1.0),
-    recent_batch_errors() {
+    recent_batch_errors(),
+    decision_rng(rand()) {
     // Try to load existing model from specified file
     if (q_network.load(model_file)) {
         model_loaded = true;
@@ -813,65 +886,55 @@ RLAgent::RLAgent(const std::string& model_file)
     }
 }
 
-std::vector<double> RLAgent::extractState(const TetrisGame& game) {
-    // ZERO-BASED REDESIGN: Minimal essential features only (27 total)
-    std::vector<double> state(NeuralNetwork::INPUT_SIZE, 0.0);
-    int idx = 0;
-    
+std::vector<nn_real> RLAgent::extractState(const TetrisGame& game) {
+    // ZERO-BASED REDESIGN: Minimal essential features only (27 total):
+    // 10 column heights, max height, holes, bumpiness, current and next piece one-hot.
+    // Built from the packed form so replayed states and live states always agree
+    std::vector<nn_real> state(NeuralNetwork::INPUT_SIZE, 0.0);
     if (game.current_piece == nullptr) {
         return state;
     }
-    
-    // 1. Column Heights (10 features) - Essential spatial information
-    int max_height = 0;
-    for (int x = 0; x < game.WIDTH; x++) {
-        int height = game.getColumnHeight(x, game.board);
-        max_height = std::max(max_height, height);
-        state[idx++] = height / 20.0;  // Simple normalization [0, 1]
-    }
-    
-    // 2. Board Quality (3 features) - How bad is the board?
-    state[idx++] = max_height / 20.0;  // Max height [0, 1]
-    // FIX: Normalize holes properly - max possible holes = 10 columns × 20 rows = 200
-    int total_holes = game.countHoles(game.board);
-    state[idx++] = std::min(1.0, total_holes / 200.0);  // Total holes [0, 1]
-    // FIX: Normalize bumpiness properly - max possible = 9 gaps × 20 height diff = 180
-    int total_bumpiness = game.calculateBumpiness(game.board);
-    state[idx++] = std::min(1.0, total_bumpiness / 180.0);  // Total bumpiness [0, 1]
-    
-    // 3. Current Piece (7 features) - One-hot encoding
-    for (int i = 0; i < 7; i++) {
-        state[idx++] = (game.current_piece->type == i) ? 1.0 : 0.0;
-    }
-    
-    // 4. Next Piece (7 features) - One-hot encoding
-    if (game.next_piece) {
-        for (int i = 0; i < 7; i++) {
-            state[idx++] = (game.next_piece->type == i) ? 1.0 : 0.0;
-        }
-    } else {
-        for (int i = 0; i < 7; i++) {
-            state[idx++] = 0.0;
-        }
-    }
-    
-    // Total: 10 + 3 + 7 + 7 = 27 features
-    // Removed lines/level - not needed for move selection
-    
+    decodeState(packState(game), state.data());
+    return state;
+}
+
+PackedState RLAgent::packState(const TetrisGame& game) {
+    return packState(game.board, game.current_piece, game.next_piece);
+}
+
+PackedState RLAgent::packState(const std::vector<std::vector<int>>& board, const TetrisPiece* current_piece,
+                               const TetrisPiece* next_piece) {
+    static_assert(PackedState::COLUMNS == TetrisGame::WIDTH && PackedState::ROWS == TetrisGame::HEIGHT,
+                  "PackedState must cover the board");
+    PackedState packed;
+    packed.clear();
+    for (int y = 0; y < TetrisGame::HEIGHT; y++) {
+        for (int x = 0; x < TetrisGame::WIDTH; x++) {
+            if (board[y][x] != 0) packed.setCell(x, y);
+        }
+    }
+    packed.current_piece = current_piece ? int8_t(current_piece->type) : int8_t(-1);
+    packed.next_piece = next_piece ? int8_t(next_piece->type) : int8_t(-1);
+    return packed;
+}
+
+std::vector<nn_real> RLAgent::extractStateFromBoard(const std::vector<std::vector<int>>& sim_board, 
+                                                     int /*lines_cleared*/, int /*level*/, 
+                                                     const TetrisPiece* next_piece) const {
+    std::vector<nn_real> state(NeuralNetwork::INPUT_SIZE, 0.0);
+    extractStateFromBoard(sim_board, next_piece, state.data());
     return state;
 }
 
-std::vector<double> RLAgent::extractStateFromBoard(const std::vector<std::vector<int>>& sim_board, 
-                                                    int /*lines_cleared*/, int /*level*/, 
-                                                    const TetrisPiece* next_piece) const {
+void RLAgent::extractStateFromBoard(const std::vector<std::vector<int>>& sim_board, const TetrisPiece* next_piece,
+                                    nn_real* state) const {
     // ZERO-BASED REDESIGN: Minimal essential features only (27 total)
-    std::vector<double> state(NeuralNetwork::INPUT_SIZE, 0.0);
     int idx = 0;
     const int WIDTH = TetrisGame::WIDTH;
     const int HEIGHT = TetrisGame::HEIGHT;
     
     // 1. Column Heights (10 features) - Essential spatial information
-    std::vector<int> column_heights(WIDTH);
+    int column_heights[TetrisGame::WIDTH];
     int max_height = 0;
     
     for (int x = 0; x < WIDTH; x++) {
@@ -931,11 +994,10 @@ std::vector<double> RLAgent::extractStateFromBoard(const std::vector<std::vector
     
     // Total: 10 + 3 + 7 + 7 = 27 features
     // Removed lines/level - not needed for move selection
-    
-    return state;
 }
 
-RLAgent::Move RLAgent::findBestMove(const TetrisGame& game, bool training) {
+RLAgent::Move RLAgent::findBestMove(const TetrisGame& game, bool training, std::mt19937& rng, DecisionScratch& scratch,
+                                    std::vector<nn_real>* scored_states) const {
     if (game.current_piece == nullptr) {
         return {0, 0, -999999};
     }
@@ -944,12 +1006,12 @@ RLAgent::Move RLAgent::findBestMove(const TetrisGame& game, bool training) {
     TetrisPiece piece = *game.current_piece;
     
     // Epsilon-greedy: explore or exploit
-    bool explore = training && (rand() / (double)RAND_MAX) < epsilon;
+    bool explore = training && std::uniform_real_distribution<double>(0.0, 1.0)(rng) < epsilon;
     
     if (explore) {
         // Random exploration
-        int rot = rand() % 4;
-        int x = rand() % (game.WIDTH + 1) - 2;
+        int rot = std::uniform_int_distribution<int>(0, 3)(rng);
+        int x = std::uniform_int_distribution<int>(-2, game.WIDTH - 2)(rng);
         return {rot, x, 0.0};
     }
     
@@ -961,26 +1023,36 @@ RLAgent::Move RLAgent::findBestMove(const TetrisGame& game, bool training) {
     // Pre-calculate next piece encoding (used in all state extractions)
     const TetrisPiece* next_piece = game.next_piece;
     const int total_lines_cleared = game.lines_cleared;
-    const int current_level = game.level;
+    
+    // Every afterstate shares the next-piece slots and most column features with the
+    // current board, so the first layer is computed once for it and each candidate only
+    // adds the rows of the features it changes. Play-only decisions can use the quantized network
+    const bool use_quantized = quantized_inference && !training;
+    nn_real* next_state = scratch.state.data();
+    if (!use_quantized) {
+        extractStateFromBoard(game.board, next_piece, next_state);
+        q_network.initAccumulator(next_state, scratch.accumulator);
+    }
     
     // Generate move order: try center positions first (more likely to be good)
     // Create ordered list of x positions: center outward, alternating left/right
     // FIX: Alternate left/right to prevent bias towards one side
-    std::vector<int> x_positions;
+    int x_positions[TetrisGame::WIDTH + 4];  // Every x in [-2, WIDTH + 2)
+    int x_count = 0;
     int center = game.WIDTH / 2;
-    x_positions.push_back(center);  // Center first
+    x_positions[x_count++] = center;  // Center first
     for (int offset = 1; offset <= game.WIDTH + 2; offset++) {
         // Alternate left/right to prevent bias
         // Try right first on odd offsets, left first on even offsets
         // This ensures both sides are checked equally at each distance
         if (offset % 2 == 1) {
             // Odd offset: try right first (balance left bias)
-            if (center + offset < game.WIDTH + 2) x_positions.push_back(center + offset);
-            if (center - offset >= -2) x_positions.push_back(center - offset);
+            if (center + offset < game.WIDTH + 2) x_positions[x_count++] = center + offset;
+            if (center - offset >= -2) x_positions[x_count++] = center - offset;
         } else {
             // Even offset: try left first (balance right bias)
-            if (center - offset >= -2) x_positions.push_back(center - offset);
-            if (center + offset < game.WIDTH + 2) x_positions.push_back(center + offset);
+            if (center - offset >= -2) x_positions[x_count++] = center - offset;
+            if (center + offset < game.WIDTH + 2) x_positions[x_count++] = center + offset;
         }
     }
     
@@ -1001,7 +1073,7 @@ RLAgent::Move RLAgent::findBestMove(const TetrisGame& game, bool training) {
         }
         
         // Try positions in order (center outward)
-        for (size_t pos_idx = 0; pos_idx < x_positions.size() && move_evaluations < MAX_EVALUATIONS; pos_idx++) {
+        for (int pos_idx = 0; pos_idx < x_count && move_evaluations < MAX_EVALUATIONS; pos_idx++) {
             int x = x_positions[pos_idx];
             
             // Skip positions where piece would be completely off-board (optimized bounds check)
@@ -1029,7 +1101,7 @@ RLAgent::Move RLAgent::findBestMove(const TetrisGame& game, bool training) {
             
             // Create next state
             std::vector<std::vector<int>> sim_board = game.simulatePlacePiece(piece, piece.y + drop_y);
-            int lines_cleared = game.simulateClearLines(sim_board);
+            game.simulateClearLines(sim_board);
             
             // Relaxed heuristic filter: only skip moves that create excessive holes
             // Let network learn hole avoidance naturally, but filter obviously terrible moves
@@ -1040,12 +1112,15 @@ RLAgent::Move RLAgent::findBestMove(const TetrisGame& game, bool training) {
                 continue;
             }
             
-            // Extract state using optimized helper function
-            std::vector<double> next_state = extractStateFromBoard(
-                sim_board, total_lines_cleared + lines_cleared, current_level, next_piece);
+            // Extract state using optimized helper function (lines and level are not features)
+            extractStateFromBoard(sim_board, next_piece, next_state);
             
-            // Get Q-value from network
-            double q_value = q_network.forward(next_state);
+            // Get Q-value from network (incrementally from the board's accumulator)
+            double q_value = use_quantized ? q_network.forwardQuantized(next_state)
+                                           : q_network.forwardFrom(scratch.accumulator, next_state);
+            if (scored_states) {
+                scored_states->insert(scored_states->end(), next_state, next_state + NeuralNetwork::INPUT_SIZE);
+            }
             
             // Clip Q-value to prevent unbounded growth (new: Q-value clipping)
             const double MAX_Q_VALUE_EVAL = 200.0;
@@ -1081,52 +1156,159 @@ RLAgent::Move RLAgent::findBestMove(const TetrisGame& game, bool training) {
     return best_move;
 }
 
-void RLAgent::addExperience(const Experience& exp) {
-    replay_buffer.push_back(exp);
-    if (replay_buffer.size() > BUFFER_SIZE) {
-        // Remove oldest experience (FIFO)
-        // This ensures we keep recent experiences while maintaining diversity
-        replay_buffer.pop_front();
-    }
-    
-    // Prevent buffer from being dominated by bad experiences
-    // If we have too many game-over experiences, occasionally remove some
-    if (replay_buffer.size() > BUFFER_SIZE / 2) {
-        int game_over_count = 0;
-        for (const auto& e : replay_buffer) {
-            if (e.done) game_over_count++;
-        }
-        // If more than 30% are game-over experiences, remove some old ones
-        if (game_over_count > replay_buffer.size() * 0.3) {
-            // Remove oldest game-over experiences to maintain balance
-            auto it = replay_buffer.begin();
-            int removed = 0;
-            int target_removal = game_over_count / 4;
-            while (it != replay_buffer.end() && removed < target_removal) {
-                if (it->done) {
-                    it = replay_buffer.erase(it);
-                    removed++;
-                } else {
-                    ++it;
-                }
-            }
-        }
+NStepWindow::NStepWindow(int steps) {
+    reset(steps);
+}
+
+void NStepWindow::reset(int steps) {
+    n = std::max(1, steps);
+    pending.clear();
+}
+
+void NStepWindow::push(const Experience& step, double gamma, std::vector<Experience>& out) {
+    pending.push_back(step);
+    // Emit the oldest step once its n-step window is complete, or every step at game over
+    while (!pending.empty() && (int(pending.size()) >= n || step.done)) {
+        Experience emitted = pending.front();
+        double discount = 1.0;
+        emitted.reward = 0.0;
+        for (const Experience& later : pending) {
+            emitted.reward += discount * later.reward;
+            discount *= gamma;
+        }
+        emitted.next_state = pending.back().next_state;
+        emitted.done = step.done;
+        out.push_back(emitted);
+        pending.pop_front();
     }
 }
 
+void RLAgent::addExperience(const Experience& exp) {
+    // Once full, the oldest experience is overwritten (FIFO)
+    // This ensures we keep recent experiences while maintaining diversity
+    // Game-over experiences are not evicted to balance the buffer any more: sampleBatch caps
+    // their share of each batch instead, so adding stays O(1)
+    std::lock_guard<std::mutex> lock(replay_mutex);  // Shared with the batch producer
+    if (cold_replay.isOpen() && replay_buffer.full()) {
+        // The oldest transition moves to the cold tier instead of being lost
+        const size_t oldest = replay_buffer.slot(0);
+        ArchivedTransition spilled;
+        spilled.state = replay_buffer.state(oldest);
+        spilled.next_state = replay_buffer.nextState(oldest);
+        spilled.reward = replay_buffer.reward(oldest);
+        spilled.action_rotation = int8_t(replay_buffer.actionRotation(oldest));
+        spilled.action_x = int8_t(replay_buffer.actionX(oldest));
+        spilled.done = replay_buffer.done(oldest);
+        cold_replay.append(spilled);
+    }
+    replay_buffer.push(exp.state, exp.action_rotation, exp.action_x, exp.reward, exp.next_state, exp.done);
+}
+
 void RLAgent::train() {
-    if (replay_buffer.size() < BATCH_SIZE) return;
+    if (replay_buffer.size() < size_t(batch_size)) return;
+    if (cold_replay.isOpen()) {
+        // One archive block read per call (read ahead by the OS since the last call); the
+        // window is only read while the learners or the producer sample
+        std::lock_guard<std::mutex> lock(replay_mutex);
+        cold_replay.advance();
+    }
     
-    // Constants matching NeuralNetwork::update() - must match exactly
-    const double MAX_ERROR = 25.0;  // Same as in update() function (reduced from 50.0)
-    const double MAX_Q_VALUE = 200.0;  // Maximum Q-value (new: prevent unbounded Q-values)
-    const double MIN_Q_VALUE = -200.0; // Minimum Q-value (new: prevent unbounded Q-values)
+    // Constants matching NeuralNetwork::trainBatch() - must match exactly
+    const double MAX_ERROR = 25.0;  // Same as in trainBatch() (reduced from 50.0)
+    
+    const TrainingBatch* tb = &train_batch;
+    const NeuralNetwork::BatchWorkspace* ws = &train_workspace;
+    int valid_updates = 0;
+    int batches = 1;
+    if (!hogwild_learners.empty()) {
+        // One minibatch per learner, all updating q_network at once; this thread runs learner 0
+        {
+            std::lock_guard<std::mutex> lock(hogwild_mutex);
+            hogwild_running = int(hogwild_pool.size());
+            hogwild_round++;
+        }
+        hogwild_start.notify_all();
+        runHogwildLearner(0);
+        {
+            std::unique_lock<std::mutex> lock(hogwild_mutex);
+            hogwild_done.wait(lock, [this]() { return hogwild_running == 0; });
+        }
+        // Statistics below describe learner 0's batch
+        tb = &hogwild_learners[0].batch;
+        ws = &hogwild_learners[0].workspace;
+        valid_updates = hogwild_learners[0].valid_updates;
+        batches = int(hogwild_learners.size());
+    } else {
+        if (producer_depth > 0) {
+            // Sampled and decoded ahead by the producer thread; the targets use the networks as
+            // they are now
+            startBatchProducer();
+            int index;
+            {
+                std::unique_lock<std::mutex> lock(producer_mutex);
+                producer_filled.wait(lock, [this]() { return !producer_ready.empty(); });
+                index = producer_ready.front();
+                producer_ready.pop_front();
+            }
+            std::swap(train_batch, produced_batches[index]);  // The last batch's storage goes back to be refilled
+            {
+                std::lock_guard<std::mutex> lock(producer_mutex);
+                producer_free.push_back(index);
+            }
+            producer_space.notify_one();
+            computeTargets(train_batch, target_network_enabled ? target_network : q_network, bootstrapDiscount());
+        } else if (target_network_enabled) {
+            // Targets for this batch were computed by the worker from the frozen target network
+            // while the last batch trained and the game ran (see the end of this function)
+            if (!pending_targets.valid()) {
+                sampleBatch(pending_batch);
+                computeTargets(pending_batch, target_network, bootstrapDiscount());
+            } else {
+                pending_targets.get();
+            }
+            std::swap(train_batch, pending_batch);
+        } else {
+            sampleBatch(train_batch);
+            computeTargets(train_batch, q_network, bootstrapDiscount());
+        }
+        
+        // One forward + backward pass over the batch and a single weight update.
+        // The predictions come from the same forward pass, before the update
+        valid_updates = q_network.trainBatch(train_batch.states.data(), train_batch.targets.data(),
+                                             int(train_batch.targets.size()), learning_rate, train_workspace,
+                                             train_batch.weights.empty() ? nullptr : train_batch.weights.data());
+    }
+    
+    if (prioritized_replay) {
+        // Priorities are written here, after every learner finished sampling
+        std::lock_guard<std::mutex> lock(replay_mutex);
+        if (hogwild_learners.empty()) {
+            updatePriorities(train_batch, train_workspace);
+        } else {
+            for (const HogwildLearner& learner : hogwild_learners) {
+                updatePriorities(learner.batch, learner.workspace);
+            }
+        }
+        priority_beta = std::min(1.0, priority_beta + priority_beta_step * batches);
+    }
     
-    // SIMPLIFIED: Uniform random sampling (standard experience replay)
-    std::vector<Experience> batch;
-    for (int i = 0; i < BATCH_SIZE; i++) {
-        int idx = rand() % replay_buffer.size();
-        batch.push_back(replay_buffer[idx]);
+    if (target_network_enabled) {
+        // Refresh the target network; no learner or worker reads it here
+        if (target_tau > 0.0) {
+            target_network.blendParametersFrom(q_network, 1.0 - std::pow(1.0 - target_tau, batches));
+        } else if ((batches_since_target_sync += batches) >= target_sync_interval) {
+            target_network.copyParametersFrom(q_network);
+            batches_since_target_sync = 0;
+        }
+    }
+    if (target_network_enabled && hogwild_learners.empty() && producer_depth == 0) {
+        // Sample the next batch here (rand() and replay_buffer stay on this thread) and
+        // compute its targets in the background
+        sampleBatch(pending_batch);
+        const double discount = bootstrapDiscount();
+        pending_targets = std::async(std::launch::async, [this, discount]() {
+            computeTargets(pending_batch, target_network, discount);
+        });
     }
     
     // IMPROVED: Better error tracking and normalization
@@ -1134,7 +1316,6 @@ void RLAgent::train() {
     double batch_max_error = 0.0;
     double batch_min_error = std::numeric_limits<double>::max();
     double batch_error_sum_sq = 0.0;  // For standard deviation
-    int valid_updates = 0;
     int total_samples = 0;
     int clipped_errors = 0;  // Count how many errors were clipped
     
@@ -1144,24 +1325,10 @@ void RLAgent::train() {
     double min_predicted = std::numeric_limits<double>::max();
     double max_predicted = std::numeric_limits<double>::lowest();
     
-    for (const auto& exp : batch) {
+    for (int i = 0; i < int(tb->targets.size()); i++) {
         total_samples++;
-        
-        // COMPLETE REWRITE: Clean Q-learning update with Q-value clipping
-        // Q-learning target: r + gamma * max Q(s', a')
-        double target = exp.reward;
-        if (!exp.done) {
-            double next_q = q_network.forward(exp.next_state);
-            // Clip Q-value to prevent unbounded growth (new: Q-value clipping)
-            next_q = std::max(MIN_Q_VALUE, std::min(MAX_Q_VALUE, next_q));
-            target += gamma * next_q;
-        }
-        
-        // Clip target Q-value to prevent extreme targets (new: target clipping)
-        target = std::max(MIN_Q_VALUE, std::min(MAX_Q_VALUE, target));
-        
-        // Get current Q-value prediction
-        double predicted = q_network.forward(exp.state);
+        double target = tb->targets[i];
+        double predicted = ws->predictions[i];
         
         // Track ranges
         if (std::isfinite(target)) {
@@ -1182,7 +1349,7 @@ void RLAgent::train() {
             clipped_errors++;
         }
         
-        // Clip error for statistics (same as in update function)
+        // Clip error for statistics (same as in trainBatch)
         double clipped_error = std::max(-MAX_ERROR, std::min(MAX_ERROR, raw_error));
         double abs_clipped_error = std::abs(clipped_error);
         
@@ -1191,12 +1358,6 @@ void RLAgent::train() {
         batch_max_error = std::max(batch_max_error, abs_clipped_error);
         batch_min_error = std::min(batch_min_error, abs_clipped_error);
         batch_error_sum_sq += abs_clipped_error * abs_clipped_error;
-        
-        // Update network if values are finite
-        if (std::isfinite(target) && std::isfinite(predicted)) {
-            q_network.update(exp.state, target, learning_rate);
-            valid_updates++;
-        }
     }
     
     // Calculate statistics
@@ -1217,6 +1378,7 @@ void RLAgent::train() {
                         << " | Max: " << batch_max_error
                         << " | Std: " << error_std
                         << " | Clipped: " << clipped_errors << "/" << total_samples
+                        << " | Updated: " << valid_updates << "/" << total_samples
                         << " | Target Range: [" << min_target << ", " << max_target << "]"
                         << " | Predicted Range: [" << min_predicted << ", " << max_predicted << "]"
                         << std::endl;
@@ -1240,7 +1402,387 @@ void RLAgent::train() {
     
     // Weight changes are now displayed on screen only (no log file)
     
-    training_episodes++;
+    if (policy_snapshots && (batches_since_snapshot += batches) >= snapshot_interval) {
+        if (policy_snapshots->publish(q_network)) {
+            batches_since_snapshot = 0;  // Otherwise readers still hold every buffer: retry next batch
+        }
+    }
+    
+    training_episodes += batches;  // Minibatches trained (one per Hogwild learner)
+}
+
+void RLAgent::sampleBatch(TrainingBatch& batch, std::mt19937* rng) const {
+    const int I = NeuralNetwork::INPUT_SIZE;
+    batch.states.resize(batch_size * I);
+    batch.rewards.resize(batch_size);
+    batch.done.resize(batch_size);
+    batch.slots.resize(batch_size);
+    batch.next_states.clear();
+    auto uniform = [&]() {
+        return rng ? std::uniform_real_distribution<double>(0.0, 1.0)(*rng) : rand() / (RAND_MAX + 1.0);
+    };
+    // Sample i (just decoded, so its next state is the last one) as its mirror image, half the time
+    auto mirror = [&](int i) {
+        if (!mirror_augmentation || uniform() >= 0.5) return;
+        mirrorFeatures(&batch.states[size_t(i) * I]);
+        if (!batch.done[i]) mirrorFeatures(&batch.next_states[batch.next_states.size() - I]);
+    };
+    
+    const size_t cold_window = cold_replay.windowSize();
+    const int cold_samples = cold_window > 0 ? std::min(batch_size - 1, int(batch_size * cold_share + uniform())) : 0;
+    const int hot_samples = batch_size - cold_samples;
+    
+    // Prevent batches from being dominated by bad experiences: game-over transitions get
+    // their share of the buffer (counting merged duplicates), capped at MAX_TERMINAL_SHARE
+    // (randomly rounded to a count)
+    const size_t terminal = replay_buffer.terminalCount();
+    const size_t non_terminal = replay_buffer.nonTerminalCount();
+    double share = double(replay_buffer.transitionCount(true)) / replay_buffer.transitions();
+    if (non_terminal > 0) share = std::min(share, MAX_TERMINAL_SHARE);
+    const int terminal_samples = std::min(hot_samples, int(hot_samples * share + uniform()));
+    
+    // Through the sum-trees with priorities or deduplication; only priorities need IS weights
+    const bool weighted = replay_buffer.weighted();
+    const bool prioritized = prioritized_replay && weighted;
+    if (prioritized) {
+        batch.weights.resize(batch_size);
+    } else {
+        batch.weights.clear();
+    }
+    // First pick the slot of every sample (the batch's index list)
+    double max_weight = 0.0;
+    for (int i = 0; i < hot_samples; i++) {
+        const bool terminal_sample = i < terminal_samples;
+        size_t slot;
+        if (weighted) {
+            // One draw from each of the stratum's equal segments of priority mass
+            const int k = terminal_sample ? i : i - terminal_samples;
+            const int n = terminal_sample ? terminal_samples : hot_samples - terminal_samples;
+            const double total = replay_buffer.priorityTotal(terminal_sample);
+            slot = replay_buffer.findPrioritized(terminal_sample, (k + uniform()) * total / n);
+            if (prioritized) {
+                // Per copy: a merged entry is drawn count times as often as each of its copies
+                const double pool_size = double(replay_buffer.transitionCount(terminal_sample));
+                batch.weights[i] = std::pow(pool_size * replay_buffer.priority(slot) / total, -priority_beta);
+                max_weight = std::max(max_weight, batch.weights[i]);
+            }
+        } else {
+            size_t draw = rng ? (*rng)() : unsigned(rand());
+            slot = terminal_sample ? replay_buffer.terminalSlot(draw % terminal)
+                                   : replay_buffer.nonTerminalSlot(draw % non_terminal);
+        }
+        batch.slots[i] = uint32_t(slot);
+    }
+    
+    // Then read the rows in place and decode them into the batch, with the rows of the sample
+    // PREFETCH_DISTANCE ahead already requested: the scattered reads overlap instead of each
+    // missing the cache in turn
+    const int PREFETCH_DISTANCE = 8;
+    for (int i = 0; i < std::min(PREFETCH_DISTANCE, hot_samples); i++) {
+        replay_buffer.prefetch(batch.slots[i]);
+    }
+    batch.next_states.reserve(size_t(batch_size) * I);
+    for (int i = 0; i < hot_samples; i++) {
+        if (i + PREFETCH_DISTANCE < hot_samples) replay_buffer.prefetch(batch.slots[i + PREFETCH_DISTANCE]);
+        const size_t slot = batch.slots[i];
+        decodeState(replay_buffer.state(slot), &batch.states[size_t(i) * I]);
+        batch.rewards[i] = replay_buffer.reward(slot);
+        batch.done[i] = replay_buffer.done(slot);
+        if (!batch.done[i]) {
+            batch.next_states.resize(batch.next_states.size() + I);
+            decodeState(replay_buffer.nextState(slot), &batch.next_states[batch.next_states.size() - I]);
+        }
+        mirror(i);
+    }
+    for (int i = hot_samples; i < batch_size; i++) {
+        size_t draw = rng ? (*rng)() : unsigned(rand());
+        const ArchivedTransition& cold = cold_replay.sample(draw % cold_window);
+        batch.slots[i] = COLD_SLOT;
+        decodeState(cold.state, &batch.states[size_t(i) * I]);
+        batch.rewards[i] = cold.reward;
+        batch.done[i] = cold.done;
+        if (!batch.done[i]) {
+            batch.next_states.resize(batch.next_states.size() + I);
+            decodeState(cold.next_state, &batch.next_states[batch.next_states.size() - I]);
+        }
+        mirror(i);
+        if (prioritized) {
+            batch.weights[i] = 0.0;  // Archived transitions have no priority: full weight (below)
+        }
+    }
+    for (double& weight : batch.weights) {
+        if (weight == 0.0) weight = max_weight;
+        weight /= max_weight;  // Weights only ever scale updates down
+    }
+}
+
+void RLAgent::updatePriorities(const TrainingBatch& batch, const NeuralNetwork::BatchWorkspace& ws) {
+    const double MAX_ERROR = 25.0;  // Same clipping as trainBatch()
+    for (size_t i = 0; i < batch.slots.size(); i++) {
+        if (batch.slots[i] == COLD_SLOT) continue;
+        double error = std::abs(batch.targets[i] - ws.predictions[i]);
+        if (!std::isfinite(error)) error = 0.0;
+        replay_buffer.setPriority(batch.slots[i], std::pow(std::min(error, MAX_ERROR) + PRIORITY_EPSILON, priority_alpha));
+    }
+}
+
+void RLAgent::enablePrioritizedReplay(double alpha, double beta) {
+    stopBatchProducer();  // Restarted by the next train()
+    replay_buffer.enablePriorities();
+    prioritized_replay = true;
+    priority_alpha = alpha;
+    priority_beta = std::max(0.0, std::min(1.0, beta));
+    priority_beta_step = (1.0 - priority_beta) / PRIORITY_BETA_BATCHES;
+}
+
+void RLAgent::enableReplayDeduplication() {
+    stopBatchProducer();
+    replay_buffer.enableDeduplication();
+}
+
+bool RLAgent::enableColdReplay(const std::string& path, double share, std::string& error) {
+    stopBatchProducer();
+    if (!cold_replay.open(path, error)) return false;
+    cold_share = std::max(0.0, std::min(0.9, share));
+    return true;
+}
+
+void RLAgent::computeTargets(TrainingBatch& batch, const NeuralNetwork& net, double discount) {
+    const double MAX_Q_VALUE = 200.0;  // Maximum Q-value (new: prevent unbounded Q-values)
+    const double MIN_Q_VALUE = -200.0; // Minimum Q-value (new: prevent unbounded Q-values)
+    
+    // One batched forward pass for max Q(s', a') over the non-terminal samples
+    int next_count = batch.next_states.size() / NeuralNetwork::INPUT_SIZE;
+    batch.next_q.resize(next_count);
+    if (next_count > 0) {
+        net.forwardBatch(batch.next_states.data(), next_count, batch.next_q.data());
+    }
+    
+    // COMPLETE REWRITE: Clean Q-learning update with Q-value clipping
+    // Q-learning target: r + gamma * max Q(s', a') (n-step: R + gamma^n * max Q(s_t+n, a'))
+    int count = batch.rewards.size();
+    batch.targets.resize(count);
+    for (int i = 0, next = 0; i < count; i++) {
+        double target = batch.rewards[i];
+        if (!batch.done[i]) {
+            // Clip Q-value to prevent unbounded growth (new: Q-value clipping)
+            double next_q = std::max(MIN_Q_VALUE, std::min(MAX_Q_VALUE, batch.next_q[next++]));
+            target += discount * next_q;
+        }
+        // Clip target Q-value to prevent extreme targets (new: target clipping)
+        batch.targets[i] = std::max(MIN_Q_VALUE, std::min(MAX_Q_VALUE, target));
+    }
+}
+
+void RLAgent::runHogwildLearner(int index) {
+    HogwildLearner& learner = hogwild_learners[index];
+    sampleBatch(learner.batch, &learner.rng);
+    computeTargets(learner.batch, target_network_enabled ? target_network : q_network, bootstrapDiscount());
+    learner.valid_updates = q_network.trainBatch(learner.batch.states.data(), learner.batch.targets.data(),
+                                                 int(learner.batch.targets.size()), learning_rate, learner.workspace,
+                                                 learner.batch.weights.empty() ? nullptr : learner.batch.weights.data());
+}
+
+void RLAgent::hogwildWorkerLoop(int index, long long first_round) {
+    long long seen = first_round;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(hogwild_mutex);
+            hogwild_start.wait(lock, [&]() { return hogwild_stop || hogwild_round != seen; });
+            if (hogwild_stop) return;
+            seen = hogwild_round;
+        }
+        runHogwildLearner(index);
+        {
+            std::lock_guard<std::mutex> lock(hogwild_mutex);
+            if (--hogwild_running == 0) hogwild_done.notify_one();
+        }
+    }
+}
+
+void RLAgent::enableHogwild(int learners) {
+    // Stop the current pool (it is idle between train() calls)
+    {
+        std::lock_guard<std::mutex> lock(hogwild_mutex);
+        hogwild_stop = true;
+    }
+    hogwild_start.notify_all();
+    for (std::thread& thread : hogwild_pool) thread.join();
+    hogwild_pool.clear();
+    hogwild_stop = false;
+    hogwild_learners.clear();
+    if (learners <= 1) return;
+    stopBatchProducer();
+    producer_depth = 0;  // The learners sample their own batches
+    
+    // The learners sample their own batches, so drop a prefetched one
+    if (pending_targets.valid()) pending_targets.get();
+    hogwild_learners.resize(learners);
+    for (HogwildLearner& learner : hogwild_learners) {
+        learner.rng.seed(rand());
+        learner.valid_updates = 0;
+    }
+    for (int index = 1; index < learners; index++) {
+        hogwild_pool.emplace_back(&RLAgent::hogwildWorkerLoop, this, index, hogwild_round);
+    }
+}
+
+RLAgent::~RLAgent() {
+    stopBatchProducer();
+    enableHogwild(0);
+}
+
+void RLAgent::enableBatchProducer(int depth) {
+    stopBatchProducer();
+    producer_depth = hogwild_learners.empty() ? std::max(0, depth) : 0;
+}
+
+void RLAgent::startBatchProducer() {
+    if (producer_depth <= 0 || producer_thread.joinable()) return;
+    if (pending_targets.valid()) pending_targets.get();  // The producer replaces the prefetched batch
+    produced_batches.resize(producer_depth);
+    producer_free.clear();
+    producer_ready.clear();
+    for (int index = 0; index < producer_depth; index++) producer_free.push_back(index);
+    producer_stop = false;
+    producer_thread = std::thread(&RLAgent::batchProducerLoop, this, unsigned(rand()));
+}
+
+void RLAgent::stopBatchProducer() {
+    if (!producer_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(producer_mutex);
+        producer_stop = true;
+    }
+    producer_space.notify_all();
+    producer_thread.join();
+    producer_ready.clear();  // Restarted (with fresh batches) by the next train()
+}
+
+void RLAgent::batchProducerLoop(unsigned seed) {
+    std::mt19937 rng(seed);  // Own generator (rand() belongs to the game thread)
+    for (;;) {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(producer_mutex);
+            producer_space.wait(lock, [this]() { return producer_stop || !producer_free.empty(); });
+            if (producer_stop) return;
+            index = producer_free.back();
+            producer_free.pop_back();
+        }
+        {
+            std::lock_guard<std::mutex> lock(replay_mutex);
+            sampleBatch(produced_batches[index], &rng);
+        }
+        {
+            std::lock_guard<std::mutex> lock(producer_mutex);
+            producer_ready.push_back(index);
+        }
+        producer_filled.notify_one();
+    }
+}
+
+void RLAgent::setBatchSize(int size) {
+    size = std::max(int(MIN_BATCH_SIZE), std::min(int(MAX_BATCH_SIZE), size));
+    if (size == batch_size) return;
+    // Prefetched batches have the old size: drop them, train() samples new ones
+    if (pending_targets.valid()) pending_targets.get();
+    stopBatchProducer();
+    batch_size = size;
+}
+
+bool RLAgent::setReplayCapacity(size_t capacity) {
+    // Sampled batches are copies, so only prefetched batches' slots would go stale
+    if (pending_targets.valid()) pending_targets.get();
+    stopBatchProducer();
+    return replay_buffer.resize(std::max(capacity, size_t(MIN_BUFFER_SIZE)));
+}
+
+size_t RLAgent::replayCapacityForBudget(size_t bytes, bool prioritized, bool deduplicated) {
+    // memoryFor grows with capacity (in steps at powers of two with priorities): binary search
+    size_t low = MIN_BUFFER_SIZE;
+    size_t high = std::max(low, bytes / 32);  // Every transition takes more than 32 bytes
+    while (low < high) {
+        size_t middle = low + (high - low + 1) / 2;
+        if (ReplayBuffer::memoryFor(middle, prioritized, deduplicated) <= bytes) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+int RLAgent::calibrateBatchSize(double seconds) const {
+    const int I = NeuralNetwork::INPUT_SIZE;
+    const int LARGEST = 512;
+    NeuralNetwork scratch(q_network.hidden_size);
+    scratch.copyParametersFrom(q_network);
+    scratch.optimizer.select(q_network.optimizer.type, q_network.hidden_size);
+    NeuralNetwork::BatchWorkspace ws;
+    
+    // Random boards up to half height, as features
+    std::mt19937 gen(12345);
+    std::vector<nn_real> states(size_t(LARGEST) * I), next_states(size_t(LARGEST) * I);
+    for (int n = 0; n < 2 * LARGEST; n++) {
+        PackedState packed;
+        packed.clear();
+        for (int x = 0; x < PackedState::COLUMNS; x++) {
+            for (int y = PackedState::ROWS - int(gen() % 11); y < PackedState::ROWS; y++) packed.setCell(x, y);
+        }
+        packed.current_piece = int8_t(gen() % 7);
+        packed.next_piece = int8_t(gen() % 7);
+        decodeState(packed, (n < LARGEST ? states.data() : next_states.data()) + size_t(n % LARGEST) * I);
+    }
+    std::vector<double> next_q(LARGEST), targets(LARGEST);
+    
+    std::vector<int> sizes;
+    std::vector<double> throughput;  // Samples per second
+    for (int size = 16; size <= LARGEST; size *= 2) {
+        int steps = 0;
+        double elapsed = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        while (steps < 2 || elapsed < seconds) {
+            scratch.forwardBatch(next_states.data(), size, next_q.data());
+            for (int i = 0; i < size; i++) targets[i] = 1.0 + 0.95 * next_q[i];
+            scratch.trainBatch(states.data(), targets.data(), size, 1e-6, ws);
+            steps++;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        sizes.push_back(size);
+        throughput.push_back(double(steps) * size / elapsed);
+    }
+    
+    const double best = *std::max_element(throughput.begin(), throughput.end());
+    int chosen = sizes.back();
+    for (size_t k = sizes.size(); k-- > 0;) {
+        if (throughput[k] >= 0.9 * best) chosen = sizes[k];
+    }
+    std::ofstream logfile("debug.log", std::ios::app);
+    if (logfile.is_open()) {
+        logfile << "[BATCH_SIZE] Calibration (samples/s):";
+        for (size_t k = 0; k < sizes.size(); k++) {
+            logfile << " " << sizes[k] << "=" << int(throughput[k]);
+        }
+        logfile << " | Chosen: " << chosen << std::endl;
+    }
+    return chosen;
+}
+
+void RLAgent::enablePolicySnapshots(int interval) {
+    if (!policy_snapshots) policy_snapshots.reset(new WeightSnapshots());
+    snapshot_interval = std::max(1, interval);
+    batches_since_snapshot = 0;
+    policy_snapshots->publish(q_network);
+}
+
+void RLAgent::enableTargetNetwork(int sync_interval, double tau) {
+    if (pending_targets.valid()) pending_targets.wait();
+    target_network.copyParametersFrom(q_network);
+    target_sync_interval = std::max(1, sync_interval);
+    target_tau = std::max(0.0, std::min(1.0, tau));
+    batches_since_target_sync = 0;
+    target_network_enabled = true;
 }
 
 void RLAgent::updateEpsilonBasedOnPerformance() {
@@ -1,43 +1,147 @@
 #ifndef RL_AGENT_H
 #define RL_AGENT_H
 
+#include <array>
+#include <cmath>
 #include <vector>
 #include <deque>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <string>
+#include <thread>
+#include "nn_kernels.h"
+#include "optimizer.h"
+#include "replay_buffer.h"
 
 // Forward declaration
 class TetrisGame;
 class TetrisPiece;
+class WeightSnapshots;
 
-// Experience for replay buffer
+// Experience for replay buffer (copied into RLAgent::replay_buffer by addExperience)
 struct Experience {
-    std::vector<double> state;
+    PackedState state;       // RLAgent::packState; features are decoded when sampled
     int action_rotation;
     int action_x;
     double reward;
-    std::vector<double> next_state;
+    PackedState next_state;
     bool done;
 };
 
+// Sliding window over one game's one-step experiences that turns them into n-step ones:
+// (s_t, a_t, r_t + gamma r_t+1 + ... + gamma^(n-1) r_t+n-1, s_t+n), emitted once n steps
+// have been seen. At game over every pending step is emitted with its return truncated at
+// the end of the game and done set, so targets never bootstrap past it. With n = 1
+// experiences pass through unchanged
+class NStepWindow {
+public:
+    explicit NStepWindow(int steps = 1);
+    void reset(int steps);  // Drops pending steps
+    int steps() const { return n; }
+    void clear() { pending.clear(); }  // E.g. when a game is abandoned
+    // Add the game's next one-step experience; completed n-step experiences are appended to `out`
+    void push(const Experience& step, double gamma, std::vector<Experience>& out);
+
+private:
+    int n;
+    std::deque<Experience> pending;  // At most n - 1 between calls
+};
+
 // Simple Neural Network for Q-Learning
 class NeuralNetwork {
 public:
-    std::vector<std::vector<double>> weights1;  // Input to hidden
-    std::vector<double> bias1;                  // Hidden bias
-    std::vector<std::vector<double>> weights2;  // Hidden to output
-    std::vector<double> bias2;                  // Output bias
+    // Flat fixed-capacity storage so the SIMD kernels can stream rows (see NetworkView in
+    // nn_kernels.h). Only the first parameter counts for hidden_size are in use.
+    std::array<nn_real, NN_INPUT_SIZE * NN_MAX_HIDDEN_SIZE> weights1;  // Input to hidden: weights1[j * hidden_size + i]
+    std::array<nn_real, NN_MAX_HIDDEN_SIZE> bias1;                     // Hidden bias
+    std::array<nn_real, NN_MAX_HIDDEN_SIZE> weights2;                  // Hidden to output: weights2[i * OUTPUT_SIZE + o]
+    std::array<nn_real, 1> bias2;                                      // Output bias
     
-        static const int INPUT_SIZE = 27;   // ZERO-BASED REDESIGN: 10 heights + 3 board_quality + 7 current + 7 next + 2 game_state
-    static const int HIDDEN_SIZE = 64;
+        static const int INPUT_SIZE = NN_INPUT_SIZE;   // ZERO-BASED REDESIGN: 10 heights + 3 board_quality + 7 current + 7 next + 2 game_state
+    static const int MAX_HIDDEN_SIZE = NN_MAX_HIDDEN_SIZE;
+    static const int DEFAULT_HIDDEN_SIZE = 64;  // Shape of models saved before the "# Shape:" header
     static const int OUTPUT_SIZE = 1;  // Q-value
+    int hidden_size;   // One of NN_HIDDEN_SIZES, set by the constructor or by load()
+    int shape_index;   // Index of hidden_size in NN_HIDDEN_SIZES (selects the kernels)
+    Optimizer optimizer;  // Update rule used by trainBatch; its state is saved with the model
+    
+    explicit NeuralNetwork(int hidden = DEFAULT_HIDDEN_SIZE);
+    nn_accum relu(nn_accum x) const;
+    nn_accum leaky_relu(nn_accum x) const;  // Leaky ReLU to prevent dead neurons
+    // Inference is const and does not allocate, so any number of threads can share one
+    // network as long as nothing trains it at the same time
+    double forward(const nn_real* input) const;
+    double forward(const std::vector<nn_real>& input) const { return forward(input.data()); }
+    void forwardBatch(const nn_real* inputs, int count, double* q_values) const;  // Rows of INPUT_SIZE values
+    NetworkView view() const;
+    const NNKernels& kernels() const { return nnKernels(shape_index); }
+    
+    // Incremental first layer (NNUE style) for scoring many inputs that differ from a
+    // reference input in a few features, e.g. afterstates of one board: the hidden
+    // pre-activations of the reference are computed once, then each input only adds the
+    // weight rows of the features that changed. Same Q-values as forward() up to rounding
+    struct Accumulator {
+        std::array<nn_real, NN_INPUT_SIZE> input;                // Reference input
+        std::array<nn_accum, NN_MAX_HIDDEN_SIZE> pre_activation;  // Its hidden pre-activations
+    };
+    void initAccumulator(const nn_real* input, Accumulator& acc) const;
+    double forwardFrom(const Accumulator& acc, const nn_real* input) const;  // Clipped Q-value
+    
+    // Fixed-point copy of the parameters for fast move selection (see QuantizedView in nn_kernels.h).
+    // Rebuilt by quantize(), which the constructor, load() and save() call; training does not
+    // touch it, so it holds the network as of the last load or save
+    struct QuantizedParameters {
+        std::array<int16_t, NN_INPUT_PAIRS * 2 * NN_MAX_HIDDEN_SIZE> weights1;
+        std::array<int32_t, NN_MAX_HIDDEN_SIZE> bias1;
+        std::array<float, NN_MAX_HIDDEN_SIZE> weights2;
+        float bias2;
+        double weight_scale;  // Quantized weight = round(weight * weight_scale), one scale for weights1
+    };
+    QuantizedParameters quantized;
+    void quantize();
+    QuantizedView quantizedView() const;
+    double forwardQuantized(const nn_real* input) const;  // Clipped Q-value from the quantized copy
     
-    NeuralNetwork();
-    double relu(double x) const;
-    double leaky_relu(double x) const;  // Leaky ReLU to prevent dead neurons
-    double forward(const std::vector<double>& input);
-    void update(const std::vector<double>& input, double target, double learning_rate);
+    // Scratch space for trainBatch, owned by the caller so repeated batches don't allocate
+    struct BatchWorkspace {
+        std::vector<nn_real> clean_states;     // Copy of the inputs with non-finite values zeroed
+        std::vector<double> predictions;       // Clipped Q(s) from trainBatch's forward pass
+        std::vector<nn_accum> outputs;         // Raw network outputs
+        std::vector<nn_accum> pre_activations; // count * hidden_size, reused as hidden deltas
+        std::vector<nn_accum> errors;          // Clipped output error per sample (0 for skipped samples)
+        std::vector<nn_accum> grad_weights1;   // Gradient sums over the batch, same layout as the weights
+        std::vector<nn_accum> grad_bias1;
+        std::vector<nn_accum> grad_weights2;
+    };
+    
+    // One minibatch step: a batched forward pass over `count` states (rows of INPUT_SIZE),
+    // gradients summed over the batch, then a single clipped weight update.
+    // Fills ws.predictions and returns the number of samples that contributed
+    // (samples with a non-finite target or prediction are skipped)
+    // sample_weights (optional, one per sample) scale each clipped error, e.g. importance-sampling weights
+    int trainBatch(const nn_real* states, const double* targets, int count, double learning_rate,
+                   BatchWorkspace& ws, const double* sample_weights = nullptr);
+    void update(const std::vector<nn_real>& input, double target, double learning_rate);  // trainBatch with one sample
+    // Target network support: copy (hard sync) or Polyak-average the parameters of another
+    // network of any shape; the optimizer state is left alone
+    void copyParametersFrom(const NeuralNetwork& other);
+    void blendParametersFrom(const NeuralNetwork& other, double tau);  // this = (1 - tau) * this + tau * other
     void save(const std::string& filename);
-    bool load(const std::string& filename);
+    bool load(const std::string& filename);  // Adopts the shape from the file's "# Shape:" header
+                                             // and restores the optimizer state if present
+    // Read the first `count` parameter values of a model file at full precision
+    // (shared by load() and the precision check, which needs the double values)
+    static bool readParameters(const std::string& filename, size_t count, std::vector<double>& values);
+    // Hidden size from the model file's "# Shape: 27xH" header (DEFAULT_HIDDEN_SIZE for older
+    // files without one), or -1 if the file cannot be opened or the shape is not supported
+    static int readHiddenSize(const std::string& filename);
+    static size_t parameterCount(int hidden) { return INPUT_SIZE * hidden + hidden + hidden * OUTPUT_SIZE + OUTPUT_SIZE; }
+    size_t parameterCount() const { return parameterCount(hidden_size); }
+    size_t weights1Count() const { return size_t(INPUT_SIZE) * hidden_size; }
+    static constexpr double LOAD_WEIGHT_LIMIT = 20.0;  // Loaded values are clipped to 80% of MAX_WEIGHT (25.0)
     void logWeightChanges(const std::string& filename, int episode, double error);
     std::string getWeightStatsString(int episode, double error, bool is_learning = true);  // Get stats as string for display
     
@@ -59,15 +163,119 @@ public:
 class RLAgent {
 public:
     NeuralNetwork q_network;
-    std::deque<Experience> replay_buffer;
-    static const int BUFFER_SIZE = 10000;
-    static const int BATCH_SIZE = 32;
+    NeuralNetwork::BatchWorkspace train_workspace;  // Reused by train() every batch
+    bool quantized_inference;  // Non-training moves are scored with the quantized copy of q_network
+    ReplayBuffer replay_buffer;  // DEFAULT_BUFFER_SIZE transitions unless resized, preallocated
+    static const int DEFAULT_BUFFER_SIZE = 10000;
+    static const int MIN_BUFFER_SIZE = 1000;
+    static constexpr double MAX_TERMINAL_SHARE = 0.3;  // Of each minibatch (see sampleBatch)
+    int batch_size;                                     // Samples per minibatch (setBatchSize)
+    static const int DEFAULT_BATCH_SIZE = 32;
+    static const int MIN_BATCH_SIZE = 8;
+    static const int MAX_BATCH_SIZE = 1024;
+    
+    // Optional cold tier (enableColdReplay): transitions overwritten in replay_buffer are
+    // appended to an on-disk archive, and cold_share of each minibatch is drawn from the
+    // archive blocks loaded into memory (one more block per train() call, see ReplayArchive)
+    ReplayArchive cold_replay;
+    double cold_share;
+    static constexpr double DEFAULT_COLD_SHARE = 0.25;
+    
+    // Mirror augmentation: each sampled transition is replaced by its left-right mirror image
+    // (see mirrorFeatures) with probability 1/2, so every stored move also trains its mirrored
+    // twin at no extra memory or batch cost
+    bool mirror_augmentation;
+    
+    // A sampled minibatch, copied out of the replay buffer so its targets can be computed
+    // on another thread while the game keeps adding experiences
+    struct TrainingBatch {
+        std::vector<nn_real> states;       // batch_size * INPUT_SIZE
+        std::vector<double> rewards;
+        std::vector<char> done;
+        std::vector<nn_real> next_states;  // Non-terminal samples only
+        std::vector<double> next_q;        // max Q(s', a') for next_states
+        std::vector<double> targets;       // r + gamma^n_steps * next_q, clipped
+        std::vector<uint32_t> slots;       // replay_buffer slot of each sample (COLD_SLOT: from cold_replay)
+        std::vector<double> weights;       // Importance-sampling weights (prioritized replay only, else empty)
+    };
+    TrainingBatch train_batch;
+    static const uint32_t COLD_SLOT = 0xffffffffu;
+    
+    // Optional prioritized replay (enablePrioritizedReplay): within each stratum samples are
+    // drawn in proportion to priority = (|TD error| + PRIORITY_EPSILON)^alpha, refreshed from
+    // the errors of every trained batch. Importance-sampling weights (N * P(i))^-beta,
+    // normalised by the batch maximum, scale each sample's error in the update; beta is
+    // annealed to 1 over PRIORITY_BETA_BATCHES minibatches
+    bool prioritized_replay;
+    double priority_alpha;
+    double priority_beta;
+    double priority_beta_step;
+    static constexpr double PRIORITY_EPSILON = 0.01;
+    static const int PRIORITY_BETA_BATCHES = 100000;
+    
+    // Optional frozen target network for the Q-learning targets. Off by default (the online
+    // network computes them); see enableTargetNetwork. While it is on, the next batch is
+    // sampled at the end of train() and its targets are computed on a worker thread
+    NeuralNetwork target_network;
+    int target_sync_interval;        // Hard copy every N batches (used when target_tau is 0)
+    double target_tau;               // Polyak averaging weight per batch (0 = hard sync)
+    int batches_since_target_sync;
+    bool target_network_enabled;
+    TrainingBatch pending_batch;     // Next batch; owned by the worker until pending_targets is ready
+    std::future<void> pending_targets;  // Declared after what the worker uses, so it is joined first
+    
+    // Optional Hogwild training (enableHogwild): each train() call runs one minibatch per
+    // learner, on this thread and a pool of worker threads, and every learner applies its
+    // update to q_network's parameters in place without locks. Updates race with each
+    // other and with the other learners' forward passes; the network is small and the
+    // gradients sparse, so occasionally lost or stale updates still converge. replay_buffer
+    // is only read while the learners run: train() returns after all of them finish
+    struct HogwildLearner {
+        TrainingBatch batch;
+        NeuralNetwork::BatchWorkspace workspace;
+        std::mt19937 rng;          // Own generator (rand() is shared state)
+        int valid_updates;
+    };
+    std::vector<HogwildLearner> hogwild_learners;  // Empty when off; [0] runs on the calling thread
+    std::vector<std::thread> hogwild_pool;         // Learners 1..N-1
+    std::mutex hogwild_mutex;
+    std::condition_variable hogwild_start;
+    std::condition_variable hogwild_done;
+    long long hogwild_round;   // Bumped by train() to start the pool on a round
+    int hogwild_running;       // Pool learners still busy in the current round
+    bool hogwild_stop;
+    
+    // Optional background batch producer (enableBatchProducer): a thread keeps up to
+    // producer_depth minibatches sampled and decoded ahead, so train() only computes the
+    // targets and runs the update. While it runs, replay_buffer and cold_replay are only
+    // touched under replay_mutex. A batch may be a few pushes old when it is trained (its
+    // priorities then land on whatever those slots hold by now). Not used with Hogwild:
+    // the learners sample their own batches
+    std::vector<TrainingBatch> produced_batches;  // producer_depth batches, recycled via train_batch
+    std::vector<int> producer_free;               // Indices to fill
+    std::deque<int> producer_ready;               // Filled, oldest first
+    std::mutex producer_mutex;
+    std::condition_variable producer_space;
+    std::condition_variable producer_filled;
+    std::thread producer_thread;
+    bool producer_stop;
+    int producer_depth;    // 0 = off
+    std::mutex replay_mutex;
+    
+    // Read-only copies of q_network for actor threads (see weight_snapshot.h), published every
+    // snapshot_interval minibatches once enablePolicySnapshots has been called. Publishing
+    // happens at the end of train(), when no learner is writing the weights
+    std::unique_ptr<WeightSnapshots> policy_snapshots;
+    int snapshot_interval;
+    int batches_since_snapshot;
     
     double epsilon;           // Exploration rate
     double epsilon_min;
     double epsilon_decay;
     double learning_rate;
     double gamma;             // Discount factor
+    int n_steps;              // Steps per stored return (see NStepWindow); experiences must match
+    double bootstrapDiscount() const { return std::pow(gamma, n_steps); }
     
         int training_episodes;
         int total_games;
@@ -111,22 +319,86 @@ public:
         double q_value;
     };
     
-    RLAgent(const std::string& model_file = "tetris_model.txt");  // Allow custom model file
+    // Working memory for one game thread's findBestMove calls. The agent is only read while
+    // choosing a move, so any number of games can share one agent, each with its own scratch
+    // and generator
+    struct DecisionScratch {
+        NeuralNetwork::Accumulator accumulator;                 // Current board's first layer
+        std::array<nn_real, NeuralNetwork::INPUT_SIZE> state;  // Afterstate being scored
+    };
+    DecisionScratch decision_scratch;  // Used by the single-game findBestMove overload
+    std::mt19937 decision_rng;         // Its exploration generator (seeded from rand())
+    
+    // hidden_size applies to a fresh network; a loaded model keeps the shape saved in its file
+    RLAgent(const std::string& model_file = "tetris_model.txt",
+            int hidden_size = NeuralNetwork::DEFAULT_HIDDEN_SIZE);  // Allow custom model file
+    ~RLAgent();  // Joins the Hogwild pool
     
-    // Extract state features from game
-    std::vector<double> extractState(const TetrisGame& game);
+    // Extract state features from game (decodeState of packState)
+    std::vector<nn_real> extractState(const TetrisGame& game);
+    // Compact form of the board and pieces, as stored in the replay buffer
+    static PackedState packState(const TetrisGame& game);
+    static PackedState packState(const std::vector<std::vector<int>>& board, const TetrisPiece* current_piece,
+                                 const TetrisPiece* next_piece);
     
     // Extract state features from simulated board (helper for findBestMove)
-    std::vector<double> extractStateFromBoard(const std::vector<std::vector<int>>& sim_board, 
+    std::vector<nn_real> extractStateFromBoard(const std::vector<std::vector<int>>& sim_board, 
                                               int lines_cleared, int level, 
                                               const TetrisPiece* next_piece) const;
+    void extractStateFromBoard(const std::vector<std::vector<int>>& sim_board, const TetrisPiece* next_piece,
+                               nn_real* state) const;  // Writes INPUT_SIZE values
     
-    // Find best move using Q-learning
-    Move findBestMove(const TetrisGame& game, bool training = false);
+    // Find best move using Q-learning (epsilon-greedy when training, exploring with rng).
+    // When scored_states is not null, every afterstate that was scored is appended to it
+    // (INPUT_SIZE values each), e.g. to record a position corpus
+    Move findBestMove(const TetrisGame& game, bool training, std::mt19937& rng, DecisionScratch& scratch,
+                      std::vector<nn_real>* scored_states = nullptr) const;
+    // Same with the agent's own scratch and generator, for the single game of the UI
+    Move findBestMove(const TetrisGame& game, bool training = false,
+                      std::vector<nn_real>* scored_states = nullptr) {
+        return findBestMove(game, training, decision_rng, decision_scratch, scored_states);
+    }
     
     // Experience replay
     void addExperience(const Experience& exp);
     void train();
+    void enableTargetNetwork(int sync_interval, double tau);  // tau > 0: Polyak, else copy every sync_interval batches
+    void enablePrioritizedReplay(double alpha, double beta);  // e.g. 0.6, 0.4
+    bool enableColdReplay(const std::string& path, double share, std::string& error);  // share capped at 0.9
+    void enableReplayDeduplication();  // See ReplayBuffer::enableDeduplication
+    // Rewrites the sampled slots' priorities from the batch's clipped |TD error|; cold-tier samples are skipped
+    void updatePriorities(const TrainingBatch& batch, const NeuralNetwork::BatchWorkspace& ws);
+    // Stratified sample copied out of replay_buffer (rand() without rng): game-over transitions
+    // fill their share of the buffer, at most MAX_TERMINAL_SHARE, of the batch; the rest are
+    // non-terminal. Uniform within each stratum, or by priority with prioritized replay (and
+    // by duplicate count with deduplication).
+    // With a cold tier its share of the batch (rounded randomly) comes last, uniform over the
+    // archive window. With mirror_augmentation about half the samples are mirrored
+    void sampleBatch(TrainingBatch& batch, std::mt19937* rng = nullptr) const;
+    void enableHogwild(int learners);  // Learners per train() call; 1 or less turns it off
+    void enableBatchProducer(int depth);  // Batches kept ready (e.g. 2); 0 turns it off. Ignored with Hogwild
+    void startBatchProducer();  // Called by train() once the buffer holds a batch
+    void stopBatchProducer();   // Joins the thread and drops its batches
+    void batchProducerLoop(unsigned seed);
+    
+    // Runtime sizes, changed between train() calls (a batch whose targets are being computed
+    // in the background is waited for and sampled again)
+    void setBatchSize(int size);  // Clamped to [MIN_BATCH_SIZE, MAX_BATCH_SIZE]
+    // Keeps the newest transitions (at least MIN_BUFFER_SIZE slots); false for a replay file
+    bool setReplayCapacity(size_t capacity);
+    // Largest capacity whose replay storage (see ReplayBuffer::memoryFor) fits in `bytes`
+    static size_t replayCapacityForBudget(size_t bytes, bool prioritized, bool deduplicated = false);
+    // Batch size for this machine: times training steps (targets for the next states and one
+    // update, on a scratch copy of q_network) at sizes from 16 to 512 for `seconds` each and
+    // returns the smallest within 10% of the best samples per second, since past that point
+    // larger batches mostly cost updates. Results go to debug.log; the agent is not changed
+    int calibrateBatchSize(double seconds = 0.15) const;
+    void enablePolicySnapshots(int interval);  // Publishes q_network now and every `interval` batches
+    int hogwildLearners() const { return hogwild_learners.empty() ? 1 : int(hogwild_learners.size()); }
+    void runHogwildLearner(int index);
+    void hogwildWorkerLoop(int index, long long first_round);
+    // discount = gamma^n_steps (see bootstrapDiscount)
+    static void computeTargets(TrainingBatch& batch, const NeuralNetwork& net, double discount);
     void updateEpsilonBasedOnPerformance();  // Adaptive epsilon based on score improvement
     bool checkConvergence();  // Check if network has converged
     void saveModel();
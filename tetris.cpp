@@ -23,422 +23,9 @@
 #include "rl_agent.h"
 #include "parameter_tuner.h"
 #include "game_classes.h"
+#include "diagnostics.h"
+#include "training_session.h"
 
-// Debug logging function
-void debugLog(const std::string& message) {
-    static std::ofstream debug_file("debug.log", std::ios::app);
-    if (debug_file.is_open()) {
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        debug_file << "[" << time_t << "] " << message << "\n";
-        debug_file.flush();
-    }
-}
-
-// Tetris pieces (tetrominoes) - each piece is defined by its shape
-// Format: [rotations][y][x] where each rotation is a 4x4 grid
-const int PIECES[7][4][4][4] = {
-    // I piece
-    {
-        {{0,0,0,0}, {1,1,1,1}, {0,0,0,0}, {0,0,0,0}},
-        {{0,0,1,0}, {0,0,1,0}, {0,0,1,0}, {0,0,1,0}},
-        {{0,0,0,0}, {0,0,0,0}, {1,1,1,1}, {0,0,0,0}},
-        {{0,1,0,0}, {0,1,0,0}, {0,1,0,0}, {0,1,0,0}}
-    },
-    // O piece
-    {
-        {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}},
-        {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}},
-        {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}},
-        {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}}
-    },
-    // T piece
-    {
-        {{0,0,0,0}, {0,1,0,0}, {1,1,1,0}, {0,0,0,0}},
-        {{0,0,0,0}, {0,1,0,0}, {0,1,1,0}, {0,1,0,0}},
-        {{0,0,0,0}, {0,0,0,0}, {1,1,1,0}, {0,1,0,0}},
-        {{0,0,0,0}, {0,1,0,0}, {1,1,0,0}, {0,1,0,0}}
-    },
-    // S piece
-    {
-        {{0,0,0,0}, {0,1,1,0}, {1,1,0,0}, {0,0,0,0}},
-        {{0,0,0,0}, {0,1,0,0}, {0,1,1,0}, {0,0,1,0}},
-        {{0,0,0,0}, {0,0,0,0}, {0,1,1,0}, {1,1,0,0}},
-        {{0,0,0,0}, {1,0,0,0}, {1,1,0,0}, {0,1,0,0}}
-    },
-    // Z piece
-    {
-        {{0,0,0,0}, {1,1,0,0}, {0,1,1,0}, {0,0,0,0}},
-        {{0,0,0,0}, {0,0,1,0}, {0,1,1,0}, {0,1,0,0}},
-        {{0,0,0,0}, {0,0,0,0}, {1,1,0,0}, {0,1,1,0}},
-        {{0,0,0,0}, {0,1,0,0}, {1,1,0,0}, {1,0,0,0}}
-    },
-    // J piece
-    {
-        {{0,0,0,0}, {1,0,0,0}, {1,1,1,0}, {0,0,0,0}},
-        {{0,0,0,0}, {0,1,1,0}, {0,1,0,0}, {0,1,0,0}},
-        {{0,0,0,0}, {0,0,0,0}, {1,1,1,0}, {0,0,1,0}},
-        {{0,0,0,0}, {0,1,0,0}, {0,1,0,0}, {1,1,0,0}}
-    },
-    // L piece
-    {
-        {{0,0,0,0}, {0,0,1,0}, {1,1,1,0}, {0,0,0,0}},
-        {{0,0,0,0}, {0,1,0,0}, {0,1,0,0}, {0,1,1,0}},
-        {{0,0,0,0}, {0,0,0,0}, {1,1,1,0}, {1,0,0,0}},
-        {{0,0,0,0}, {1,1,0,0}, {0,1,0,0}, {0,1,0,0}}
-    }
-};
-
-// Colors for each piece type
-const int PIECE_COLORS[7] = {
-    1,  // I - Cyan
-    2,  // O - Yellow
-    3,  // T - Magenta
-    4,  // S - Green
-    5,  // Z - Red
-    6,  // J - Blue
-    7   // L - White
-};
-
-// Class definitions are in game_classes.h
-// Implementations below:
-
-TetrisPiece::TetrisPiece(int piece_type, int x, int y) 
-    : type(piece_type), x(x), y(y), rotation(0), color(PIECE_COLORS[piece_type]) {}
-
-void TetrisPiece::getShape(int shape[4][4]) const {
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            shape[i][j] = PIECES[type][rotation][i][j];
-        }
-    }
-}
-
-void TetrisPiece::rotate() {
-    rotation = (rotation + 1) % 4;
-}
-
-std::vector<Point> TetrisPiece::getBlocks() const {
-    std::vector<Point> blocks;
-    int shape[4][4];
-    getShape(shape);
-    for (int dy = 0; dy < 4; dy++) {
-        for (int dx = 0; dx < 4; dx++) {
-            if (shape[dy][dx]) {
-                blocks.push_back(Point(x + dx, y + dy));
-            }
-        }
-    }
-    return blocks;
-}
-
-TetrisGame::TetrisGame() 
-    : board(HEIGHT, std::vector<int>(WIDTH, 0)),
-      current_piece(nullptr),
-      next_piece(nullptr),
-      score(0),
-      lines_cleared(0),
-      level(1),
-      game_over(false),
-      paused(false),
-      ai_enabled(false),
-      training_mode(false),
-      last_score(0),
-      last_lines(0),
-      fall_delay(0.5),
-      last_fall_time(std::chrono::steady_clock::now()),
-      last_ai_time(std::chrono::steady_clock::now()) {
-    spawnPiece();
-}
-
-TetrisGame::~TetrisGame() {
-    // Only delete if pointers are different to avoid double deletion
-    if (current_piece != nullptr) {
-        delete current_piece;
-        current_piece = nullptr;
-    }
-    if (next_piece != nullptr && next_piece != current_piece) {
-        delete next_piece;
-        next_piece = nullptr;
-    }
-}
-
-void TetrisGame::spawnPiece() {
-    // Delete old current_piece if it exists (shouldn't happen, but safety check)
-    if (current_piece != nullptr && current_piece != next_piece) {
-        delete current_piece;
-    }
-    
-    if (next_piece == nullptr) {
-        int piece_type = rand() % 7;
-        next_piece = new TetrisPiece(piece_type);
-    }
-    
-    // Take ownership of next_piece
-    current_piece = next_piece;
-    next_piece = nullptr;  // Clear next_piece so we don't double-delete
-    
-    current_piece->x = WIDTH / 2 - 2;
-    current_piece->y = 0;
-    
-    // Check if game over
-    if (checkCollision(*current_piece)) {
-        game_over = true;
-    }
-    
-    // Generate next piece
-    int piece_type = rand() % 7;
-    next_piece = new TetrisPiece(piece_type);
-}
-
-bool TetrisGame::checkCollision(const TetrisPiece& piece, int dx, int dy) const {
-        std::vector<Point> blocks = piece.getBlocks();
-        for (const auto& block : blocks) {
-            int nx = block.x + dx;
-            int ny = block.y + dy;
-            // Check boundaries
-            if (nx < 0 || nx >= WIDTH || ny >= HEIGHT) {
-                return true;
-            }
-            // Check placed blocks (only check if within board)
-            if (ny >= 0 && board[ny][nx] != 0) {
-                return true;
-        }
-    }
-    return false;
-}
-
-void TetrisGame::placePiece() {
-        if (current_piece == nullptr) return;
-        
-        std::vector<Point> blocks = current_piece->getBlocks();
-        for (const auto& block : blocks) {
-            if (block.y >= 0 && block.y < HEIGHT && block.x >= 0 && block.x < WIDTH) {
-                board[block.y][block.x] = current_piece->color;
-            }
-        }
-        
-        // Clear lines
-        int cleared = clearLines();
-        lines_cleared += cleared;
-        
-        // Update score
-        if (cleared > 0) {
-            int points[] = {0, 100, 300, 500, 800};
-            score += points[std::min(cleared, 4)] * level;
-        }
-        
-        // Update level (every 10 lines)
-        level = lines_cleared / 10 + 1;
-        fall_delay = std::max(0.05, 0.5 - (level - 1) * 0.05);
-        
-    delete current_piece;
-    current_piece = nullptr;
-}
-
-int TetrisGame::clearLines() {
-    std::vector<int> lines_to_clear;
-    for (int y = 0; y < HEIGHT; y++) {
-        bool full = true;
-        for (int x = 0; x < WIDTH; x++) {
-            if (board[y][x] == 0) {
-                full = false;
-                break;
-            }
-        }
-        if (full) {
-            lines_to_clear.push_back(y);
-        }
-    }
-    
-    // Remove lines from bottom to top
-    for (auto it = lines_to_clear.rbegin(); it != lines_to_clear.rend(); ++it) {
-        board.erase(board.begin() + *it);
-        board.insert(board.begin(), std::vector<int>(WIDTH, 0));
-    }
-    
-    return lines_to_clear.size();
-}
-
-bool TetrisGame::movePiece(int dx, int dy) {
-    if (current_piece == nullptr) return false;
-    
-    if (!checkCollision(*current_piece, dx, dy)) {
-        current_piece->x += dx;
-        current_piece->y += dy;
-        return true;
-    }
-    return false;
-}
-
-bool TetrisGame::rotatePiece() {
-        if (current_piece == nullptr) return false;
-        
-        int old_rotation = current_piece->rotation;
-        current_piece->rotate();
-        
-        if (checkCollision(*current_piece)) {
-            // Try wall kicks
-            int kicks[] = {-1, 1, -2, 2};
-            for (int dx : kicks) {
-                if (!checkCollision(*current_piece, dx, 0)) {
-                    current_piece->x += dx;
-                    return true;
-                }
-            }
-            // Rotation failed, revert
-            current_piece->rotation = old_rotation;
-            return false;
-        }
-        return true;
-}
-
-void TetrisGame::hardDrop() {
-    if (current_piece == nullptr) return;
-    
-    // Safety limit to prevent infinite loop
-    int drop_attempts = 0;
-    while (movePiece(0, 1) && drop_attempts < HEIGHT * 2) {
-        score += 2;  // Bonus points for hard drop
-        drop_attempts++;
-    }
-    if (drop_attempts >= HEIGHT * 2) {
-        // Safety: force place piece if stuck
-        placePiece();
-        spawnPiece();
-        return;
-    }
-    placePiece();
-    spawnPiece();
-}
-
-void TetrisGame::update() {
-    if (game_over || paused) return;
-    
-    auto current_time = std::chrono::steady_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-        current_time - last_fall_time).count() / 1000.0;
-    
-    if (elapsed >= fall_delay) {
-        if (current_piece == nullptr) {
-            spawnPiece();
-        } else if (!movePiece(0, 1)) {
-            placePiece();
-            spawnPiece();
-        }
-        last_fall_time = current_time;
-    }
-}
-
-void TetrisGame::executeAIMove(int rotation, int x_pos) {
-    if (current_piece == nullptr) return;
-    
-    // Rotate to desired rotation (with safety limit)
-    int rotation_attempts = 0;
-    while (current_piece->rotation != rotation && rotation_attempts < 10) {
-        rotatePiece();
-        rotation_attempts++;
-    }
-    if (rotation_attempts >= 10) {
-        // Debug: rotation stuck
-        static int debug_count = 0;
-        if (debug_count++ % 100 == 0) {
-            // Could log to file or screen, but avoiding I/O for now
-        }
-    }
-    
-    // Move to desired x position (with safety limits)
-    int target_x = x_pos;
-    int move_attempts = 0;
-    while (current_piece->x < target_x && movePiece(1, 0) && move_attempts < WIDTH * 2) {
-        move_attempts++;
-    }
-    move_attempts = 0;
-    while (current_piece->x > target_x && movePiece(-1, 0) && move_attempts < WIDTH * 2) {
-        move_attempts++;
-    }
-    
-    // Hard drop
-    hardDrop();
-}
-
-std::vector<std::vector<int>> TetrisGame::simulatePlacePiece(const TetrisPiece& piece, int drop_y) const {
-        std::vector<std::vector<int>> sim_board = board;
-        std::vector<Point> blocks = piece.getBlocks();
-        for (const auto& block : blocks) {
-            int y = block.y + drop_y - piece.y;
-            int x = block.x;
-            if (y >= 0 && y < HEIGHT && x >= 0 && x < WIDTH) {
-                sim_board[y][x] = piece.color;
-            }
-        }
-    return sim_board;
-}
-
-int TetrisGame::simulateClearLines(std::vector<std::vector<int>>& sim_board) const {
-        std::vector<int> lines_to_clear;
-        for (int y = 0; y < HEIGHT; y++) {
-            bool full = true;
-            for (int x = 0; x < WIDTH; x++) {
-                if (sim_board[y][x] == 0) {
-                    full = false;
-                    break;
-                }
-            }
-            if (full) {
-                lines_to_clear.push_back(y);
-            }
-        }
-        
-        for (auto it = lines_to_clear.rbegin(); it != lines_to_clear.rend(); ++it) {
-            sim_board.erase(sim_board.begin() + *it);
-            sim_board.insert(sim_board.begin(), std::vector<int>(WIDTH, 0));
-        }
-        
-    return lines_to_clear.size();
-}
-
-int TetrisGame::getColumnHeight(int x, const std::vector<std::vector<int>>& sim_board) const {
-        for (int y = 0; y < HEIGHT; y++) {
-            if (sim_board[y][x] != 0) {
-                return HEIGHT - y;
-            }
-        }
-    return 0;
-}
-
-int TetrisGame::countHoles(const std::vector<std::vector<int>>& sim_board) const {
-        int holes = 0;
-        for (int x = 0; x < WIDTH; x++) {
-            bool block_found = false;
-            for (int y = 0; y < HEIGHT; y++) {
-                if (sim_board[y][x] != 0) {
-                    block_found = true;
-                } else if (block_found) {
-                    holes++;
-                }
-            }
-        }
-    return holes;
-}
-
-int TetrisGame::calculateBumpiness(const std::vector<std::vector<int>>& sim_board) const {
-        int bumpiness = 0;
-        for (int x = 0; x < WIDTH - 1; x++) {
-            int h1 = getColumnHeight(x, sim_board);
-            int h2 = getColumnHeight(x + 1, sim_board);
-            bumpiness += abs(h1 - h2);
-        }
-    return bumpiness;
-}
-
-int TetrisGame::getAggregateHeight(const std::vector<std::vector<int>>& sim_board) const {
-    int height = 0;
-    for (int x = 0; x < WIDTH; x++) {
-        height += getColumnHeight(x, sim_board);
-    }
-    return height;
-}
 
 // AI classes moved to rl_agent.h and rl_agent.cpp
 
@@ -1073,15 +660,50 @@ void drawScoreGraph(RLAgent* agent) {
 
 int main(int argc, char* argv[]) {
     // Parse command line arguments (before ncurses initialization)
-    std::string model_file = "tetris_model.txt";
+    TrainingOptions options;
+    bool verify_precision = false;
+    bool verify_kernels = false;
+    bool verify_quantized = false;
+    std::string corpus_file;
+    int bench_hogwild = 0;
+    bool verify_snapshots = false;
+    bool verify_shared_agent = false;
+    bool verify_replay = false;
+    bool verify_training = false;
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
-        if (arg == "--model" || arg == "-m") {
+        int parsed = parseTrainingOption(options, argc, argv, i);
+        if (parsed < 0) {
+            return 1;
+        } else if (parsed > 0) {
+            continue;
+        } else if (arg == "--verify-precision") {
+            verify_precision = true;
+        } else if (arg == "--verify-kernels") {
+            verify_kernels = true;
+        } else if (arg == "--verify-snapshots") {
+            verify_snapshots = true;
+        } else if (arg == "--verify-shared-agent") {
+            verify_shared_agent = true;
+        } else if (arg == "--verify-replay") {
+            verify_replay = true;
+        } else if (arg == "--verify-training") {
+            verify_training = true;
+        } else if (arg == "--verify-quantized") {
+            verify_quantized = true;
+        } else if (arg == "--corpus") {
             if (i + 1 < argc) {
-                model_file = argv[++i];
+                corpus_file = argv[++i];
             } else {
-                std::cerr << "Error: --model requires a filename\n";
-                std::cerr << "Usage: " << argv[0] << " [--model|-m <filename>] [--help|-h]\n";
+                std::cerr << "Error: --corpus requires a filename\n";
+                return 1;
+            }
+        } else if (arg == "--bench-hogwild") {
+            if (i + 1 < argc) {
+                bench_hogwild = std::atoi(argv[++i]);
+            }
+            if (bench_hogwild < 2 || bench_hogwild > 64) {
+                std::cerr << "Error: --bench-hogwild requires a number of learner threads (2-64)\n";
                 return 1;
             }
         } else if (arg == "--help" || arg == "-h") {
@@ -1089,8 +711,25 @@ int main(int argc, char* argv[]) {
             std::cout << "==========================================\n\n";
             std::cout << "Usage: " << argv[0] << " [OPTIONS]\n\n";
             std::cout << "Options:\n";
-            std::cout << "  --model, -m <filename>  Load neural network model from specified file\n";
-            std::cout << "                          (default: tetris_model.txt)\n";
+            printTrainingOptions(std::cout);
+            std::cout << "  --verify-precision      Compare the model's Q-values against a double-precision\n";
+            std::cout << "                          reference and exit\n";
+            std::cout << "  --verify-kernels        Check the SIMD forward kernels against the scalar path\n";
+            std::cout << "                          (bit-exact) and exit\n";
+            std::cout << "  --verify-replay         Check packed states, the sum-tree, prioritized sampling\n";
+            std::cout << "                          and replay files, then exit\n";
+            std::cout << "  --verify-training       Check optimizer state save/load and the update rules,\n";
+            std::cout << "                          then exit\n";
+            std::cout << "  --bench-hogwild <N>     Compare training throughput and convergence with N\n";
+            std::cout << "                          Hogwild learners against one and exit\n";
+            std::cout << "  --verify-snapshots      Stress the weight snapshot publisher (one learner, four\n";
+            std::cout << "                          readers) for torn reads and exit\n";
+            std::cout << "  --verify-shared-agent   Choose moves from eight threads sharing one agent and\n";
+            std::cout << "                          compare with single-threaded decisions, then exit\n";
+            std::cout << "  --verify-quantized      Report how often the quantized network picks another move\n";
+            std::cout << "                          than the float network on a position corpus and exit\n";
+            std::cout << "  --corpus <filename>     Corpus for --verify-quantized (recorded by greedy play\n";
+            std::cout << "                          and saved there if the file does not exist)\n";
             std::cout << "  --help, -h              Show this help message\n\n";
             std::cout << "Examples:\n";
             std::cout << "  " << argv[0] << "                    # Use default model (tetris_model.txt)\n";
@@ -1110,6 +749,32 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    // Offline checks run without the terminal UI
+    if (verify_precision) {
+        return runPrecisionCheck(options.model_file, 34000);
+    }
+    if (verify_kernels) {
+        return runKernelCheck(options.model_file, 20000);
+    }
+    if (verify_quantized) {
+        return runQuantizedCheck(options.model_file, 2000, corpus_file);
+    }
+    if (verify_snapshots) {
+        return runSnapshotCheck(4, 2.0);
+    }
+    if (verify_shared_agent) {
+        return runSharedAgentCheck(options.model_file, 8, 400);
+    }
+    if (verify_replay) {
+        return runReplayCheck(2000000);
+    }
+    if (verify_training) {
+        return runTrainingCheck();
+    }
+    if (bench_hogwild > 0) {
+        return runHogwildBench(options.model_file, bench_hogwild, 3.0);
+    }
+    
     // Initialize random seed
     srand(time(nullptr));
     
@@ -1123,26 +788,21 @@ int main(int argc, char* argv[]) {
     initColors();
     
     TetrisGame game;
-    RLAgent agent(model_file);  // Load from specified model file
+    RLAgent agent(options.model_file, options.hidden_size);  // Load from specified model file
     ParameterTuner tuner;
-    
-    // Save best model with date and max score on program start
-    if (agent.best_score > 0) {
-        agent.saveBestModelWithDate();
+    std::string error;
+    if (!configureAgent(options, agent, tuner, error)) {
+        endwin();
+        std::cerr << "Error: " << error << "\n";
+        return 1;
     }
+    TrainingSession session(agent, tuner);
+    session.start();
     
     // Auto-start in training mode for continuous learning
     game.training_mode = true;
     game.ai_enabled = true;
     
-    // Apply initial parameter set
-    ParameterSet initial_params = tuner.getNextParameterSet();
-    tuner.applyParameters(initial_params, agent);
-    
-    std::vector<double> last_state;
-    int last_action_rot = 0;
-    int last_action_x = 0;
-    
     // Game loop with debugging
     int loop_count = 0;
     auto last_debug_time = std::chrono::steady_clock::now();
@@ -1233,131 +893,12 @@ int main(int argc, char* argv[]) {
             
             // Execute AI move every 100ms (with timeout protection)
             if (ai_elapsed >= 100) {
-                // Safety: Limit AI computation time to prevent CPU spinning
-                auto ai_start_time = std::chrono::steady_clock::now();
-                
-                // Extract current state
-                std::vector<double> current_state = agent.extractState(game);
-                
-                // Find best move (with timeout check)
-                RLAgent::Move best_move = agent.findBestMove(game, game.training_mode);
-                
-                // Check if AI computation took too long
-                auto ai_compute_time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now() - ai_start_time).count();
-                if (ai_compute_time > 1000) {
-                    // AI computation took more than 1 second - skip this move to prevent CPU spinning
+                if (!session.playMove(game, game.training_mode)) {
+                    // Choosing took more than 1 second - skip this move to prevent CPU spinning
                     game.last_ai_time = current_time;
                     continue;
                 }
                 
-                game.executeAIMove(best_move.rotation, best_move.x);
-                
-                // Collect experience for training
-                if (game.training_mode && last_state.size() > 0) {
-                    // SIMPLIFIED REWARD STRUCTURE - Focus on core objectives
-                    double reward = 0.0;
-                    
-                    // PRIMARY OBJECTIVE: Clear lines (main goal of Tetris)
-                    int lines_diff = game.lines_cleared - game.last_lines;
-                    reward += lines_diff * 15.0;  // IMPROVED: Increased from 10.0 to 15.0 for better emphasis (Priority 3)
-                    
-                    // Combo bonus: Extra reward for clearing multiple lines at once
-                    if (lines_diff > 1) {
-                        reward += lines_diff * 5.0;  // Bonus for combos (2+ lines)
-                    }
-                    
-                    // SECONDARY OBJECTIVE: Survival (stay alive)
-                    // FIX: Increased survival bonus to make most moves positive
-                    if (!game.game_over) {
-                        reward += 5.0;  // IMPROVED: Increased from 1.0 to 5.0 to make moves positive
-                    }
-                    
-                    // CRITICAL: Game over penalty (avoid at all costs)
-                    if (game.game_over) {
-                        reward -= 100.0;  // Strong but not overwhelming penalty
-                    }
-                    
-                    // STATE QUALITY: Normalized penalties (not overwhelming)
-                    // Height penalty (encourage keeping board low)
-                    int max_height = 0;
-                    std::vector<int> column_heights(game.WIDTH);
-                    for (int x = 0; x < game.WIDTH; x++) {
-                        int h = game.getColumnHeight(x, game.board);
-                        column_heights[x] = h;
-                        if (h > max_height) max_height = h;
-                    }
-                    // FIX: Reduced height penalty to prevent all moves being negative
-                    reward -= max_height * 0.1;  // IMPROVED: Reduced from 0.2 to 0.1
-                    
-                    // Well depth reward (encourage creating wells for I-piece strategy)
-                    int deepest_well = 0;
-                    for (int x = 0; x < game.WIDTH; x++) {
-                        int left_height = (x > 0) ? column_heights[x-1] : column_heights[x];
-                        int right_height = (x < game.WIDTH-1) ? column_heights[x+1] : column_heights[x];
-                        int well_depth = std::max(left_height, right_height) - column_heights[x];
-                        deepest_well = std::max(deepest_well, well_depth);
-                    }
-                    reward += deepest_well * 0.3;  // Reward for creating wells (helps I-piece placement)
-                    
-                    // Holes penalty (encourage avoiding holes)
-                    // FIX: Reduced holes penalty to prevent all moves being negative
-                    int holes = game.countHoles(game.board);
-                    reward -= holes * 0.2;  // IMPROVED: Reduced from 0.5 to 0.2
-                    
-                    // Store experience
-                    Experience exp;
-                    exp.state = last_state;
-                    exp.action_rotation = last_action_rot;
-                    exp.action_x = last_action_x;
-                    exp.reward = reward;
-                    exp.next_state = current_state;
-                    exp.done = game.game_over;
-                    
-                    agent.addExperience(exp);
-                    
-                    // Train periodically
-                    if (agent.replay_buffer.size() >= RLAgent::BATCH_SIZE) {
-                        auto train_start = std::chrono::steady_clock::now();
-                        agent.train();
-                        auto train_time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                            std::chrono::steady_clock::now() - train_start).count();
-                        if (train_time > 500) {
-                            std::stringstream ss;
-                            ss << "Slow training: " << train_time << "ms";
-                            debugLog(ss.str());
-                        }
-                        
-                        // Record metrics for parameter tuning
-                        tuner.recordError(agent.last_batch_error);
-                        tuner.recordEpsilon(agent.epsilon);
-                        
-                        // Check if we should test new parameters
-                        if (tuner.shouldTestNewParameters()) {
-                            debugLog("Testing new parameter set");
-                            ParameterSet new_params = tuner.getNextParameterSet();
-                            tuner.applyParameters(new_params, agent);
-                            tuner.resetForNewParameters();
-                            
-                            // Log parameter change
-                            std::ofstream logfile("debug.log", std::ios::app);
-                            if (logfile.is_open()) {
-                                logfile << "[TUNER] Switched to new parameters: LR=" << new_params.learning_rate
-                                        << " Gamma=" << new_params.gamma
-                                        << " EpsDecay=" << new_params.epsilon_decay
-                                        << " EpsMin=" << new_params.epsilon_min << std::endl;
-                            }
-                        }
-                    }
-                }
-                
-                // Update last state/action
-                last_state = current_state;
-                last_action_rot = best_move.rotation;
-                last_action_x = best_move.x;
-                game.last_score = game.score;
-                game.last_lines = game.lines_cleared;
-                
                 game.last_ai_time = current_time;
                 
                 // Auto-restart in training mode (handled in main loop)
@@ -1376,26 +917,7 @@ int main(int argc, char* argv[]) {
         
         // Auto-restart in training mode when game over
         if (game.training_mode && game.game_over) {
-            debugLog("Game over - restarting");
-            // Update training statistics
-            agent.total_games++;
-            if (game.score > agent.best_score) {
-                agent.best_score = game.score;
-                
-                // Save best model only if it's better than existing best, with timestamp and score in filename
-                agent.saveBestModelIfBetter(game.score);
-                
-                debugLog("New best score! Checking if model should be saved...");
-            }
-            
-            // Update running average (simple moving average of last N games)
-            agent.recent_scores_sum += game.score;
-            
-            // Track recent scores for convergence detection
-            agent.recent_scores.push_back(game.score);
-            if (agent.recent_scores.size() > RLAgent::CONVERGENCE_WINDOW) {
-                agent.recent_scores.pop_front();
-            }
+            session.endGame(game);
             
             // Track scores for graph display
             score_history.push_back(game.score);
@@ -1403,46 +925,11 @@ int main(int argc, char* argv[]) {
                 score_history.pop_front();
             }
             
-            // Track best score improvement
-            if (game.score > agent.best_score) {
-                agent.games_since_best_improvement = 0;
-            } else {
-                agent.games_since_best_improvement++;
-            }
-            
-            // Use sliding window average for more responsive updates
-            // Calculate average of recent scores (last RECENT_SCORES_COUNT games)
-            if (agent.recent_scores.size() > 0) {
-                int window_size = std::min((int)agent.recent_scores.size(), RLAgent::RECENT_SCORES_COUNT);
-                double sum = 0.0;
-                // Sum last N scores
-                int start_idx = std::max(0, (int)agent.recent_scores.size() - window_size);
-                for (int i = start_idx; i < (int)agent.recent_scores.size(); i++) {
-                    sum += agent.recent_scores[i];
-                }
-                agent.average_score = sum / window_size;
-            } else {
-                // Fallback: simple average if no recent scores yet
-                agent.average_score = agent.recent_scores_sum / (double)agent.total_games;
-            }
-            
-            // Record score for parameter tuning
-            tuner.recordScore(game.score);
-            
-            // Update epsilon based on performance (adaptive decay)
-            agent.updateEpsilonBasedOnPerformance();
-            
-            // Save model periodically
-            if (agent.training_episodes % 100 == 0) {
-                agent.saveModel();
-            }
-            
             // Reset game immediately
             game.~TetrisGame();
             new (&game) TetrisGame();
             game.training_mode = true;
             game.ai_enabled = true;
-            last_state.clear();
             
             // Small delay to show game over briefly and allow screen refresh
             napms(100);
@@ -1499,11 +986,7 @@ int main(int argc, char* argv[]) {
     
     // Save model on exit if training
     if (game.training_mode) {
-        agent.saveModel();
-        // Save best model with date and max score on program exit
-        if (agent.best_score > 0) {
-            agent.saveBestModelWithDate();
-        }
+        session.finish();
     }
     
     endwin();
@@ -0,0 +1,163 @@
+/*
+ * Headless Tetris training (C++)
+ * Plays and trains the agent with the same session as the game (training_session.h),
+ * without the terminal UI or its frame delays, and prints a progress line periodically.
+ * Stops after --duration seconds or --games games, on convergence, or on Ctrl-C, and
+ * saves the model like the game does on exit.
+ */
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "rl_agent.h"
+#include "parameter_tuner.h"
+#include "game_classes.h"
+#include "training_session.h"
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void requestStop(int) {
+    stop_requested = 1;
+}
+
+int main(int argc, char* argv[]) {
+    TrainingOptions options;
+    double duration = 0.0;          // Seconds of training (0 = no limit)
+    long long max_games = 0;        // Games to play (0 = no limit)
+    double progress_interval = 10.0;  // Seconds between progress lines
+    unsigned seed = unsigned(time(nullptr));
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        int parsed = parseTrainingOption(options, argc, argv, i);
+        if (parsed < 0) {
+            return 1;
+        } else if (parsed > 0) {
+            continue;
+        } else if (arg == "--duration") {
+            if (i + 1 < argc) {
+                duration = std::atof(argv[++i]);
+            }
+            if (!(duration > 0.0)) {
+                std::cerr << "Error: --duration requires a number of seconds\n";
+                return 1;
+            }
+        } else if (arg == "--games") {
+            if (i + 1 < argc) {
+                max_games = std::atoll(argv[++i]);
+            }
+            if (max_games <= 0) {
+                std::cerr << "Error: --games requires a positive number of games\n";
+                return 1;
+            }
+        } else if (arg == "--seed") {
+            if (i + 1 < argc) {
+                seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+            } else {
+                std::cerr << "Error: --seed requires a number\n";
+                return 1;
+            }
+        } else if (arg == "--progress") {
+            if (i + 1 < argc) {
+                progress_interval = std::atof(argv[++i]);
+            }
+            if (!(progress_interval > 0.0)) {
+                std::cerr << "Error: --progress requires a number of seconds\n";
+                return 1;
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Headless Tetris training\n";
+            std::cout << "========================\n\n";
+            std::cout << "Usage: " << argv[0] << " [OPTIONS]\n\n";
+            std::cout << "Trains the model as the game's training mode does (same agent, rewards,\n";
+            std::cout << "parameter tuner and checkpoints), without the terminal or frame delays.\n\n";
+            std::cout << "Options:\n";
+            printTrainingOptions(std::cout);
+            std::cout << "  --duration <S>          Stop after S seconds (default: no limit)\n";
+            std::cout << "  --games <N>             Stop after N games (default: no limit)\n";
+            std::cout << "  --seed <N>              Seed for the pieces, exploration and minibatch sampling\n";
+            std::cout << "                          (default: the time). A new model's initial weights are\n";
+            std::cout << "                          not seeded\n";
+            std::cout << "  --progress <S>          Seconds between progress lines (default: 10)\n";
+            std::cout << "  --help, -h              Show this help message\n\n";
+            std::cout << "Ctrl-C stops after the current move and saves the model.\n";
+            return 0;
+        } else {
+            std::cerr << "Error: unknown option " << arg << " (see --help)\n";
+            return 1;
+        }
+    }
+
+    srand(seed);  // Before the agent, whose exploration generator is seeded from rand()
+    RLAgent agent(options.model_file, options.hidden_size);
+    ParameterTuner tuner;
+    std::string error;
+    if (!configureAgent(options, agent, tuner, error)) {
+        std::cerr << "Error: " << error << "\n";
+        return 1;
+    }
+    TrainingSession session(agent, tuner);
+    session.start();
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    std::cout << "Training " << options.model_file << " (seed " << seed << ")" << std::endl;
+    debugLog("Headless training started");
+    const auto start_time = std::chrono::steady_clock::now();
+    double next_progress = progress_interval;
+    long long games = 0;
+    long long last_moves = 0;
+    double last_elapsed = 0.0;
+    bool converged = false;
+    TetrisGame* game = new TetrisGame();
+    game->training_mode = true;
+    game->ai_enabled = true;
+
+    while (!stop_requested) {
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        if (elapsed >= next_progress) {
+            char line[200];
+            snprintf(line, sizeof(line),
+                     "[%7.0fs] games %lld | moves %lld (%.0f/s) | batches %d | avg score %.0f | best %d | "
+                     "epsilon %.3f | buffer %zu",
+                     elapsed, games, session.moves, (session.moves - last_moves) / (elapsed - last_elapsed),
+                     agent.training_episodes, agent.average_score, agent.best_score, agent.epsilon,
+                     agent.replay_buffer.size());
+            std::cout << line << std::endl;
+            last_moves = session.moves;
+            last_elapsed = elapsed;
+            next_progress = elapsed + progress_interval;
+        }
+        if (duration > 0.0 && elapsed >= duration) break;
+
+        if (game->game_over) {
+            session.endGame(*game);
+            games++;
+            delete game;
+            game = new TetrisGame();
+            game->training_mode = true;
+            game->ai_enabled = true;
+            if (agent.total_games % 50 == 0 && agent.checkConvergence()) {
+                converged = true;
+                break;
+            }
+            if (max_games > 0 && games >= max_games) break;
+            continue;
+        }
+        session.playMove(*game, true);
+    }
+    delete game;
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    char line[200];
+    snprintf(line, sizeof(line), "%s after %.1fs: %lld games, %lld moves (%.0f/s), %d batches, best score %d",
+             converged ? "Converged" : "Stopped", elapsed, games, session.moves, session.moves / elapsed,
+             agent.training_episodes, agent.best_score);
+    std::cout << line << std::endl;
+    session.finish();
+    std::cout << "Model saved to " << options.model_file << std::endl;
+    return 0;
+}
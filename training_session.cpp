@@ -0,0 +1,467 @@
+#include "training_session.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Debug logging function
+void debugLog(const std::string& message) {
+    static std::ofstream debug_file("debug.log", std::ios::app);
+    if (debug_file.is_open()) {
+        auto now = std::chrono::system_clock::now();
+        auto time_t = std::chrono::system_clock::to_time_t(now);
+        debug_file << "[" << time_t << "] " << message << "\n";
+        debug_file.flush();
+    }
+}
+
+TrainingOptions::TrainingOptions()
+    : model_file("tetris_model.txt"),
+      hidden_size(NeuralNetwork::DEFAULT_HIDDEN_SIZE),
+      optimizer_type(OPTIMIZER_SGD),
+      optimizer_set(false),
+      target_sync(0),
+      target_tau(0.0),
+      quantized(false),
+      hogwild_learners(1),
+      batch_producer(0),
+      prioritized(false),
+      dedup_replay(false),
+      mirror_augmentation(false),
+      cold_share(RLAgent::DEFAULT_COLD_SHARE),
+      n_steps(1),
+      replay_capacity(RLAgent::DEFAULT_BUFFER_SIZE),
+      replay_memory_mb(0),
+      batch_size(0) {}
+
+int parseTrainingOption(TrainingOptions& options, int argc, char* argv[], int& i) {
+    std::string arg = argv[i];
+    if (arg == "--model" || arg == "-m") {
+        if (i + 1 < argc) {
+            options.model_file = argv[++i];
+        } else {
+            std::cerr << "Error: --model requires a filename\n";
+            std::cerr << "Usage: " << argv[0] << " [--model|-m <filename>] [--help|-h]\n";
+            return -1;
+        }
+    } else if (arg == "--hidden") {
+        if (i + 1 < argc) {
+            options.hidden_size = std::atoi(argv[++i]);
+        }
+        if (nnShapeIndex(NeuralNetwork::INPUT_SIZE, options.hidden_size) < 0) {
+            std::cerr << "Error: --hidden must be one of:";
+            for (int shape = 0; shape < NN_SHAPE_COUNT; shape++) {
+                std::cerr << " " << NN_HIDDEN_SIZES[shape];
+            }
+            std::cerr << "\n";
+            return -1;
+        }
+    } else if (arg == "--optimizer") {
+        if (i + 1 >= argc || !parseOptimizer(argv[++i], options.optimizer_type)) {
+            std::cerr << "Error: --optimizer must be one of: sgd momentum rmsprop adam\n";
+            return -1;
+        }
+        options.optimizer_set = true;
+    } else if (arg == "--target-sync") {
+        if (i + 1 < argc) {
+            options.target_sync = std::atoi(argv[++i]);
+        }
+        if (options.target_sync <= 0) {
+            std::cerr << "Error: --target-sync requires a positive number of batches\n";
+            return -1;
+        }
+    } else if (arg == "--target-tau") {
+        if (i + 1 < argc) {
+            options.target_tau = std::atof(argv[++i]);
+        }
+        if (!(options.target_tau > 0.0 && options.target_tau <= 1.0)) {
+            std::cerr << "Error: --target-tau must be in (0, 1]\n";
+            return -1;
+        }
+    } else if (arg == "--prioritized") {
+        options.prioritized = true;
+    } else if (arg == "--dedup-replay") {
+        options.dedup_replay = true;
+    } else if (arg == "--mirror") {
+        options.mirror_augmentation = true;
+    } else if (arg == "--replay-file") {
+        if (i + 1 < argc) {
+            options.replay_file = argv[++i];
+        } else {
+            std::cerr << "Error: --replay-file requires a filename\n";
+            return -1;
+        }
+    } else if (arg == "--cold-replay") {
+        if (i + 1 < argc) {
+            options.cold_replay_file = argv[++i];
+        } else {
+            std::cerr << "Error: --cold-replay requires a filename\n";
+            return -1;
+        }
+    } else if (arg == "--batch-size") {
+        std::string value = i + 1 < argc ? argv[++i] : "";
+        options.batch_size = value == "auto" ? -1 : std::atoi(value.c_str());
+        if (options.batch_size != -1 &&
+            (options.batch_size < RLAgent::MIN_BATCH_SIZE || options.batch_size > RLAgent::MAX_BATCH_SIZE)) {
+            std::cerr << "Error: --batch-size must be auto or " << RLAgent::MIN_BATCH_SIZE << "-"
+                      << RLAgent::MAX_BATCH_SIZE << "\n";
+            return -1;
+        }
+    } else if (arg == "--replay-capacity") {
+        if (i + 1 < argc) {
+            options.replay_capacity = std::atoll(argv[++i]);
+        }
+        if (options.replay_capacity < RLAgent::MIN_BUFFER_SIZE || options.replay_capacity > 100000000) {
+            std::cerr << "Error: --replay-capacity must be " << RLAgent::MIN_BUFFER_SIZE << "-100000000\n";
+            return -1;
+        }
+    } else if (arg == "--replay-memory") {
+        if (i + 1 < argc) {
+            options.replay_memory_mb = std::atoll(argv[++i]);
+        }
+        if (options.replay_memory_mb <= 0) {
+            std::cerr << "Error: --replay-memory requires a budget in MB\n";
+            return -1;
+        }
+    } else if (arg == "--n-step") {
+        if (i + 1 < argc) {
+            options.n_steps = std::atoi(argv[++i]);
+        }
+        if (options.n_steps < 1 || options.n_steps > 20) {
+            std::cerr << "Error: --n-step requires a number of steps (1-20)\n";
+            return -1;
+        }
+    } else if (arg == "--cold-share") {
+        if (i + 1 < argc) {
+            options.cold_share = std::atof(argv[++i]);
+        }
+        if (!(options.cold_share >= 0.0 && options.cold_share <= 0.9)) {
+            std::cerr << "Error: --cold-share must be in [0, 0.9]\n";
+            return -1;
+        }
+    } else if (arg == "--quantized") {
+        options.quantized = true;
+    } else if (arg == "--batch-producer") {
+        if (i + 1 < argc) {
+            options.batch_producer = std::atoi(argv[++i]);
+        }
+        if (options.batch_producer < 1 || options.batch_producer > 16) {
+            std::cerr << "Error: --batch-producer requires a queue depth (1-16)\n";
+            return -1;
+        }
+    } else if (arg == "--hogwild") {
+        if (i + 1 < argc) {
+            options.hogwild_learners = std::atoi(argv[++i]);
+        }
+        if (options.hogwild_learners < 2 || options.hogwild_learners > 64) {
+            std::cerr << "Error: --hogwild requires a number of learner threads (2-64)\n";
+            return -1;
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+void printTrainingOptions(std::ostream& out) {
+    out << "  --model, -m <filename>  Load neural network model from specified file\n";
+    out << "                          (default: tetris_model.txt)\n";
+    out << "  --hidden <size>         Hidden layer size for a new model: 32, 64 or 128\n";
+    out << "                          (default: 64; an existing model keeps its own shape)\n";
+    out << "  --optimizer <name>      Update rule: sgd, momentum, rmsprop or adam\n";
+    out << "                          (default: the model's saved optimizer, else sgd)\n";
+    out << "  --target-sync <N>       Compute targets with a frozen target network, copied\n";
+    out << "                          from the online network every N batches\n";
+    out << "  --target-tau <T>        Target network updated by Polyak averaging with weight T\n";
+    out << "                          per batch (e.g. 0.005); overrides --target-sync\n";
+    out << "  --prioritized           Prioritized experience replay: sample transitions by their\n";
+    out << "                          last TD error, with importance-sampling weights\n";
+    out << "  --dedup-replay          Store repeated transitions once with a count, sampled in\n";
+    out << "                          proportion to it\n";
+    out << "  --mirror                Train on the left-right mirror image (S/Z and J/L swapped)\n";
+    out << "                          of about half the sampled transitions\n";
+    out << "  --replay-file <file>    Keep the replay buffer in a memory-mapped file, so its\n";
+    out << "                          experience survives restarts (created if missing)\n";
+    out << "  --batch-size <N|auto>   Samples per minibatch (8-1024), or auto: the best size\n";
+    out << "                          measured on this machine (default: parameter tuner)\n";
+    out << "  --replay-capacity <N>   Experiences kept in the replay buffer (default: 10000)\n";
+    out << "  --replay-memory <MB>    Size the replay buffer to fit this memory budget\n";
+    out << "  --n-step <N>            Learn from N-step returns (rewards of the next N moves,\n";
+    out << "                          then bootstrap); default 1\n";
+    out << "  --cold-replay <file>    Append transitions evicted from the replay buffer to a\n";
+    out << "                          compressed on-disk archive and keep replaying them\n";
+    out << "  --cold-share <F>        Fraction of each minibatch drawn from the archive\n";
+    out << "                          (default: 0.25)\n";
+    out << "  --hogwild <N>           Train N minibatches at once on N threads, updating the\n";
+    out << "                          shared weights without locks (Hogwild)\n";
+    out << "  --batch-producer <N>    Sample and decode up to N minibatches ahead on a background\n";
+    out << "                          thread, so training only computes targets and updates\n";
+    out << "                          (not with --hogwild)\n";
+    out << "  --quantized             Pick moves with the fixed-point copy of the network when not\n";
+    out << "                          training (refreshed on load and save)\n";
+}
+
+bool configureAgent(const TrainingOptions& options, RLAgent& agent, ParameterTuner& tuner, std::string& error) {
+    if (options.optimizer_set) {
+        agent.q_network.optimizer.select(options.optimizer_type, agent.q_network.hidden_size);
+    }
+    agent.quantized_inference = options.quantized;
+    long long replay_capacity = options.replay_capacity;
+    if (options.replay_memory_mb > 0) {
+        replay_capacity = RLAgent::replayCapacityForBudget(size_t(options.replay_memory_mb) << 20,
+                                                           options.prioritized || options.dedup_replay,
+                                                           options.dedup_replay);
+    }
+    if (options.replay_file.empty()) {
+        agent.setReplayCapacity(size_t(replay_capacity));
+    } else if (!agent.replay_buffer.openFile(options.replay_file, size_t(replay_capacity), false, error)) {
+        error = "--replay-file " + error;
+        return false;
+    }
+    if (!options.cold_replay_file.empty() &&
+        !agent.enableColdReplay(options.cold_replay_file, options.cold_share, error)) {
+        error = "--cold-replay " + error;
+        return false;
+    }
+    agent.n_steps = options.n_steps;
+    agent.mirror_augmentation = options.mirror_augmentation;
+    agent.enableHogwild(options.hogwild_learners);
+    agent.enableBatchProducer(options.batch_producer);
+    if (options.prioritized) {
+        agent.enablePrioritizedReplay(0.6, 0.4);
+    }
+    if (options.dedup_replay) {
+        agent.enableReplayDeduplication();
+    }
+    if (options.target_sync > 0 || options.target_tau > 0.0) {
+        agent.enableTargetNetwork(options.target_sync, options.target_tau);
+    }
+    if (options.batch_size != 0) {
+        // Explicit or calibrated batch size: the tuner's sets leave it alone
+        agent.setBatchSize(options.batch_size > 0 ? options.batch_size : agent.calibrateBatchSize());
+        tuner.tune_batch_size = false;
+    }
+    return true;
+}
+
+double moveReward(const TetrisGame& game) {
+    // SIMPLIFIED REWARD STRUCTURE - Focus on core objectives
+    double reward = 0.0;
+
+    // PRIMARY OBJECTIVE: Clear lines (main goal of Tetris)
+    int lines_diff = game.lines_cleared - game.last_lines;
+    reward += lines_diff * 15.0;  // IMPROVED: Increased from 10.0 to 15.0 for better emphasis (Priority 3)
+
+    // Combo bonus: Extra reward for clearing multiple lines at once
+    if (lines_diff > 1) {
+        reward += lines_diff * 5.0;  // Bonus for combos (2+ lines)
+    }
+
+    // SECONDARY OBJECTIVE: Survival (stay alive)
+    // FIX: Increased survival bonus to make most moves positive
+    if (!game.game_over) {
+        reward += 5.0;  // IMPROVED: Increased from 1.0 to 5.0 to make moves positive
+    }
+
+    // CRITICAL: Game over penalty (avoid at all costs)
+    if (game.game_over) {
+        reward -= 100.0;  // Strong but not overwhelming penalty
+    }
+
+    // STATE QUALITY: Normalized penalties (not overwhelming)
+    // Height penalty (encourage keeping board low)
+    int max_height = 0;
+    std::vector<int> column_heights(game.WIDTH);
+    for (int x = 0; x < game.WIDTH; x++) {
+        int h = game.getColumnHeight(x, game.board);
+        column_heights[x] = h;
+        if (h > max_height) max_height = h;
+    }
+    // FIX: Reduced height penalty to prevent all moves being negative
+    reward -= max_height * 0.1;  // IMPROVED: Reduced from 0.2 to 0.1
+
+    // Well depth reward (encourage creating wells for I-piece strategy)
+    int deepest_well = 0;
+    for (int x = 0; x < game.WIDTH; x++) {
+        int left_height = (x > 0) ? column_heights[x-1] : column_heights[x];
+        int right_height = (x < game.WIDTH-1) ? column_heights[x+1] : column_heights[x];
+        int well_depth = std::max(left_height, right_height) - column_heights[x];
+        deepest_well = std::max(deepest_well, well_depth);
+    }
+    reward += deepest_well * 0.3;  // Reward for creating wells (helps I-piece placement)
+
+    // Holes penalty (encourage avoiding holes)
+    // FIX: Reduced holes penalty to prevent all moves being negative
+    int holes = game.countHoles(game.board);
+    reward -= holes * 0.2;  // IMPROVED: Reduced from 0.5 to 0.2
+    return reward;
+}
+
+TrainingSession::TrainingSession(RLAgent& agent, ParameterTuner& tuner)
+    : moves(0), agent(agent), tuner(tuner), has_last_state(false), n_step_window(agent.n_steps),
+      last_action_rot(0), last_action_x(0) {}
+
+void TrainingSession::start() {
+    // Save best model with date and max score on program start
+    if (agent.best_score > 0) {
+        agent.saveBestModelWithDate();
+    }
+
+    // Apply initial parameter set
+    ParameterSet initial_params = tuner.getNextParameterSet();
+    tuner.applyParameters(initial_params, agent);
+}
+
+bool TrainingSession::playMove(TetrisGame& game, bool training) {
+    // Safety: Limit AI computation time to prevent CPU spinning
+    auto ai_start_time = std::chrono::steady_clock::now();
+
+    // Extract current state
+    PackedState current_state = RLAgent::packState(game);
+
+    // Find best move (with timeout check)
+    RLAgent::Move best_move = agent.findBestMove(game, training);
+
+    // Check if AI computation took too long
+    auto ai_compute_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - ai_start_time).count();
+    if (ai_compute_time > 1000) {
+        // AI computation took more than 1 second - skip this move to prevent CPU spinning
+        return false;
+    }
+
+    game.executeAIMove(best_move.rotation, best_move.x);
+    moves++;
+
+    // Collect experience for training
+    if (training && has_last_state) {
+        // Store experience
+        Experience exp;
+        exp.state = last_state;
+        exp.action_rotation = last_action_rot;
+        exp.action_x = last_action_x;
+        exp.reward = moveReward(game);
+        exp.next_state = current_state;
+        exp.done = game.game_over;
+
+        n_step_window.push(exp, agent.gamma, n_step_ready);
+        for (const Experience& ready : n_step_ready) {
+            agent.addExperience(ready);
+        }
+        n_step_ready.clear();
+
+        // Train periodically
+        if (agent.replay_buffer.size() >= size_t(agent.batch_size)) {
+            auto train_start = std::chrono::steady_clock::now();
+            agent.train();
+            auto train_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - train_start).count();
+            if (train_time > 500) {
+                std::stringstream ss;
+                ss << "Slow training: " << train_time << "ms";
+                debugLog(ss.str());
+            }
+
+            // Record metrics for parameter tuning
+            tuner.recordError(agent.last_batch_error);
+            tuner.recordEpsilon(agent.epsilon);
+
+            // Check if we should test new parameters
+            if (tuner.shouldTestNewParameters()) {
+                debugLog("Testing new parameter set");
+                ParameterSet new_params = tuner.getNextParameterSet();
+                tuner.applyParameters(new_params, agent);
+                tuner.resetForNewParameters();
+
+                // Log parameter change
+                std::ofstream logfile("debug.log", std::ios::app);
+                if (logfile.is_open()) {
+                    logfile << "[TUNER] Switched to new parameters: LR=" << new_params.learning_rate
+                            << " Gamma=" << new_params.gamma
+                            << " EpsDecay=" << new_params.epsilon_decay
+                            << " EpsMin=" << new_params.epsilon_min << std::endl;
+                }
+            }
+        }
+    }
+
+    // Update last state/action
+    last_state = current_state;
+    has_last_state = true;
+    last_action_rot = best_move.rotation;
+    last_action_x = best_move.x;
+    game.last_score = game.score;
+    game.last_lines = game.lines_cleared;
+    return true;
+}
+
+void TrainingSession::endGame(const TetrisGame& game) {
+    debugLog("Game over - restarting");
+    // Update training statistics
+    agent.total_games++;
+    if (game.score > agent.best_score) {
+        agent.best_score = game.score;
+
+        // Save best model only if it's better than existing best, with timestamp and score in filename
+        agent.saveBestModelIfBetter(game.score);
+
+        debugLog("New best score! Checking if model should be saved...");
+    }
+
+    // Update running average (simple moving average of last N games)
+    agent.recent_scores_sum += game.score;
+
+    // Track recent scores for convergence detection
+    agent.recent_scores.push_back(game.score);
+    if (agent.recent_scores.size() > RLAgent::CONVERGENCE_WINDOW) {
+        agent.recent_scores.pop_front();
+    }
+
+    // Track best score improvement
+    if (game.score > agent.best_score) {
+        agent.games_since_best_improvement = 0;
+    } else {
+        agent.games_since_best_improvement++;
+    }
+
+    // Use sliding window average for more responsive updates
+    // Calculate average of recent scores (last RECENT_SCORES_COUNT games)
+    if (agent.recent_scores.size() > 0) {
+        int window_size = std::min((int)agent.recent_scores.size(), RLAgent::RECENT_SCORES_COUNT);
+        double sum = 0.0;
+        // Sum last N scores
+        int start_idx = std::max(0, (int)agent.recent_scores.size() - window_size);
+        for (int i = start_idx; i < (int)agent.recent_scores.size(); i++) {
+            sum += agent.recent_scores[i];
+        }
+        agent.average_score = sum / window_size;
+    } else {
+        // Fallback: simple average if no recent scores yet
+        agent.average_score = agent.recent_scores_sum / (double)agent.total_games;
+    }
+
+    // Record score for parameter tuning
+    tuner.recordScore(game.score);
+
+    // Update epsilon based on performance (adaptive decay)
+    agent.updateEpsilonBasedOnPerformance();
+
+    // Save model periodically
+    if (agent.training_episodes % 100 == 0) {
+        agent.saveModel();
+    }
+
+    // The next game starts without a previous move
+    has_last_state = false;
+    n_step_window.clear();
+}
+
+void TrainingSession::finish() {
+    agent.saveModel();
+    // Save best model with date and max score on program exit
+    if (agent.best_score > 0) {
+        agent.saveBestModelWithDate();
+    }
+}
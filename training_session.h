@@ -0,0 +1,86 @@
+#ifndef TRAINING_SESSION_H
+#define TRAINING_SESSION_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "rl_agent.h"
+#include "parameter_tuner.h"
+#include "game_classes.h"
+
+// Appends a timestamped line to debug.log
+void debugLog(const std::string& message);
+
+// Agent settings from the command line, shared by the game (tetris) and the headless
+// trainer (tetris_train)
+struct TrainingOptions {
+    std::string model_file;
+    int hidden_size;
+    OptimizerType optimizer_type;
+    bool optimizer_set;          // Otherwise a loaded model keeps its saved optimizer
+    int target_sync;             // Target network: hard copy every N batches (0 = off)
+    double target_tau;           // Target network: Polyak averaging weight (0 = off)
+    bool quantized;
+    int hogwild_learners;        // Minibatches trained in parallel per training step
+    int batch_producer;          // Minibatches prepared ahead on a background thread (0 = off)
+    bool prioritized;            // Prioritized experience replay
+    bool dedup_replay;           // Merge repeated transitions into counted entries
+    bool mirror_augmentation;    // Train on left-right mirrored transitions half the time
+    std::string replay_file;     // Memory-mapped replay buffer (empty = in memory only)
+    std::string cold_replay_file;  // Archive of overwritten transitions (empty = off)
+    double cold_share;
+    int n_steps;                 // Steps per stored return (1 = one-step Q-learning)
+    long long replay_capacity;
+    long long replay_memory_mb;  // Size the replay buffer from this budget instead (0 = off)
+    int batch_size;              // 0 = from the parameter tuner, -1 = calibrate
+
+    TrainingOptions();
+};
+
+// Consumes argv[i] (and its value) if it is an agent option: 1 if it was, 0 if it is not
+// one, -1 after printing an error about its value
+int parseTrainingOption(TrainingOptions& options, int argc, char* argv[], int& i);
+void printTrainingOptions(std::ostream& out);  // Help lines for the options above
+
+// Applies the options to a freshly loaded agent and its tuner (replay storage, optional
+// features, batch size). False with `error` set when a replay file cannot be opened
+bool configureAgent(const TrainingOptions& options, RLAgent& agent, ParameterTuner& tuner, std::string& error);
+
+// Reward for the move just played in `game`: lines (with a combo bonus), survival or the
+// game-over penalty, and penalties for height and holes with a bonus for the deepest well
+double moveReward(const TetrisGame& game);
+
+// The training loop of one agent, without any display: picks and plays moves, turns them
+// into (n-step) experiences with moveReward, trains, feeds the parameter tuner, and does the
+// statistics and checkpoints at each game over. The game UI and the headless trainer drive
+// the same session; only their pacing differs.
+class TrainingSession {
+public:
+    TrainingSession(RLAgent& agent, ParameterTuner& tuner);
+
+    // Saves the best model so far and applies the tuner's first parameter set
+    void start();
+    // Picks and plays one move. When training, the previous move becomes an experience
+    // (its reward seen from the position after this move) and the agent trains once the
+    // buffer holds a batch. False when choosing took over a second and the move was skipped
+    bool playMove(TetrisGame& game, bool training);
+    // Game-over bookkeeping: statistics, tuner score, epsilon, the best model and a periodic
+    // checkpoint. The caller starts the next game
+    void endGame(const TetrisGame& game);
+    // Saves the model (and the best model with its date); called on exit
+    void finish();
+
+    long long moves;  // Played since construction
+
+private:
+    RLAgent& agent;
+    ParameterTuner& tuner;
+    PackedState last_state;          // Replay form of the state before the last move
+    bool has_last_state;
+    NStepWindow n_step_window;       // Current game's steps not yet stored as n-step experiences
+    std::vector<Experience> n_step_ready;
+    int last_action_rot;
+    int last_action_x;
+};
+
+#endif // TRAINING_SESSION_H
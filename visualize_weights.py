@@ -21,20 +21,36 @@ import matplotlib.pyplot as plt
 import matplotlib.patches as mpatches
 from matplotlib.colors import LinearSegmentedColormap
 import os
+import re
 import time
 import sys
 
 # Network architecture constants (matching rl_agent.h)
 INPUT_SIZE = 27  # ZERO-BASED REDESIGN: 10 heights + 3 board_quality + 7 current + 7 next + 2 game_state
-HIDDEN_SIZE = 64
+DEFAULT_HIDDEN_SIZE = 64  # Shape of models saved before the "# Shape: 27xH" header
 OUTPUT_SIZE = 1
 
+def read_hidden_size(lines):
+    """Hidden size from the "# Shape: 27xH" header (DEFAULT_HIDDEN_SIZE for older files),
+    or None if the file was saved for another input size"""
+    for line in lines:
+        line = line.strip()
+        if line and not line.startswith('#'):
+            break  # The header comes before the first data line
+        match = re.match(r'# Shape: (\d+)x(\d+)', line)
+        if match:
+            if int(match.group(1)) != INPUT_SIZE or int(match.group(2)) <= 0:
+                return None
+            return int(match.group(2))
+    return DEFAULT_HIDDEN_SIZE
+
 class WeightVisualizer:
     def __init__(self, model_file="tetris_model.txt"):
         self.model_file = model_file
-        self.weights1 = None  # Input to Hidden (27 x 64)
-        self.bias1 = None     # Hidden bias (64)
-        self.weights2 = None  # Hidden to Output (64 x 1)
+        self.hidden_size = DEFAULT_HIDDEN_SIZE  # From the model file's shape header
+        self.weights1 = None  # Input to Hidden (27 x hidden_size)
+        self.bias1 = None     # Hidden bias (hidden_size)
+        self.weights2 = None  # Hidden to Output (hidden_size x 1)
         self.bias2 = None     # Output bias (1)
         self.last_load_time = None  # Timestamp of last successful load
         self.load_count = 0  # Number of times model was loaded
@@ -72,6 +88,11 @@ class WeightVisualizer:
             with open(self.model_file, 'r') as f:
                 all_lines = f.readlines()
             
+            hidden_size = read_hidden_size(all_lines)
+            if hidden_size is None:
+                print(f"Error: {self.model_file} is not a {INPUT_SIZE}xH model")
+                return False
+            
             # Filter out comment lines (starting with #) and empty lines
             lines = []
             for line in all_lines:
@@ -83,27 +104,27 @@ class WeightVisualizer:
                 print(f"Error: Not enough data lines in file (expected at least {INPUT_SIZE + 1}, got {len(lines)})")
                 return False
             
-            # Parse weights1 (27 rows, 64 columns each)
-            self.weights1 = np.zeros((INPUT_SIZE, HIDDEN_SIZE))
+            # Parse weights1 (27 rows, hidden_size columns each)
+            self.weights1 = np.zeros((INPUT_SIZE, hidden_size))
             for i in range(INPUT_SIZE):
                 values = list(map(float, lines[i].split()))
-                if len(values) != HIDDEN_SIZE:
-                    print(f"Error: Expected {HIDDEN_SIZE} values for weights1 row {i}, got {len(values)}")
+                if len(values) != hidden_size:
+                    print(f"Error: Expected {hidden_size} values for weights1 row {i}, got {len(values)}")
                     return False
                 self.weights1[i] = values
             
-            # Parse bias1 (1 row, 64 values)
+            # Parse bias1 (1 row, hidden_size values)
             bias1_line = lines[INPUT_SIZE]
             bias1_values = list(map(float, bias1_line.split()))
-            if len(bias1_values) != HIDDEN_SIZE:
-                print(f"Error: Expected {HIDDEN_SIZE} values for bias1, got {len(bias1_values)}")
+            if len(bias1_values) != hidden_size:
+                print(f"Error: Expected {hidden_size} values for bias1, got {len(bias1_values)}")
                 return False
             self.bias1 = np.array(bias1_values)
             
-            # Parse weights2 (64 rows, 1 column each)
-            self.weights2 = np.zeros((HIDDEN_SIZE, OUTPUT_SIZE))
+            # Parse weights2 (hidden_size rows, 1 column each)
+            self.weights2 = np.zeros((hidden_size, OUTPUT_SIZE))
             start_idx = INPUT_SIZE + 1
-            for i in range(HIDDEN_SIZE):
+            for i in range(hidden_size):
                 values = list(map(float, lines[start_idx + i].split()))
                 if len(values) != OUTPUT_SIZE:
                     print(f"Error: Expected {OUTPUT_SIZE} values for weights2 row {i}, got {len(values)}")
@@ -111,15 +132,16 @@ class WeightVisualizer:
                 self.weights2[i] = values
             
             # Parse bias2 (1 row, 1 value)
-            bias2_line = lines[start_idx + HIDDEN_SIZE]
+            bias2_line = lines[start_idx + hidden_size]
             bias2_values = list(map(float, bias2_line.split()))
             if len(bias2_values) != OUTPUT_SIZE:
                 print(f"Error: Expected {OUTPUT_SIZE} values for bias2, got {len(bias2_values)}")
                 return False
             self.bias2 = np.array(bias2_values)
+            self.hidden_size = hidden_size
             
             # Try to load metadata (if present) - starts after bias2 line
-            metadata_start = start_idx + HIDDEN_SIZE + 1
+            metadata_start = start_idx + hidden_size + 1
             if metadata_start < len(lines):
                 self._load_metadata(lines, metadata_start)
             
@@ -330,17 +352,19 @@ class WeightVisualizer:
         else:
             # Update existing image data with new color range
             self.images['im1'].set_data(self.weights1)
+            # The reloaded model may have another hidden size
+            self.images['im1'].set_extent((-0.5, self.weights1.shape[1] - 0.5, self.weights1.shape[0] - 0.5, -0.5))
             self.images['im1'].set_clim(vmin1, vmax1)  # Update color scale dynamically
             # Update colorbar
             if 'cb1' in self.colorbars:
                 self.colorbars['cb1'].update_normal(self.images['im1'])
         
-        title1 = ax1.set_title(f'Weights1: Input → Hidden Layer ({INPUT_SIZE}×{HIDDEN_SIZE})\n'
+        title1 = ax1.set_title(f'Weights1: Input → Hidden Layer ({INPUT_SIZE}×{self.hidden_size})\n'
                      f'Mean: {stats["weights1"]["mean"]:.4f}, Std: {stats["weights1"]["std"]:.4f}, '
                      f'Range: [{stats["weights1"]["min"]:.3f}, {stats["weights1"]["max"]:.3f}]',
                      fontsize=12, fontweight='bold')
         self.text_objects.append(title1)
-        ax1.set_xlabel('Hidden Neurons (64)', fontsize=10)
+        ax1.set_xlabel(f'Hidden Neurons ({self.hidden_size})', fontsize=10)
         ax1.set_ylabel('Input Features (27)', fontsize=10)
         
         # Add y-axis labels for input features (grouped by type)
@@ -390,18 +414,19 @@ class WeightVisualizer:
         else:
             # Update existing image data with new color range
             self.images['im2'].set_data(self.weights2)
+            self.images['im2'].set_extent((-0.5, self.weights2.shape[1] - 0.5, self.weights2.shape[0] - 0.5, -0.5))
             self.images['im2'].set_clim(vmin2, vmax2)  # Update color scale dynamically
             # Update colorbar
             if 'cb2' in self.colorbars:
                 self.colorbars['cb2'].update_normal(self.images['im2'])
         
-        title2 = ax2.set_title(f'Weights2: Hidden → Output ({HIDDEN_SIZE}×{OUTPUT_SIZE})\n'
+        title2 = ax2.set_title(f'Weights2: Hidden → Output ({self.hidden_size}×{OUTPUT_SIZE})\n'
                      f'Mean: {stats["weights2"]["mean"]:.4f} | Std: {stats["weights2"]["std"]:.4f} | '
                      f'Range: [{stats["weights2"]["min"]:.3f}, {stats["weights2"]["max"]:.3f}]',
                      fontsize=11, fontweight='bold', pad=10)
         self.text_objects.append(title2)
         ax2.set_xlabel('Output Neurons (1)', fontsize=10)
-        ax2.set_ylabel('Hidden Neurons (64)', fontsize=10)
+        ax2.set_ylabel(f'Hidden Neurons ({self.hidden_size})', fontsize=10)
         
         # 3. Bias1 Distribution
         if 'ax3' not in self.axes:
@@ -563,7 +588,7 @@ class WeightVisualizer:
         vmax = max(abs(self.weights1.min()), abs(self.weights1.max()))
         
         im = ax1.imshow(self.weights1, aspect='auto', cmap=cmap, vmin=-vmax, vmax=vmax)
-        ax1.set_title(f'Weights1: Input → Hidden ({INPUT_SIZE}×{HIDDEN_SIZE})', 
+        ax1.set_title(f'Weights1: Input → Hidden ({INPUT_SIZE}×{self.hidden_size})', 
                      fontsize=13, fontweight='bold', pad=10)
         ax1.set_xlabel('Hidden Neurons', fontsize=12)
         ax1.set_ylabel('Input Features', fontsize=12)
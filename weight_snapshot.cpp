@@ -0,0 +1,72 @@
+#include "weight_snapshot.h"
+#include <algorithm>
+#include <limits>
+
+WeightSnapshots::WeightSnapshots()
+    : current(nullptr), global_epoch(1), published_version(0) {
+    for (ReaderSlot& reader : readers) {
+        reader.epoch.store(0);
+    }
+}
+
+WeightSnapshots::~WeightSnapshots() {
+    for (Snapshot* snapshot : buffers) {
+        delete snapshot;
+    }
+}
+
+bool WeightSnapshots::publish(const NeuralNetwork& net) {
+    reclaim();
+    Snapshot* fresh;
+    if (!free_buffers.empty()) {
+        fresh = free_buffers.back();
+        free_buffers.pop_back();
+    } else if (buffers.size() < size_t(MAX_BUFFERS)) {
+        fresh = new Snapshot{NeuralNetwork(net.hidden_size), 0};
+        buffers.push_back(fresh);
+    } else {
+        return false;
+    }
+    fresh->network.copyParametersFrom(net);
+    fresh->network.quantize();
+    fresh->version = ++published_version;
+
+    // Readers that enter after the epoch bump can only see `fresh`; the replaced snapshot
+    // waits until no reader announced an earlier epoch
+    Snapshot* old = current.exchange(fresh);
+    uint64_t epoch = global_epoch.fetch_add(1) + 1;
+    if (old != nullptr) {
+        retired.push_back(std::make_pair(old, epoch));
+    }
+    reclaim();
+    return true;
+}
+
+void WeightSnapshots::reclaim() {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const ReaderSlot& reader : readers) {
+        uint64_t epoch = reader.epoch.load();
+        if (epoch != 0) oldest = std::min(oldest, epoch);
+    }
+    size_t kept = 0;
+    for (size_t k = 0; k < retired.size(); k++) {
+        if (retired[k].second <= oldest) {
+            free_buffers.push_back(retired[k].first);
+        } else {
+            retired[kept++] = retired[k];
+        }
+    }
+    retired.resize(kept);
+}
+
+WeightSnapshots::ReadGuard::ReadGuard(WeightSnapshots& snapshots, int slot)
+    : slot_epoch(snapshots.readers[slot].epoch) {
+    // Announce the epoch before loading the pointer (both sequentially consistent, pairing
+    // with the exchange and the slot scan in publish)
+    slot_epoch.store(snapshots.global_epoch.load());
+    snapshot = snapshots.current.load();
+}
+
+WeightSnapshots::ReadGuard::~ReadGuard() {
+    slot_epoch.store(0);
+}
@@ -0,0 +1,78 @@
+#ifndef WEIGHT_SNAPSHOT_H
+#define WEIGHT_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "rl_agent.h"
+
+// Read-only copies of a network published by one learner thread for any number of reader
+// (actor) threads. publish() copies the parameters into a spare buffer and swaps it in
+// with one atomic exchange, so readers always see a whole snapshot and never block.
+//
+// Reclamation is epoch based (RCU style): a reader announces the global epoch in its slot
+// for as long as it holds a snapshot, and a replaced snapshot is only reused once every
+// active reader announced an epoch at or after the one it was retired in. Buffers are
+// recycled, so steady state allocates nothing; with readers that keep up there are two.
+// A reader that holds on to a snapshot (or is descheduled while holding it) keeps the
+// buffers retired since then; at MAX_BUFFERS publish() skips instead of waiting.
+class WeightSnapshots {
+public:
+    static const int MAX_READERS = 64;  // Reader slots; each reader thread uses its own
+    static const int MAX_BUFFERS = 8;
+
+    struct Snapshot {
+        NeuralNetwork network;  // Parameters and the quantized copy; no optimizer state
+        long long version;      // 1 for the first publish, then +1 per publish
+    };
+
+    WeightSnapshots();
+    ~WeightSnapshots();  // No readers may be active
+    WeightSnapshots(const WeightSnapshots&) = delete;
+    WeightSnapshots& operator=(const WeightSnapshots&) = delete;
+
+    // Learner side (one thread at a time). False when every buffer is still being read;
+    // nothing was published and the caller can try again later
+    bool publish(const NeuralNetwork& net);
+    long long version() const { return published_version; }
+    size_t bufferCount() const { return buffers.size(); }  // Snapshots allocated so far
+    size_t retiredCount() const { return retired.size(); }  // Replaced, still possibly read
+
+    // Reader side: holds the current snapshot until destroyed. Slots must not be shared by
+    // threads holding guards at the same time
+    class ReadGuard {
+    public:
+        ReadGuard(WeightSnapshots& snapshots, int slot);
+        ~ReadGuard();
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        const Snapshot* get() const { return snapshot; }  // nullptr before the first publish
+        const NeuralNetwork* network() const { return snapshot ? &snapshot->network : nullptr; }
+
+    private:
+        std::atomic<uint64_t>& slot_epoch;
+        const Snapshot* snapshot;
+    };
+
+private:
+    // Reader slots padded to a cache line each (C++11 new does not honour alignas); 0 = not reading
+    struct ReaderSlot {
+        std::atomic<uint64_t> epoch;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::atomic<Snapshot*> current;
+    std::atomic<uint64_t> global_epoch;
+    ReaderSlot readers[MAX_READERS];
+
+    // Learner-only bookkeeping
+    long long published_version;
+    std::vector<Snapshot*> buffers;                           // Owns every snapshot
+    std::vector<Snapshot*> free_buffers;
+    std::vector<std::pair<Snapshot*, uint64_t>> retired;  // Snapshot and the epoch it was replaced in
+
+    void reclaim();
+};
+
+#endif // WEIGHT_SNAPSHOT_H
@@ -12,10 +12,12 @@
 #include <sys/stat.h>
 #include <cmath>
 #include <algorithm>
+#include <cstdio>
 
 // Network architecture constants (matching rl_agent.h)
+// The hidden size comes from the model's "# Shape: 27xH" header; files without one are 27x64
 const int INPUT_SIZE = 27;  // ZERO-BASED REDESIGN: 10 heights + 3 board_quality + 7 current + 7 next
-const int HIDDEN_SIZE = 64;
+const int DEFAULT_HIDDEN_SIZE = 64;
 const int OUTPUT_SIZE = 1;
 
 struct Connection {
@@ -38,10 +40,11 @@ private:
     std::string model_file;
     
     // Weight data
-    std::vector<std::vector<double>> weights1;  // 27 x 64
-    std::vector<double> bias1;                   // 64
-    std::vector<std::vector<double>> weights2;   // 64 x 1
+    std::vector<std::vector<double>> weights1;  // 27 x hidden_size
+    std::vector<double> bias1;                   // hidden_size
+    std::vector<std::vector<double>> weights2;   // hidden_size x 1
     std::vector<double> bias2;                   // 1
+    int hidden_size;                             // From the model header
     
     // 3D connections
     std::vector<Connection> connections;
@@ -121,13 +124,25 @@ private:
         file_exists = true;
         std::string line;
         std::vector<std::string> data_lines;
+        int input_size = INPUT_SIZE;
+        int file_hidden_size = DEFAULT_HIDDEN_SIZE;
         
         while (std::getline(file, line)) {
-            if (line.empty() || line[0] == '#') continue;
+            if (line.empty()) continue;
+            if (line[0] == '#') {
+                // Header comments come before any data line
+                if (data_lines.empty()) {
+                    sscanf(line.c_str(), "# Shape: %dx%d", &input_size, &file_hidden_size);
+                }
+                continue;
+            }
             data_lines.push_back(line);
         }
         
-        if (data_lines.size() < INPUT_SIZE + 1 + HIDDEN_SIZE + 1) {
+        if (input_size != INPUT_SIZE || file_hidden_size <= 0) {
+            return false;
+        }
+        if (data_lines.size() < size_t(INPUT_SIZE + 1 + file_hidden_size + 1)) {
             return false;
         }
         
@@ -141,7 +156,7 @@ private:
             while (iss >> val) {
                 weights1[i].push_back(val);
             }
-            if (weights1[i].size() != HIDDEN_SIZE) return false;
+            if (weights1[i].size() != size_t(file_hidden_size)) return false;
         }
         
         // Load bias1
@@ -151,12 +166,12 @@ private:
         while (iss1 >> val) {
             bias1.push_back(val);
         }
-        if (bias1.size() != HIDDEN_SIZE) return false;
+        if (bias1.size() != size_t(file_hidden_size)) return false;
         
         // Load weights2
         weights2.clear();
-        weights2.resize(HIDDEN_SIZE);
-        for (int i = 0; i < HIDDEN_SIZE; i++) {
+        weights2.resize(file_hidden_size);
+        for (int i = 0; i < file_hidden_size; i++) {
             std::istringstream iss(data_lines[INPUT_SIZE + 1 + i]);
             weights2[i].clear();
             while (iss >> val) {
@@ -166,12 +181,13 @@ private:
         }
         
         // Load bias2
-        std::istringstream iss2(data_lines[INPUT_SIZE + 1 + HIDDEN_SIZE]);
+        std::istringstream iss2(data_lines[INPUT_SIZE + 1 + file_hidden_size]);
         bias2.clear();
         while (iss2 >> val) {
             bias2.push_back(val);
         }
         if (bias2.size() != OUTPUT_SIZE) return false;
+        hidden_size = file_hidden_size;
         
         // Build connections for 3D view
         buildConnections();
@@ -192,13 +208,13 @@ private:
         
         // Input to Hidden connections
         for (int i = 0; i < INPUT_SIZE; i++) {
-            for (int j = 0; j < HIDDEN_SIZE; j++) {
+            for (int j = 0; j < hidden_size; j++) {
                 connections.push_back(Connection(0, i, 1, j, weights1[i][j]));
             }
         }
         
         // Hidden to Output connections
-        for (int i = 0; i < HIDDEN_SIZE; i++) {
+        for (int i = 0; i < hidden_size; i++) {
             for (int j = 0; j < OUTPUT_SIZE; j++) {
                 connections.push_back(Connection(1, i, 2, j, weights2[i][j]));
             }
@@ -359,10 +375,10 @@ private:
         drawLayer3DGrid(INPUT_SIZE, 0);
         glPopMatrix();
         
-        // Hidden layer (64 nodes) - arranged in 3D grid (8x8)
+        // Hidden layer (hidden_size nodes) - arranged in 3D grid (8x8 for 64)
         glPushMatrix();
         glTranslatef(0.0f, 0.0f, 0.0f);
-        drawLayer3DGrid(HIDDEN_SIZE, 1);
+        drawLayer3DGrid(hidden_size, 1);
         glPopMatrix();
         
         // Output layer (1 node) - centered
@@ -382,23 +398,26 @@ private:
         SDL_GL_SwapWindow(window);
     }
     
-    void drawLayer3DGrid(int node_count, int layer_id) {
-        // Calculate grid dimensions for 3D layout
-        int cols, rows;
-        
-        if (layer_id == 0) {
+    void layerGridSize(int layer, int& cols, int& rows) {
+        if (layer == 0) {
             // Input layer: 27 nodes -> 6x5 grid (closest rectangle)
             cols = 6;
             rows = 5;
-        } else if (layer_id == 1) {
-            // Hidden layer: 64 nodes -> 8x8 grid
-            cols = 8;
-            rows = 8;
+        } else if (layer == 1) {
+            // Hidden layer: near-square grid (64 nodes -> 8x8, 32 -> 6x6, 128 -> 12x11)
+            cols = (int)std::ceil(std::sqrt((double)hidden_size));
+            rows = (hidden_size + cols - 1) / cols;
         } else {
             // Output layer: 1 node -> centered
             cols = 1;
             rows = 1;
         }
+    }
+    
+    void drawLayer3DGrid(int node_count, int layer_id) {
+        // Calculate grid dimensions for 3D layout
+        int cols, rows;
+        layerGridSize(layer_id, cols, rows);
         
         float node_spacing = 0.4f;
         // Grid is in y-z plane (x is layer position, set by parent glTranslatef)
@@ -433,20 +452,7 @@ private:
     void getNodePosition3D(int layer, int node_index, float& y, float& z, float& x_offset) {
         // Returns y, z position within layer (x_offset will be set by layer spacing)
         int cols, rows;
-        
-        if (layer == 0) {
-            // Input layer: 27 nodes -> 6x5 grid
-            cols = 6;
-            rows = 5;
-        } else if (layer == 1) {
-            // Hidden layer: 64 nodes -> 8x8 grid
-            cols = 8;
-            rows = 8;
-        } else {
-            // Output layer: 1 node -> centered
-            cols = 1;
-            rows = 1;
-        }
+        layerGridSize(layer, cols, rows);
         
         float node_spacing = 0.4f;
         float start_y = -(rows - 1) * node_spacing / 2.0f;
@@ -549,7 +555,7 @@ private:
     
 public:
     WeightVisualizer(const std::string& filename = "tetris_model.txt") 
-        : window(nullptr), gl_context(nullptr), renderer(nullptr), model_file(filename),
+        : window(nullptr), gl_context(nullptr), renderer(nullptr), model_file(filename), hidden_size(DEFAULT_HIDDEN_SIZE),
           last_file_mtime(0), file_exists(false),
           window_width(1600), window_height(900), view_3d(false),
           camera_angle_x(20.0f), camera_angle_y(45.0f), camera_distance(8.0f),